@@ -1,5 +1,7 @@
 TEMPLATE = subdirs
 SUBDIRS  = \
+    adblockbenchmark \
+    adblockengine \
     adblockmanager \
     adblocknetwork \
     adblockpage \
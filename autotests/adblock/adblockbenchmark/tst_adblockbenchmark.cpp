@@ -0,0 +1,375 @@
+/**
+ * Copyright (c) 2009, Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Benjamin Meyer nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <qtest.h>
+#include <qtry.h>
+
+#include "adblockengine.h"
+#include "adblockmanager.h"
+#include "adblocknetwork.h"
+#include "adblockpage.h"
+#include "adblockrule.h"
+#include "adblockrulestore.h"
+#include "adblocksubscription.h"
+
+#include <qdebug.h>
+#include <qdir.h>
+#include <qfile.h>
+#include <qnetworkreply.h>
+#include <qnetworkrequest.h>
+#include <qpair.h>
+#include <qtemporaryfile.h>
+#include <qtextstream.h>
+#include <qwebframe.h>
+#include <qwebpage.h>
+
+#if defined(Q_OS_LINUX)
+#include <time.h>
+#include <unistd.h>
+#else
+#include <qdatetime.h>
+#endif
+
+/*
+    Offline benchmarks for the adblock matcher.
+
+    By default the bundled filters.txt (the rule shapes found in EasyList)
+    is padded with generated rules up to ADBLOCK_BENCHMARK_RULES rules and
+    the requests in urls.txt are replayed.  Point ADBLOCK_BENCHMARK_LIST at
+    a downloaded filter list and ADBLOCK_BENCHMARK_URLS at a recorded
+    corpus (same format as urls.txt) to benchmark against real data.
+ */
+class tst_AdBlockBenchmark : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+private slots:
+    void parseRules();
+    void loadSubscription();
+    void buildEngine();
+    void memory();
+    void block_data();
+    void block();
+    void matchLatency();
+    void elementHidingStyleSheet();
+    void applyRulesToPage();
+
+private:
+    QStringList m_filters;
+    QExplicitlySharedDataPointer<AdBlockRuleStore> m_rules;
+    QList<QPair<QUrl, QUrl> > m_requests;
+    QList<QUrl> m_pages;
+    QTemporaryFile m_listFile;
+    QUrl m_subscriptionUrl;
+};
+
+static qint64 nanoseconds()
+{
+#if defined(Q_OS_LINUX)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+    static QTime start = QTime::currentTime();
+    return qint64(start.msecsTo(QTime::currentTime())) * 1000000;
+#endif
+}
+
+// Resident set size in kilobytes, -1 where we do not know how to get it
+static qint64 residentMemory()
+{
+#if defined(Q_OS_LINUX)
+    QFile file(QLatin1String("/proc/self/statm"));
+    if (!file.open(QFile::ReadOnly))
+        return -1;
+    QList<QByteArray> fields = file.readAll().split(' ');
+    if (fields.count() < 2)
+        return -1;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+#else
+    return -1;
+#endif
+}
+
+static QString dataFile(const char *environment, const QString &fallback)
+{
+    QByteArray fileName = qgetenv(environment);
+    if (!fileName.isEmpty())
+        return QFile::decodeName(fileName);
+    return QDir::currentPath() + QLatin1Char('/') + fallback;
+}
+
+// Rules shaped like the common classes in EasyList
+static QStringList generatedRules(int count)
+{
+    QStringList rules;
+    for (int i = 0; i < count; ++i) {
+        switch (i % 8) {
+        case 0: rules.append(QString("||ads%1.network%2.com^").arg(i).arg(i % 97)); break;
+        case 1: rules.append(QString("/banner%1/*/ad.gif").arg(i)); break;
+        case 2: rules.append(QString("&adid=%1&").arg(i)); break;
+        case 3: rules.append(QString("|http://cdn%1.example-ads.net/").arg(i)); break;
+        case 4: rules.append(QString("/promo%1.$script,third-party").arg(i)); break;
+        case 5: rules.append(QString("@@||partner%1.example.com^$third-party").arg(i)); break;
+        case 6: rules.append(QString("##.ad-slot-%1").arg(i)); break;
+        case 7: rules.append(QString("site%1.example.com##.sponsor-%1").arg(i)); break;
+        }
+    }
+    return rules;
+}
+
+// This will be called before the first test function is executed.
+// It is only called once.
+void tst_AdBlockBenchmark::initTestCase()
+{
+    QString listFileName = dataFile("ADBLOCK_BENCHMARK_LIST", QLatin1String("filters.txt"));
+    QFile listFile(listFileName);
+    QVERIFY2(listFile.open(QFile::ReadOnly), qPrintable(listFileName));
+    QTextStream listStream(&listFile);
+    listStream.readLine(); // header
+    while (!listStream.atEnd())
+        m_filters.append(listStream.readLine());
+
+    int total = qgetenv("ADBLOCK_BENCHMARK_RULES").toInt();
+    if (total == 0 && qgetenv("ADBLOCK_BENCHMARK_LIST").isEmpty())
+        total = 20000;
+    if (total > m_filters.count())
+        m_filters += generatedRules(total - m_filters.count());
+
+    QString urlsFileName = dataFile("ADBLOCK_BENCHMARK_URLS", QLatin1String("urls.txt"));
+    QFile urlsFile(urlsFileName);
+    QVERIFY2(urlsFile.open(QFile::ReadOnly), qPrintable(urlsFileName));
+    QTextStream urlsStream(&urlsFile);
+    QUrl page;
+    while (!urlsStream.atEnd()) {
+        QString line = urlsStream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#')))
+            continue;
+        if (line.startsWith(QLatin1String("page "))) {
+            page = QUrl::fromEncoded(line.mid(5).toUtf8());
+            m_pages.append(page);
+            continue;
+        }
+        m_requests.append(qMakePair(QUrl::fromEncoded(line.toUtf8()), page));
+    }
+
+    QVERIFY(m_listFile.open());
+    QTextStream out(&m_listFile);
+    out << "[Adblock Plus 0.7.1]" << endl;
+    foreach (const QString &filter, m_filters)
+        out << filter << endl;
+    m_listFile.close();
+
+    m_rules = new AdBlockRuleStore;
+    foreach (const QString &filter, m_filters)
+        m_rules->append(filter);
+
+    QString location = QString::fromUtf8(QUrl::fromLocalFile(m_listFile.fileName()).toEncoded());
+    m_subscriptionUrl = QUrl(QString("abp:subscribe?location=%1&title=benchmark").arg(location));
+
+    AdBlockManager *manager = AdBlockManager::instance();
+    foreach (AdBlockSubscription *subscription, manager->subscriptions())
+        manager->removeSubscription(subscription);
+    manager->setEnabled(true);
+    manager->addSubscription(new AdBlockSubscription(m_subscriptionUrl, manager));
+    // Large engines are built in the background
+    QTRY_VERIFY(manager->engine()->count() > 0);
+
+    qDebug() << "rules:" << m_filters.count() << "requests:" << m_requests.count() << "pages:" << m_pages.count();
+}
+
+// This will be called after the last test function is executed.
+// It is only called once.
+void tst_AdBlockBenchmark::cleanupTestCase()
+{
+    AdBlockManager *manager = AdBlockManager::instance();
+    foreach (AdBlockSubscription *subscription, manager->subscriptions())
+        manager->removeSubscription(subscription);
+}
+
+// This will be called before each test function is executed.
+void tst_AdBlockBenchmark::init()
+{
+}
+
+// This will be called after every test function.
+void tst_AdBlockBenchmark::cleanup()
+{
+}
+
+void tst_AdBlockBenchmark::parseRules()
+{
+    QBENCHMARK {
+        AdBlockRuleStore rules;
+        foreach (const QString &filter, m_filters)
+            rules.append(filter);
+    }
+}
+
+// Reading the text file, parsing it and indexing the subscription
+void tst_AdBlockBenchmark::loadSubscription()
+{
+    QBENCHMARK {
+        AdBlockSubscription subscription(m_subscriptionUrl);
+        QCOMPARE(subscription.allRules().count(), m_filters.count());
+    }
+}
+
+void tst_AdBlockBenchmark::buildEngine()
+{
+    QBENCHMARK {
+        AdBlockEngine engine;
+        engine.addRules(m_rules, 0);
+    }
+}
+
+void tst_AdBlockBenchmark::memory()
+{
+    qint64 before = residentMemory();
+    if (before == -1)
+        QSKIP("Resident memory is not available on this platform", SkipSingle);
+
+    QExplicitlySharedDataPointer<AdBlockRuleStore> rules(new AdBlockRuleStore);
+    foreach (const QString &filter, m_filters)
+        rules->append(filter);
+    qint64 parsed = residentMemory();
+    AdBlockEngine *engine = new AdBlockEngine;
+    engine->addRules(rules, 0);
+    qint64 built = residentMemory();
+
+    qDebug() << "resident kB, rules:" << parsed - before << "engine:" << built - parsed
+             << "per rule (bytes):" << (built - before) * 1024 / qMax(1, m_filters.count());
+    delete engine;
+    rules = 0;
+}
+
+void tst_AdBlockBenchmark::block_data()
+{
+    QTest::addColumn<bool>("cached");
+    QTest::newRow("uncached") << false;
+    QTest::newRow("cached") << true;
+}
+
+// Every request of the corpus through AdBlockNetwork::block()
+void tst_AdBlockBenchmark::block()
+{
+    QFETCH(bool, cached);
+
+    AdBlockNetwork network;
+    if (!cached)
+        network.setCacheSize(0);
+
+    QList<QNetworkRequest> requests;
+    for (int i = 0; i < m_requests.count(); ++i)
+        requests.append(QNetworkRequest(m_requests.at(i).first));
+
+    QBENCHMARK {
+        foreach (const QNetworkRequest &request, requests)
+            delete network.block(request);
+    }
+    qDebug() << "cache hits:" << network.cacheHits() << "misses:" << network.cacheMisses();
+}
+
+/*
+    Time each request of the corpus against the engine with the page it
+    came from and report the distribution, a single slow rule shows up in
+    the high percentiles long before it moves the average.
+ */
+void tst_AdBlockBenchmark::matchLatency()
+{
+    const AdBlockEngine *engine = AdBlockManager::instance()->engine();
+    const int repeat = 20;
+
+    QList<qint64> latencies;
+    int blocked = 0;
+    int allowed = 0;
+    for (int i = 0; i < m_requests.count(); ++i) {
+        QUrl url = m_requests.at(i).first;
+        QUrl page = m_requests.at(i).second;
+        QString encodedUrl = QString::fromUtf8(url.toEncoded());
+
+        AdBlockEngine::Result result = AdBlockEngine::NoMatch;
+        qint64 start = nanoseconds();
+        for (int j = 0; j < repeat; ++j) {
+            AdBlockRequestContext context(url, page);
+            result = engine->match(encodedUrl, context);
+        }
+        latencies.append((nanoseconds() - start) / repeat);
+
+        if (result == AdBlockEngine::Blocked)
+            ++blocked;
+        else if (result == AdBlockEngine::Allowed)
+            ++allowed;
+    }
+    QVERIFY(!latencies.isEmpty());
+
+    qSort(latencies);
+    int count = latencies.count();
+    qDebug() << "blocked:" << blocked << "allowed:" << allowed << "of" << count;
+    qDebug() << "match latency (ns) p50:" << latencies.at(count / 2)
+             << "p90:" << latencies.at(count * 9 / 10)
+             << "p99:" << latencies.at(count * 99 / 100)
+             << "max:" << latencies.last();
+}
+
+void tst_AdBlockBenchmark::elementHidingStyleSheet()
+{
+    const AdBlockEngine *engine = AdBlockManager::instance()->engine();
+    QBENCHMARK {
+        foreach (const QUrl &page, m_pages)
+            engine->elementHidingStyleSheet(page.host());
+    }
+}
+
+// Includes AdBlockPage's per host stylesheet cache
+void tst_AdBlockBenchmark::applyRulesToPage()
+{
+    AdBlockPage adBlockPage;
+    QList<QWebPage*> pages;
+    foreach (const QUrl &url, m_pages) {
+        QWebPage *page = new QWebPage(this);
+        page->mainFrame()->setHtml(QLatin1String("<html><body></body></html>"), url);
+        pages.append(page);
+    }
+
+    QBENCHMARK {
+        foreach (QWebPage *page, pages)
+            adBlockPage.applyRulesToPage(page);
+    }
+    qDeleteAll(pages);
+}
+
+QTEST_MAIN(tst_AdBlockBenchmark)
+#include "tst_adblockbenchmark.moc"
+
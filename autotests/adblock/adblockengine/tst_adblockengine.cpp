@@ -0,0 +1,328 @@
+/**
+ * Copyright (c) 2009, Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Benjamin Meyer nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <qtest.h>
+
+#include "adblockengine.h"
+#include "adblockrule.h"
+#include "adblocksubscription.h"
+
+class tst_AdBlockEngine : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+private slots:
+    void adblockengine();
+    void match_data();
+    void match();
+    void disabledSubscription();
+    void rulesOutliveSubscription();
+    void updateRules();
+    void addRules();
+    void elementHidingStyleSheet_data();
+    void elementHidingStyleSheet();
+};
+
+// This will be called before the first test function is executed.
+// It is only called once.
+void tst_AdBlockEngine::initTestCase()
+{
+}
+
+// This will be called after the last test function is executed.
+// It is only called once.
+void tst_AdBlockEngine::cleanupTestCase()
+{
+}
+
+// This will be called before each test function is executed.
+void tst_AdBlockEngine::init()
+{
+}
+
+// This will be called after every test function.
+void tst_AdBlockEngine::cleanup()
+{
+}
+
+void tst_AdBlockEngine::adblockengine()
+{
+    AdBlockEngine engine;
+    QCOMPARE(engine.count(), 0);
+    QCOMPARE(engine.match(QString()), AdBlockEngine::NoMatch);
+    engine.addSubscription(0);
+    engine.clear();
+    QCOMPARE(engine.count(), 0);
+}
+
+Q_DECLARE_METATYPE(AdBlockEngine::Result)
+void tst_AdBlockEngine::match_data()
+{
+    QTest::addColumn<QString>("firstRules");
+    QTest::addColumn<QString>("secondRules");
+    QTest::addColumn<QUrl>("url");
+    QTest::addColumn<AdBlockEngine::Result>("result");
+    QTest::addColumn<QString>("rule");
+    QTest::addColumn<int>("subscription");
+
+    QUrl url("http://example.com/ads/advice.html");
+    QTest::newRow("null") << QString() << QString() << url
+                          << AdBlockEngine::NoMatch << QString() << -1;
+    QTest::newRow("block-first") << QString("/ads/") << QString() << url
+                                 << AdBlockEngine::Blocked << QString("/ads/") << 0;
+    QTest::newRow("block-second") << QString() << QString("/ads/") << url
+                                  << AdBlockEngine::Blocked << QString("/ads/") << 1;
+    QTest::newRow("allow-same") << QString("/ads/,@@advice") << QString() << url
+                                << AdBlockEngine::Allowed << QString("@@advice") << 0;
+    QTest::newRow("allow-other") << QString("/ads/") << QString("@@advice") << url
+                                 << AdBlockEngine::Allowed << QString("@@advice") << 1;
+    QTest::newRow("allow-earlier") << QString("@@advice") << QString("/ads/") << url
+                                   << AdBlockEngine::Allowed << QString("@@advice") << 0;
+    QTest::newRow("no-match") << QString("/banner/") << QString("@@/other/") << url
+                              << AdBlockEngine::NoMatch << QString() << -1;
+    QTest::newRow("css") << QString("##div.ads") << QString() << url
+                         << AdBlockEngine::NoMatch << QString() << -1;
+
+    QTest::newRow("host") << QString("||example.com^") << QString() << url
+                          << AdBlockEngine::Blocked << QString("||example.com^") << 0;
+    QTest::newRow("host-subdomain") << QString("||example.com^") << QString()
+                                    << QUrl("http://ads.cdn.example.com:8080/x.gif")
+                                    << AdBlockEngine::Blocked << QString("||example.com^") << 0;
+    QTest::newRow("host-userinfo") << QString("||example.com^") << QString()
+                                   << QUrl("http://user@example.com/")
+                                   << AdBlockEngine::Blocked << QString("||example.com^") << 0;
+    QTest::newRow("host-label") << QString("||ample.com^") << QString() << url
+                                << AdBlockEngine::NoMatch << QString() << -1;
+    QTest::newRow("host-suffix") << QString("||example.co^") << QString() << url
+                                 << AdBlockEngine::NoMatch << QString() << -1;
+    QTest::newRow("host-path") << QString("||advice.html^") << QString() << url
+                               << AdBlockEngine::NoMatch << QString() << -1;
+    QTest::newRow("host-exception") << QString("||example.com^") << QString("@@||example.com^") << url
+                                    << AdBlockEngine::Allowed << QString("@@||example.com^") << 1;
+    QTest::newRow("host-exception-parent") << QString("||ads.example.com^") << QString("@@||example.com^")
+                                           << QUrl("http://ads.example.com/")
+                                           << AdBlockEngine::Allowed << QString("@@||example.com^") << 1;
+}
+
+// public Result match(QString const &encodedUrl, AdBlockRule *rule, AdBlockSubscription const **subscription) const
+void tst_AdBlockEngine::match()
+{
+    QFETCH(QString, firstRules);
+    QFETCH(QString, secondRules);
+    QFETCH(QUrl, url);
+    QFETCH(AdBlockEngine::Result, result);
+    QFETCH(QString, rule);
+    QFETCH(int, subscription);
+
+    AdBlockSubscription first(QUrl("abp:subscribe?location=&title=first"));
+    AdBlockSubscription second(QUrl("abp:subscribe?location=&title=second"));
+    first.setEnabled(true);
+    second.setEnabled(true);
+    if (!firstRules.isEmpty()) {
+        foreach (const QString &filter, firstRules.split(QLatin1Char(',')))
+            first.addRule(AdBlockRule(filter));
+    }
+    if (!secondRules.isEmpty()) {
+        foreach (const QString &filter, secondRules.split(QLatin1Char(',')))
+            second.addRule(AdBlockRule(filter));
+    }
+
+    AdBlockEngine engine;
+    engine.addSubscription(&first);
+    engine.addSubscription(&second);
+
+    AdBlockRule matchedRule;
+    const AdBlockSubscription *matchedSubscription = 0;
+    QCOMPARE(engine.match(QString::fromUtf8(url.toEncoded()), &matchedRule, &matchedSubscription), result);
+    QCOMPARE(matchedRule.filter(), rule);
+    const AdBlockSubscription *expected = 0;
+    if (subscription == 0)
+        expected = &first;
+    if (subscription == 1)
+        expected = &second;
+    QCOMPARE(matchedSubscription, expected);
+}
+
+void tst_AdBlockEngine::disabledSubscription()
+{
+    AdBlockSubscription subscription(QUrl("abp:subscribe?location=&title=disabled"));
+    subscription.setEnabled(false);
+    subscription.addRule(AdBlockRule("/ads/"));
+
+    AdBlockEngine engine;
+    engine.addSubscription(&subscription);
+    QCOMPARE(engine.count(), 0);
+    QCOMPARE(engine.match(QLatin1String("http://example.com/ads/")), AdBlockEngine::NoMatch);
+}
+
+void tst_AdBlockEngine::rulesOutliveSubscription()
+{
+    AdBlockSubscription subscription(QUrl("abp:subscribe?location=&title=custom"));
+    subscription.setEnabled(true);
+    subscription.addRule(AdBlockRule("/ads/"));
+
+    AdBlockEngine engine;
+    engine.addSubscription(&subscription);
+
+    // Editing the subscription must not invalidate the engine's rules
+    subscription.removeRule(0);
+    subscription.addRule(AdBlockRule("/other/"));
+
+    AdBlockRule rule;
+    QCOMPARE(engine.match(QLatin1String("http://example.com/ads/"), &rule), AdBlockEngine::Blocked);
+    QVERIFY(!rule.isNull());
+    QCOMPARE(rule.filter(), QString("/ads/"));
+}
+
+// public bool updateRules(QExplicitlySharedDataPointer<AdBlockRuleStore> const &rules, AdBlockSubscription const *subscription, AdBlockRuleChange const &change)
+void tst_AdBlockEngine::updateRules()
+{
+    AdBlockSubscription subscription(QUrl("abp:subscribe?location=&title=custom"));
+    subscription.setEnabled(true);
+    subscription.addRule(AdBlockRule("/ads/"));
+    subscription.addRule(AdBlockRule("||tracker.com^"));
+
+    AdBlockEngine engine;
+    engine.addSubscription(&subscription);
+    QCOMPARE(engine.count(), 2);
+
+    subscription.addRule(AdBlockRule("@@/ads/good"));
+    int id = subscription.ruleStore()->id(2);
+    QVERIFY(engine.updateRules(subscription.ruleStore(), &subscription,
+                               AdBlockRuleChange(AdBlockRuleChange::Added, 2, id)));
+    QCOMPARE(engine.match(QLatin1String("http://example.com/ads/good")), AdBlockEngine::Allowed);
+
+    id = subscription.ruleStore()->id(1);
+    subscription.removeRule(1);
+    QVERIFY(engine.updateRules(subscription.ruleStore(), &subscription,
+                               AdBlockRuleChange(AdBlockRuleChange::Removed, 1, id)));
+    QCOMPARE(engine.count(), 2);
+    QCOMPARE(engine.match(QLatin1String("http://ads.tracker.com/")), AdBlockEngine::NoMatch);
+
+    id = subscription.ruleStore()->id(0);
+    subscription.replaceRule(AdBlockRule("/banner/"), 0);
+    QVERIFY(engine.updateRules(subscription.ruleStore(), &subscription,
+                               AdBlockRuleChange(AdBlockRuleChange::Replaced, 0, id)));
+    QCOMPARE(engine.match(QLatin1String("http://example.com/ads/")), AdBlockEngine::NoMatch);
+    QCOMPARE(engine.match(QLatin1String("http://example.com/banner/")), AdBlockEngine::Blocked);
+
+    // Element hiding rules need a new engine
+    subscription.addRule(AdBlockRule("##div.ads"));
+    id = subscription.ruleStore()->id(2);
+    QVERIFY(!engine.updateRules(subscription.ruleStore(), &subscription,
+                                AdBlockRuleChange(AdBlockRuleChange::Added, 2, id)));
+}
+
+// public void addRules(QList<AdBlockRule> const &rules, AdBlockSubscription const *subscription)
+void tst_AdBlockEngine::addRules()
+{
+    AdBlockSubscription subscription(QUrl("abp:subscribe?location=&title=snapshot"));
+    QList<AdBlockRule> rules;
+    rules.append(AdBlockRule("/ads/"));
+    rules.append(AdBlockRule("@@/ads/allowed"));
+    rules.append(AdBlockRule("!/banner/"));
+    rules.append(AdBlockRule("example.com##div.ads"));
+
+    // The subscription only tags the rules, it does not have to be enabled
+    AdBlockEngine engine;
+    engine.addRules(rules, &subscription);
+    QCOMPARE(engine.count(), 2);
+
+    const AdBlockSubscription *matchedSubscription = 0;
+    QCOMPARE(engine.match(QLatin1String("http://example.com/ads/"), 0, &matchedSubscription), AdBlockEngine::Blocked);
+    QCOMPARE(matchedSubscription, &subscription);
+    QCOMPARE(engine.match(QLatin1String("http://example.com/ads/allowed")), AdBlockEngine::Allowed);
+    QCOMPARE(engine.match(QLatin1String("http://example.com/banner/")), AdBlockEngine::NoMatch);
+}
+
+void tst_AdBlockEngine::elementHidingStyleSheet_data()
+{
+    QTest::addColumn<QString>("rules");
+    QTest::addColumn<QString>("host");
+    QTest::addColumn<QStringList>("selectors");
+
+    QTest::newRow("null") << QString() << QString("example.com") << QStringList();
+    QTest::newRow("generic") << QString("##div.ads") << QString("example.com")
+                             << (QStringList() << "div.ads");
+    QTest::newRow("disabled") << QString("!##div.ads") << QString("example.com") << QStringList();
+    QTest::newRow("network") << QString("/ads/") << QString("example.com") << QStringList();
+    QTest::newRow("domain") << QString("example.com##div.ads") << QString("example.com")
+                            << (QStringList() << "div.ads");
+    QTest::newRow("subdomain") << QString("example.com##div.ads") << QString("www.Example.com")
+                               << (QStringList() << "div.ads");
+    QTest::newRow("other-domain") << QString("example.com##div.ads") << QString("example.org")
+                                  << QStringList();
+    QTest::newRow("label") << QString("ample.com##div.ads") << QString("example.com")
+                           << QStringList();
+    QTest::newRow("multiple") << QString("example.org,example.com##div.ads") << QString("example.com")
+                              << (QStringList() << "div.ads");
+    QTest::newRow("excluded") << QString("example.com,~www.example.com##div.ads") << QString("www.example.com")
+                              << QStringList();
+    QTest::newRow("not-excluded") << QString("example.com,~www.example.com##div.ads") << QString("ads.example.com")
+                                  << (QStringList() << "div.ads");
+    QTest::newRow("generic-excluded") << QString("~example.com##div.ads|##p.ads") << QString("www.example.com")
+                                      << (QStringList() << "p.ads");
+    QTest::newRow("generic-not-excluded") << QString("~example.com##div.ads|##p.ads") << QString("example.org")
+                                          << (QStringList() << "div.ads" << "p.ads");
+    QTest::newRow("duplicate-domain") << QString("example.com,www.example.com##div.ads") << QString("www.example.com")
+                                      << (QStringList() << "div.ads");
+    QTest::newRow("braces") << QString("##div { color: red }") << QString("example.com") << QStringList();
+}
+
+// public QString elementHidingStyleSheet(QString const &host) const
+void tst_AdBlockEngine::elementHidingStyleSheet()
+{
+    QFETCH(QString, rules);
+    QFETCH(QString, host);
+    QFETCH(QStringList, selectors);
+
+    AdBlockSubscription subscription(QUrl("abp:subscribe?location=&title=hiding"));
+    subscription.setEnabled(true);
+    if (!rules.isEmpty()) {
+        foreach (const QString &filter, rules.split(QLatin1Char('|')))
+            subscription.addRule(AdBlockRule(filter));
+    }
+
+    AdBlockEngine engine;
+    engine.addSubscription(&subscription);
+
+    QString expected;
+    foreach (const QString &selector, selectors)
+        expected += selector + QLatin1String(" { display: none !important; }\n");
+    QCOMPARE(engine.elementHidingStyleSheet(host), expected);
+}
+
+QTEST_MAIN(tst_AdBlockEngine)
+#include "tst_adblockengine.moc"
+
@@ -27,6 +27,7 @@
  */
 
 #include <qtest.h>
+#include <qpointer.h>
 #include <qsignalspy.h>
 #include <qtry.h>
 
@@ -203,6 +204,14 @@ void tst_AdBlockManager::removeSubscription()
     QCOMPARE(manager.subscriptions(), list);
 
     QCOMPARE(spy0.count(), 2);
+
+    // Kept until an engine without it is in use
+    QPointer<AdBlockSubscription> guard(subscription);
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+    QVERIFY(guard);
+    manager.engine();
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+    QVERIFY(!guard);
 }
 
 
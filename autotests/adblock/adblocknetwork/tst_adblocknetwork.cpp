@@ -56,6 +56,8 @@ private slots:
 
     void block_data();
     void block();
+
+    void cache();
 };
 
 // Subclass that exposes the protected functions.
@@ -219,6 +221,41 @@ void tst_AdBlockNetwork::block()
     QCOMPARE(blocked, block);
 }
 
+void tst_AdBlockNetwork::cache()
+{
+    SubAdBlockNetwork network;
+    network.setCacheSize(10);
+    QCOMPARE(network.cacheSize(), 10);
+
+    AdBlockManager *manager = AdBlockManager::instance();
+    manager->setEnabled(true);
+
+    AdBlockSubscription *subscription = new AdBlockSubscription(QUrl(), manager);
+    subscription->setEnabled(true);
+    manager->addSubscription(subscription);
+    subscription->addRule(AdBlockRule("/ads/"));
+
+    QNetworkRequest request(QUrl("http://example.com/ads/banner.gif"));
+    QVERIFY(network.block(request));
+    QCOMPARE(network.cacheHits(), 0);
+    QCOMPARE(network.cacheMisses(), 1);
+    QVERIFY(network.block(request));
+    QCOMPARE(network.cacheHits(), 1);
+    QCOMPARE(network.cacheMisses(), 1);
+
+    // Changing the rules makes the cached verdict stale
+    subscription->addRule(AdBlockRule("@@/ads/banner"));
+    QVERIFY(!network.block(request));
+    QCOMPARE(network.cacheHits(), 1);
+    QCOMPARE(network.cacheMisses(), 2);
+    QVERIFY(!network.block(request));
+    QCOMPARE(network.cacheHits(), 2);
+
+    network.resetCacheStatistics();
+    QCOMPARE(network.cacheHits(), 0);
+    QCOMPARE(network.cacheMisses(), 0);
+}
+
 QTEST_MAIN(tst_AdBlockNetwork)
 #include "tst_adblocknetwork.moc"
 
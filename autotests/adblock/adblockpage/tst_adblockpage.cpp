@@ -38,6 +38,7 @@
 
 #include <qwebview.h>
 #include <qwebframe.h>
+#include <qwebsettings.h>
 #include <qdebug.h>
 #include <qdir.h>
 
@@ -57,6 +58,8 @@ private slots:
 
     void applyRulesToPage_data();
     void applyRulesToPage();
+    void userStyleSheet_data();
+    void userStyleSheet();
 };
 
 // Subclass that exposes the protected functions.
@@ -124,6 +127,12 @@ void tst_AdBlockPage::applyRulesToPage_data()
     QTest::newRow("attribute-3") << QString("##div[title^=\"adv\"][title$=\"ert\"]") << start - 1;
 
     // Advanced selectors
+
+    // Domain restrictions, test.html is a local file without a host
+    QTest::newRow("domain-0") << QString("example.com##div.textad") << start;
+    QTest::newRow("domain-1") << QString("~example.com##div.textad") << start - 1;
+    QTest::newRow("combined") << QString("##div.textad,##div#sponsorad,##textad") << start - 3;
+    QTest::newRow("invalid") << QString("##div[,##div.textad") << start - 1;
 }
 
 // public void applyRulesToPage(QWebPage *page)
@@ -150,9 +159,58 @@ void tst_AdBlockPage::applyRulesToPage()
 
     SubAdBlockPage page;
     page.applyRulesToPage(view.page());
-    if (view.page()->mainFrame()->toHtml().count("tofu") != count)
+
+    // Hidden elements stay in the document, count the ones still displayed
+    QString script = "var visible = 0;"
+                     "var nodes = document.body.childNodes;"
+                     "for (var i = 0; i < nodes.length; ++i) {"
+                     "    if (nodes[i].nodeType == 1"
+                     "        && window.getComputedStyle(nodes[i], null).display != 'none')"
+                     "        ++visible;"
+                     "}"
+                     "visible;";
+    int visible = view.page()->mainFrame()->evaluateJavaScript(script).toInt();
+    if (visible != count)
         qDebug() << view.page()->mainFrame()->toHtml();
-    QCOMPARE(view.page()->mainFrame()->toHtml().count("tofu"), count);
+    QCOMPARE(visible, count);
+}
+
+void tst_AdBlockPage::userStyleSheet_data()
+{
+    QTest::addColumn<QUrl>("globalStyleSheetUrl");
+    QTest::addColumn<bool>("merged");
+    QTest::newRow("none") << QUrl() << true;
+    QTest::newRow("data") << QUrl("data:text/css;charset=utf-8;base64," + QByteArray("p { color: red; }").toBase64()) << true;
+    QTest::newRow("remote") << QUrl("http://example.com/user.css") << false;
+}
+
+// The user's own stylesheet is kept when it can not be merged with ours
+void tst_AdBlockPage::userStyleSheet()
+{
+    QFETCH(QUrl, globalStyleSheetUrl);
+    QFETCH(bool, merged);
+
+    AdBlockManager *manager = AdBlockManager::instance();
+    manager->setEnabled(true);
+
+    AdBlockSubscription *subscription = new AdBlockSubscription(QUrl(), manager);
+    subscription->setEnabled(true);
+    manager->addSubscription(subscription);
+    subscription->addRule(AdBlockRule("##div.textad"));
+
+    QWebSettings *settings = QWebSettings::globalSettings();
+    QUrl oldUrl = settings->userStyleSheetUrl();
+    settings->setUserStyleSheetUrl(globalStyleSheetUrl);
+
+    QWebPage webPage;
+    SubAdBlockPage page;
+    page.applyRulesToPage(&webPage);
+    QUrl url = webPage.settings()->userStyleSheetUrl();
+    settings->setUserStyleSheetUrl(oldUrl);
+
+    QCOMPARE(url.scheme() == QLatin1String("data"), merged);
+    if (!merged)
+        QVERIFY(url.isEmpty());
 }
 
 QTEST_MAIN(tst_AdBlockPage)
@@ -23,6 +23,7 @@
 #include "adblockrule.h"
 
 #include <qbuffer.h>
+#include <qdatastream.h>
 #include <qdebug.h>
 
 class tst_AdBlockRule : public QObject
@@ -40,6 +41,16 @@ private slots:
     void regexpCreation();
     void networkMatch_data();
     void networkMatch();
+    void networkMatchContext_data();
+    void networkMatchContext();
+    void token_data();
+    void token();
+    void matchType_data();
+    void matchType();
+    void hostAnchor_data();
+    void hostAnchor();
+    void dataStream_data();
+    void dataStream();
 
 };
 
@@ -152,6 +163,28 @@ void tst_AdBlockRule::networkMatch_data()
                     << QUrl("http://gooddomain.example/analyze?http://example.com/banner.gif")
                     << false;
 
+    QTest::newRow("m12") << QString("||example.com^")
+                    << QUrl("http://ads.example.com:8080/")
+                    << true;
+    QTest::newRow("m13") << QString("||example.com^")
+                    << QUrl("http://example.com.evil.org/")
+                    << false;
+    QTest::newRow("m14") << QString("|http://example.com/|")
+                    << QUrl("http://example.com/")
+                    << true;
+    QTest::newRow("m15") << QString("|http://example.com/|")
+                    << QUrl("http://example.com/foo")
+                    << false;
+    QTest::newRow("m16") << QString("/ads/*/banner^")
+                    << QUrl("http://example.com/ads/x/y/banner?id=1")
+                    << true;
+    QTest::newRow("m17") << QString("/ads/*/banner^")
+                    << QUrl("http://example.com/ads/x/bannerad")
+                    << false;
+    QTest::newRow("m18") << QString("*.gif*|")
+                    << QUrl("http://example.com/a.gif?x")
+                    << true;
+
     QTest::newRow("m11") << QString("/getad.php|")
                     << QUrl("http://adblockplus.mozdev.org/easylist/easylist.txt")
                     << false;
@@ -335,6 +368,65 @@ void tst_AdBlockRule::networkMatch()
     QCOMPARE(AdBlockRule.networkMatch(url.toEncoded()), networkMatch);
 }
 
+void tst_AdBlockRule::networkMatchContext_data()
+{
+    QTest::addColumn<QString>("filter");
+    QTest::addColumn<QUrl>("url");
+    QTest::addColumn<QUrl>("pageUrl");
+    QTest::addColumn<bool>("networkMatch");
+
+    QUrl snap("http://spa.snap.com/snap_preview_anywhere.js?ap=1");
+    QTest::newRow("null") << QString() << QUrl() << QUrl() << false;
+    QTest::newRow("no-page") << QString("||snap.com^$third-party") << snap << QUrl() << false;
+    QTest::newRow("third-party") << QString("||snap.com^$third-party") << snap
+                                 << QUrl("http://www.techcrunch.com/") << true;
+    QTest::newRow("same-site") << QString("||snap.com^$third-party") << snap
+                               << QUrl("http://www.snap.com/") << false;
+    QTest::newRow("first-party") << QString("||snap.com^$~third-party") << snap
+                                 << QUrl("http://snap.com/") << true;
+    QTest::newRow("not-first-party") << QString("||snap.com^$~third-party") << snap
+                                     << QUrl("http://www.techcrunch.com/") << false;
+    QTest::newRow("second-level") << QString("/ads/$third-party") << QUrl("http://static.bbc.co.uk/ads/x.gif")
+                                  << QUrl("http://www.bbc.co.uk/") << false;
+    QTest::newRow("second-level-other") << QString("/ads/$third-party") << QUrl("http://static.bbc.co.uk/ads/x.gif")
+                                        << QUrl("http://www.itv.co.uk/") << true;
+
+    QTest::newRow("domain") << QString("/ads/$domain=example.com") << QUrl("http://cdn.net/ads/x.gif")
+                            << QUrl("http://www.example.com/") << true;
+    QTest::newRow("domain-other") << QString("/ads/$domain=example.com") << QUrl("http://example.com/ads/x.gif")
+                                  << QUrl("http://example.org/") << false;
+    QTest::newRow("domain-excluded") << QString("/ads/$domain=example.com|~www.example.com") << QUrl("http://cdn.net/ads/x.gif")
+                                     << QUrl("http://www.example.com/") << false;
+
+    QTest::newRow("type") << QString("/ads/$script") << QUrl("http://example.com/ads/x.js")
+                          << QUrl("http://example.com/") << true;
+    QTest::newRow("type-other") << QString("/ads/$script") << QUrl("http://example.com/ads/x.gif")
+                                << QUrl("http://example.com/") << false;
+    QTest::newRow("types") << QString("/ads/$script,image") << QUrl("http://example.com/ads/x.gif?x=1")
+                           << QUrl("http://example.com/") << true;
+    QTest::newRow("type-inverse") << QString("/ads/$~image") << QUrl("http://example.com/ads/x.gif")
+                                  << QUrl("http://example.com/") << false;
+    QTest::newRow("type-inverse-other") << QString("/ads/$~image") << QUrl("http://example.com/ads/x.js")
+                                        << QUrl("http://example.com/") << true;
+    QTest::newRow("combined") << QString("/ads/$script,third-party,domain=example.com") << QUrl("http://cdn.net/ads/x.js")
+                              << QUrl("http://example.com/") << true;
+    QTest::newRow("unsupported") << QString("/ads/$popup") << QUrl("http://example.com/ads/x.js")
+                                 << QUrl("http://example.com/") << false;
+}
+
+// public bool networkMatch(const QString &encodedUrl, const AdBlockRequestContext &context) const
+void tst_AdBlockRule::networkMatchContext()
+{
+    QFETCH(QString, filter);
+    QFETCH(QUrl, url);
+    QFETCH(QUrl, pageUrl);
+    QFETCH(bool, networkMatch);
+
+    SubAdBlockRule rule(filter);
+    AdBlockRequestContext context(url, pageUrl);
+    QCOMPARE(rule.networkMatch(url.toEncoded(), context), networkMatch);
+}
+
 void tst_AdBlockRule::regexpCreation_data()
 {
     QTest::addColumn<QString>("input");
@@ -380,6 +472,138 @@ void tst_AdBlockRule::regexpCreation()
      QCOMPARE(rule.regExpPattern(), output);
 }
 
+void tst_AdBlockRule::token_data()
+{
+    QTest::addColumn<QString>("filter");
+    QTest::addColumn<QString>("token");
+
+    QTest::newRow("null") << QString() << QString();
+    QTest::newRow("unbounded") << QString("ad") << QString();
+    QTest::newRow("wildcard") << QString("*banner*") << QString();
+    QTest::newRow("path") << QString("/ads/banner") << QString("ads");
+    QTest::newRow("longest") << QString("/ads/advertisement/") << QString("advertisement");
+    QTest::newRow("star-neighbour") << QString("/ads/banner*.gif") << QString("ads");
+    QTest::newRow("domain") << QString("||doubleclick.net^") << QString("doubleclick");
+    QTest::newRow("start") << QString("|http://ads.") << QString("ads");
+    QTest::newRow("end") << QString("swf|") << QString();
+    QTest::newRow("end-anchored") << QString(".swf|") << QString("swf");
+    QTest::newRow("common") << QString("|http://www.") << QString();
+    QTest::newRow("case") << QString("/BannerAd.gif$match-case") << QString("bannerad");
+    QTest::newRow("exception") << QString("@@||example.com^") << QString("example");
+    QTest::newRow("regexp") << QString("/banner\\d+/") << QString();
+}
+
+void tst_AdBlockRule::token()
+{
+    QFETCH(QString, filter);
+    QFETCH(QString, token);
+
+    SubAdBlockRule rule(filter);
+    QCOMPARE(rule.token(), token);
+}
+
+Q_DECLARE_METATYPE(AdBlockRule::MatchType)
+void tst_AdBlockRule::matchType_data()
+{
+    QTest::addColumn<QString>("filter");
+    QTest::addColumn<AdBlockRule::MatchType>("matchType");
+
+    QTest::newRow("contains") << QString("/ads/banner") << AdBlockRule::StringContainsMatch;
+    QTest::newRow("contains-stars") << QString("*/ads/banner*") << AdBlockRule::StringContainsMatch;
+    QTest::newRow("starts") << QString("|http://ads.") << AdBlockRule::StringStartsMatch;
+    QTest::newRow("ends") << QString(".swf|") << AdBlockRule::StringEndsMatch;
+    QTest::newRow("equals") << QString("|http://example.com/|") << AdBlockRule::StringEqualsMatch;
+    QTest::newRow("domain") << QString("||doubleclick.net^") << AdBlockRule::DomainMatch;
+    QTest::newRow("separator") << QString("http://example.com^") << AdBlockRule::SeparatorMatch;
+    QTest::newRow("separator-anchor") << QString("a^|") << AdBlockRule::SeparatorMatch;
+    QTest::newRow("wildcard") << QString("/ads/*/banner^") << AdBlockRule::WildcardMatch;
+    QTest::newRow("regexp") << QString("/banner\\d+/") << AdBlockRule::RegExpMatch;
+    QTest::newRow("exception") << QString("@@|http://example.com") << AdBlockRule::StringStartsMatch;
+}
+
+void tst_AdBlockRule::matchType()
+{
+    QFETCH(QString, filter);
+    QFETCH(AdBlockRule::MatchType, matchType);
+
+    SubAdBlockRule rule(filter);
+    QCOMPARE(rule.matchType(), matchType);
+}
+
+void tst_AdBlockRule::hostAnchor_data()
+{
+    QTest::addColumn<QString>("filter");
+    QTest::addColumn<QString>("hostAnchor");
+
+    QTest::newRow("null") << QString() << QString();
+    QTest::newRow("host") << QString("||example.com^") << QString("example.com");
+    QTest::newRow("case") << QString("||Ads.Example.com^") << QString("ads.example.com");
+    QTest::newRow("anchor") << QString("||example.com^|") << QString("example.com");
+    QTest::newRow("exception") << QString("@@||example.com^") << QString("example.com");
+    QTest::newRow("no-separator") << QString("||example.com") << QString();
+    QTest::newRow("path") << QString("||example.com/ads") << QString();
+    QTest::newRow("path-separator") << QString("||example.com^ads") << QString();
+    QTest::newRow("wildcard") << QString("||ads.*.com^") << QString();
+    QTest::newRow("end") << QString("||example.com|") << QString();
+    QTest::newRow("options") << QString("||example.com^$third-party") << QString();
+    QTest::newRow("match-case") << QString("||example.com^$match-case") << QString();
+    QTest::newRow("not-domain") << QString("|example.com^") << QString();
+    QTest::newRow("leading-dot") << QString("||.example.com^") << QString();
+}
+
+void tst_AdBlockRule::hostAnchor()
+{
+    QFETCH(QString, filter);
+    QFETCH(QString, hostAnchor);
+
+    SubAdBlockRule rule(filter);
+    QCOMPARE(rule.hostAnchor(), hostAnchor);
+}
+
+void tst_AdBlockRule::dataStream_data()
+{
+    QTest::addColumn<QString>("filter");
+    QTest::addColumn<QUrl>("url");
+
+    QTest::newRow("null") << QString() << QUrl("http://example.com/");
+    QTest::newRow("comment") << QString("!/ads/") << QUrl("http://example.com/ads/");
+    QTest::newRow("contains") << QString("/ads/") << QUrl("http://example.com/ads/");
+    QTest::newRow("domain") << QString("||example.com^") << QUrl("http://ads.example.com/");
+    QTest::newRow("wildcard") << QString("/ads/*/banner^") << QUrl("http://example.com/ads/x/banner?");
+    QTest::newRow("regexp") << QString("/banner\\d+/") << QUrl("http://example.com/banner42.gif");
+    QTest::newRow("case") << QString("/BannerAd.gif$match-case") << QUrl("http://example.com/bannerad.gif");
+    QTest::newRow("exception") << QString("@@|http://example.com|") << QUrl("http://example.com");
+    QTest::newRow("options") << QString("/ads/$domain=example.com") << QUrl("http://example.com/ads/");
+    QTest::newRow("css") << QString("example.com##div.ads") << QUrl("http://example.com/");
+}
+
+// QDataStream &operator<<(QDataStream &, const AdBlockRule &) and operator>>
+void tst_AdBlockRule::dataStream()
+{
+    QFETCH(QString, filter);
+    QFETCH(QUrl, url);
+
+    SubAdBlockRule rule(filter);
+    QByteArray data;
+    {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << rule;
+    }
+    AdBlockRule loaded(QLatin1String("unrelated"));
+    QDataStream stream(data);
+    stream >> loaded;
+    QCOMPARE(stream.status(), QDataStream::Ok);
+
+    QCOMPARE(loaded.filter(), rule.filter());
+    QCOMPARE(loaded.isCSSRule(), rule.isCSSRule());
+    QCOMPARE(loaded.isException(), rule.isException());
+    QCOMPARE(loaded.isEnabled(), rule.isEnabled());
+    QCOMPARE(loaded.matchType(), rule.matchType());
+    QCOMPARE(loaded.token(), rule.token());
+    QCOMPARE(loaded.regExpPattern(), rule.regExpPattern());
+    QCOMPARE(loaded.networkMatch(url.toEncoded()), rule.networkMatch(url.toEncoded()));
+}
+
 QTEST_MAIN(tst_AdBlockRule)
 #include "tst_adblockrule.moc"
 
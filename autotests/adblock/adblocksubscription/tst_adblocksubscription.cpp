@@ -30,6 +30,7 @@
 #include <qsignalspy.h>
 #include <qtry.h>
 
+#include <adblockengine.h>
 #include <adblocksubscription.h>
 
 #include <qdir.h>
@@ -58,12 +59,16 @@ private slots:
     void title();
     void updateNow_data();
     void updateNow();
+    void validators();
     void allow_data();
     void allow();
     void block_data();
     void block();
     void addRule();
     void removeRule();
+    void replaceRule();
+    void editSharedRules();
+    void statistics();
 };
 
 // Subclass that exposes the protected functions.
@@ -137,7 +142,7 @@ void tst_AdBlockSubscription::adblocksubscription()
     QCOMPARE(subscription.lastUpdate(), lastUpdate);
     QVERIFY(subscription.url().isValid());
     //QCOMPARE(subscription.url(), url);
-    QCOMPARE(subscription.block(QString()), (AdBlockRule const*)0);
+    QCOMPARE(match(subscription, QString()), AdBlockEngine::NoMatch);
     subscription.saveRules();
     subscription.setEnabled(false);
     subscription.setLocation(QUrl());
@@ -151,6 +156,17 @@ void tst_AdBlockSubscription::adblocksubscription()
 }
 
 Q_DECLARE_METATYPE(AdBlockRule const*)
+Q_DECLARE_METATYPE(AdBlockEngine::Result)
+
+// Match against the subscription the way the manager's engine does
+static AdBlockEngine::Result match(const AdBlockSubscription &subscription, const QString &url,
+                                   AdBlockRule *rule = 0)
+{
+    AdBlockEngine engine;
+    engine.addSubscription(&subscription);
+    return engine.match(url, rule);
+}
+
 void tst_AdBlockSubscription::allow_data()
 {
     QTest::addColumn<QUrl>("url");
@@ -159,7 +175,6 @@ void tst_AdBlockSubscription::allow_data()
     QTest::newRow("allow") << QUrl("http://example.com/ads/advice.html") << true;
 }
 
-// public AdBlockRule const *block(QString const &urlString) const
 void tst_AdBlockSubscription::allow()
 {
     QFETCH(QUrl, url);
@@ -170,35 +185,35 @@ void tst_AdBlockSubscription::allow()
     subscription.setEnabled(true);
     subscription.updateNow();
 
-    const AdBlockRule *rule = subscription.allow(QString::fromUtf8(url.toEncoded()));
-    if (rule)
-        QVERIFY(rule->isException());
-    QCOMPARE((0 != rule), allow);
+    AdBlockRule rule;
+    bool allowed = (match(subscription, QString::fromUtf8(url.toEncoded()), &rule) == AdBlockEngine::Allowed);
+    if (allowed)
+        QVERIFY(rule.isException());
+    QCOMPARE(allowed, allow);
 }
 
 void tst_AdBlockSubscription::block_data()
 {
     QTest::addColumn<QUrl>("url");
-    QTest::addColumn<bool>("block");
-    QTest::newRow("block") << QUrl("http://example.com/ads/banner123.gif") << true;
-    QTest::newRow("allow") << QUrl("http://example.com/ads/advice.html") << true;
+    QTest::addColumn<AdBlockEngine::Result>("result");
+    QTest::newRow("block") << QUrl("http://example.com/ads/banner123.gif") << AdBlockEngine::Blocked;
+    QTest::newRow("allow") << QUrl("http://example.com/ads/advice.html") << AdBlockEngine::Allowed;
+    QTest::newRow("other") << QUrl("http://example.com/index.html") << AdBlockEngine::NoMatch;
 }
 
-// public AdBlockRule const *block(QString const &urlString) const
 void tst_AdBlockSubscription::block()
 {
     QFETCH(QUrl, url);
-    QFETCH(bool, block);
+    QFETCH(AdBlockEngine::Result, result);
 
     SubAdBlockSubscription subscription;
     subscription.setLocation(QUrl::fromLocalFile(QDir::currentPath() + "/rules.txt"));
     subscription.setEnabled(true);
     subscription.updateNow();
 
-    const AdBlockRule *rule = subscription.block(QString::fromUtf8(url.toEncoded()));
-    if (rule)
-        QVERIFY(!rule->isException());
-    QCOMPARE((0 != rule), block);
+    AdBlockRule rule;
+    QCOMPARE(match(subscription, QString::fromUtf8(url.toEncoded()), &rule), result);
+    QCOMPARE(rule.isNull(), result == AdBlockEngine::NoMatch);
 }
 
 void tst_AdBlockSubscription::isEnabled_data()
@@ -215,7 +230,7 @@ void tst_AdBlockSubscription::isEnabled()
 
     SubAdBlockSubscription subscription;
 
-    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged()));
+    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged(AdBlockRuleChange)));
     QSignalSpy spy1(&subscription, SIGNAL(changed()));
 
     bool changed = subscription.isEnabled() != isEnabled;
@@ -240,7 +255,7 @@ void tst_AdBlockSubscription::location()
 
     SubAdBlockSubscription subscription(QUrl("abp:subscribe"));
 
-    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged()));
+    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged(AdBlockRuleChange)));
     QSignalSpy spy1(&subscription, SIGNAL(changed()));
 
     bool changed = location != subscription.location();
@@ -286,7 +301,7 @@ void tst_AdBlockSubscription::title()
 
     SubAdBlockSubscription subscription;
 
-    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged()));
+    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged(AdBlockRuleChange)));
     QSignalSpy spy1(&subscription, SIGNAL(changed()));
 
     bool changed = title != subscription.title();
@@ -311,7 +326,7 @@ void tst_AdBlockSubscription::updateNow()
     SubAdBlockSubscription subscription;
     subscription.setLocation(location);
 
-    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged()));
+    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged(AdBlockRuleChange)));
     QSignalSpy spy1(&subscription, SIGNAL(changed()));
 
     subscription.updateNow();
@@ -322,11 +337,26 @@ void tst_AdBlockSubscription::updateNow()
     QCOMPARE(subscription.allRules().count(), 2);
 }
 
+// The ETag and Last-Modified of the last download are kept in the url
+void tst_AdBlockSubscription::validators()
+{
+    SubAdBlockSubscription subscription(QUrl::fromEncoded("abp:subscribe?location=&title=EasyList&etag=%22abc%22&lastModified=Fri,%2016%20Jan%202009%2012:10:55%20GMT"));
+    QUrl url = subscription.url();
+    QCOMPARE(url.queryItemValue("etag"), QString("\"abc\""));
+    QCOMPARE(url.queryItemValue("lastModified"), QString("Fri, 16 Jan 2009 12:10:55 GMT"));
+
+    // They belong to the old location
+    subscription.setLocation(QUrl("http://example.com/list.txt"));
+    url = subscription.url();
+    QVERIFY(!url.hasQueryItem("etag"));
+    QVERIFY(!url.hasQueryItem("lastModified"));
+}
+
 void tst_AdBlockSubscription::addRule()
 {
     SubAdBlockSubscription subscription;
 
-    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged()));
+    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged(AdBlockRuleChange)));
     QSignalSpy spy1(&subscription, SIGNAL(changed()));
 
     subscription.addRule(AdBlockRule());
@@ -335,13 +365,16 @@ void tst_AdBlockSubscription::addRule()
     QTRY_COMPARE(spy0.count(), 2);
     QCOMPARE(spy1.count(), 0);
     QCOMPARE(subscription.allRules().count(), 2);
+    AdBlockRuleChange change = spy0.at(1).at(0).value<AdBlockRuleChange>();
+    QCOMPARE(int(change.type), int(AdBlockRuleChange::Added));
+    QCOMPARE(change.offset, 1);
 }
 
 void tst_AdBlockSubscription::removeRule()
 {
     SubAdBlockSubscription subscription;
 
-    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged()));
+    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged(AdBlockRuleChange)));
     QSignalSpy spy1(&subscription, SIGNAL(changed()));
 
     subscription.addRule(AdBlockRule("/test"));
@@ -350,8 +383,99 @@ void tst_AdBlockSubscription::removeRule()
     QTRY_COMPARE(spy0.count(), 2);
     QCOMPARE(spy1.count(), 0);
     QCOMPARE(subscription.allRules().count(), 0);
+    AdBlockRuleChange change = spy0.at(1).at(0).value<AdBlockRuleChange>();
+    QCOMPARE(int(change.type), int(AdBlockRuleChange::Removed));
+    QCOMPARE(change.offset, 0);
+}
+
+void tst_AdBlockSubscription::replaceRule()
+{
+    SubAdBlockSubscription subscription;
+    subscription.setEnabled(true);
+    subscription.addRule(AdBlockRule("/ads/"));
+    subscription.addRule(AdBlockRule("||tracker.com^"));
+    subscription.addRule(AdBlockRule("@@/ads/good"));
+    QCOMPARE(match(subscription, "http://example.com/ads/banner.png"), AdBlockEngine::Blocked);
+    QCOMPARE(match(subscription, "http://example.com/ads/good.png"), AdBlockEngine::Allowed);
+
+    QSignalSpy spy0(&subscription, SIGNAL(rulesChanged(AdBlockRuleChange)));
+
+    // Other rules keep working while one is edited
+    AdBlockRule held = subscription.rule(1);
+    subscription.replaceRule(AdBlockRule("/banner/"), 0);
+    QCOMPARE(match(subscription, "http://example.com/ads/x.png"), AdBlockEngine::NoMatch);
+    QCOMPARE(match(subscription, "http://example.com/banner/x.png"), AdBlockEngine::Blocked);
+    QCOMPARE(match(subscription, "http://ads.tracker.com/"), AdBlockEngine::Blocked);
+    QCOMPARE(held.filter(), QString("||tracker.com^"));
+
+    subscription.removeRule(1);
+    QCOMPARE(match(subscription, "http://ads.tracker.com/"), AdBlockEngine::NoMatch);
+    QCOMPARE(match(subscription, "http://example.com/ads/good.png"), AdBlockEngine::Allowed);
+    QCOMPARE(held.filter(), QString("||tracker.com^"));
+
+    QCOMPARE(spy0.count(), 2);
+    AdBlockRuleChange change = spy0.at(0).at(0).value<AdBlockRuleChange>();
+    QCOMPARE(int(change.type), int(AdBlockRuleChange::Replaced));
+    QCOMPARE(change.offset, 0);
+}
+
+// Edits copy only what they change, a held store keeps every rule
+void tst_AdBlockSubscription::editSharedRules()
+{
+    SubAdBlockSubscription subscription;
+    subscription.setEnabled(true);
+    for (int i = 0; i < 1000; ++i)
+        subscription.addRule(AdBlockRule(QString("/ad%1/").arg(i)));
+
+    QExplicitlySharedDataPointer<AdBlockRuleStore> held = subscription.ruleStore();
+    subscription.removeRule(10);
+    subscription.replaceRule(AdBlockRule("/banner/"), 600);
+    subscription.addRule(AdBlockRule("/last/"));
+
+    QCOMPARE(held->count(), 1000);
+    QCOMPARE(held->filter(held->id(10)), QString("/ad10/"));
+    QCOMPARE(held->filter(held->id(601)), QString("/ad601/"));
+    QCOMPARE(held->filter(held->id(999)), QString("/ad999/"));
+
+    QCOMPARE(subscription.ruleCount(), 1000);
+    QCOMPARE(subscription.rule(10).filter(), QString("/ad11/"));
+    QCOMPARE(subscription.rule(600).filter(), QString("/banner/"));
+    QCOMPARE(subscription.rule(998).filter(), QString("/ad999/"));
+    QCOMPARE(subscription.rule(999).filter(), QString("/last/"));
+    QCOMPARE(match(subscription, "http://example.com/ad601/"), AdBlockEngine::NoMatch);
+    QCOMPARE(match(subscription, "http://example.com/banner/"), AdBlockEngine::Blocked);
 }
 
+void tst_AdBlockSubscription::statistics()
+{
+    SubAdBlockSubscription subscription;
+    subscription.setEnabled(true);
+    subscription.addRule(AdBlockRule("/ads/"));
+    subscription.addRule(AdBlockRule("/banner/"));
+
+    AdBlockRule rule;
+    QCOMPARE(match(subscription, "http://example.com/ads/", &rule), AdBlockEngine::Blocked);
+    rule.recordHit();
+    rule.recordHit();
+    subscription.recordBlocked("http://example.com/ads/");
+    QCOMPARE(subscription.rule(0).hits(), 2);
+    QCOMPARE(subscription.rule(1).hits(), 0);
+    QCOMPARE(subscription.blockedRequests(), 1);
+    // Never loaded, so the disk cache does not know its size
+    QCOMPARE(subscription.bytesSaved(), qint64(0));
+
+    // Counters survive other rules being edited but not the rule itself
+    subscription.addRule(AdBlockRule("/other/"));
+    QCOMPARE(subscription.rule(0).hits(), 2);
+    subscription.replaceRule(AdBlockRule("/ads2/"), 0);
+    QCOMPARE(subscription.rule(0).hits(), 0);
+
+    subscription.rule(1).recordHit();
+    subscription.resetStatistics();
+    QCOMPARE(subscription.rule(1).hits(), 0);
+    QCOMPARE(subscription.blockedRequests(), 0);
+    QCOMPARE(subscription.bytesSaved(), qint64(0));
+}
 
 QTEST_MAIN(tst_AdBlockSubscription)
 #include "tst_adblocksubscription.moc"
@@ -4,9 +4,12 @@ SUBDIRS  = \
     addbookmarkdialog \
     autosaver \
     cookiejar \
+    cookiejarbenchmark \
+    cookiestore \
     historyfiltermodel \
     historymanager \
     modeltoolbar \
+    networkcookiejar \
     opensearchengine \
     opensearchmanager \
     opensearchreader \
@@ -537,6 +537,14 @@ void tst_CookieJar::isOnDomainList_data()
     QTest::newRow("edgecheck-3") << (QStringList() << ".") << "foo.com" << false;
     QTest::newRow("edgecheck-4") << (QStringList() << "abc.foo.com") << "" << false;
     QTest::newRow("edgecheck-5") << (QStringList() << "a") << "ab" << false;
+
+    QStringList many;
+    for (int i = 0; i < 1000; ++i)
+        many << QString("site%1.com").arg(i);
+    QTest::newRow("many-0") << many << "www.site500.com" << true;
+    QTest::newRow("many-1") << many << "site999.com" << true;
+    QTest::newRow("many-2") << many << "site1000.com" << false;
+    QTest::newRow("many-3") << many << "site5.com.evil.net" << false;
 }
 
 // protected static bool isOnDomainList(QStringList const &list, QString const &domain)
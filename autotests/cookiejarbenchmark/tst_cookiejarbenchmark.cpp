@@ -0,0 +1,468 @@
+/*
+ * Copyright 2009 Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include <QtTest/QtTest>
+#include <browserapplication.h>
+#include <cookiejar.h>
+
+#include <qdebug.h>
+
+#if defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+#include <math.h>
+
+/*
+    Benchmarks for the cookie jar at 1k, 10k and 100k cookies.
+
+    The synthetic jars follow the shape of real profiles: the number of
+    cookies per site falls off steeply so a few sites (analytics, social,
+    ads) hold most cookies while most sites only have one or two.  There
+    is a mix of top level and second level domains, host and domain
+    cookies, deeper paths, secure, session and already expired cookies.
+
+    The application name is set so CookieJar::save() and load() use their
+    own data directory and not the profile of the browser.
+
+    Run through runBenchmarks.sh to keep the results of every run.
+ */
+class tst_CookieJarBenchmark : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+private slots:
+    void setAllCookies_data();
+    void setAllCookies();
+    void cookiesForUrl_data();
+    void cookiesForUrl();
+    void cookiesForUrlRepeated_data();
+    void cookiesForUrlRepeated();
+    void setCookiesFromUrl_data();
+    void setCookiesFromUrl();
+    void saveState_data();
+    void saveState();
+    void restoreState_data();
+    void restoreState();
+    void save_data();
+    void save();
+    void load_data();
+    void load();
+    void loadFirstUrl_data();
+    void loadFirstUrl();
+    void purgeOldCookies_data();
+    void purgeOldCookies();
+    void memory_data();
+    void memory();
+
+private:
+    void addSizes();
+    QMap<int, QList<QNetworkCookie> > m_cookies;
+    QList<QUrl> m_urls;
+    QList<QNetworkCookie> m_updates;
+};
+
+// Subclass that exposes the protected functions.
+class SubCookieJar : public CookieJar
+{
+public:
+    QByteArray call_saveState() const
+        { return saveState(); }
+
+    bool call_restoreState(const QByteArray &state)
+        { return restoreState(state); }
+
+    void call_setAllCookies(const QList<QNetworkCookie> &cookieList)
+        { setAllCookies(cookieList); }
+
+    bool call_removeExpiredCookies()
+        { return removeExpiredCookies(); }
+
+    void call_insertCookie(const QNetworkCookie &cookie)
+        { insertCookie(cookie); }
+
+    void call_save()
+        { QMetaObject::invokeMethod(this, "save", Qt::DirectConnection); }
+};
+
+// Resident set size in kilobytes, -1 where we do not know how to get it
+static qint64 residentMemory()
+{
+#if defined(Q_OS_LINUX)
+    QFile file(QLatin1String("/proc/self/statm"));
+    if (!file.open(QFile::ReadOnly))
+        return -1;
+    QList<QByteArray> fields = file.readAll().split(' ');
+    if (fields.count() < 2)
+        return -1;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+#else
+    return -1;
+#endif
+}
+
+static const char *const topLevelDomains[] = {
+    "com", "com", "com", "net", "org", "de", "co.uk", "com.br"
+};
+
+// A random number in [0, count) that favors the low end
+static int skewed(int count)
+{
+    double r = double(qrand()) / RAND_MAX;
+    return qMin(count - 1, int(count * pow(r, 3)));
+}
+
+static QString siteName(int site)
+{
+    return QString("site%1.%2").arg(site).arg(topLevelDomains[site % 8]);
+}
+
+static QNetworkCookie generatedCookie(int site, int index)
+{
+    QNetworkCookie cookie(QString("cookie%1").arg(index).toLatin1(),
+                          QByteArray::number(qrand()));
+    int kind = qrand() % 10;
+    if (kind < 6)
+        cookie.setDomain(QLatin1Char('.') + siteName(site));
+    else if (kind < 9)
+        cookie.setDomain(QLatin1String("www.") + siteName(site));
+    else
+        cookie.setDomain(QString("sub%1.").arg(index % 5) + siteName(site));
+    cookie.setPath(qrand() % 5 ? QString("/") : QString("/path%1").arg(index % 3));
+    cookie.setSecure(qrand() % 20 == 0);
+
+    QDateTime now = QDateTime::currentDateTime();
+    int expires = qrand() % 20;
+    if (expires == 0)
+        cookie.setExpirationDate(now.addDays(-1 - qrand() % 30));
+    else if (expires > 1)
+        cookie.setExpirationDate(now.addDays(1 + qrand() % 365));
+    return cookie;
+}
+
+static QList<QNetworkCookie> generatedCookies(int count)
+{
+    qsrand(count);
+    int sites = qMax(1, count / 4);
+    QList<QNetworkCookie> cookies;
+    for (int i = 0; i < count; ++i)
+        cookies.append(generatedCookie(skewed(sites), i));
+    return cookies;
+}
+
+// This will be called before the first test function is executed.
+// It is only called once.
+void tst_CookieJarBenchmark::initTestCase()
+{
+    QCoreApplication::setOrganizationName(QLatin1String("arora-autotests"));
+    QCoreApplication::setApplicationName(QLatin1String("tst_cookiejarbenchmark"));
+
+    // The jars are loaded from these settings, evicting cookies would
+    // change what the benchmarks measure
+    QSettings settings;
+    settings.beginGroup(QLatin1String("cookies"));
+    settings.setValue(QLatin1String("maximumCookies"), -1);
+    settings.setValue(QLatin1String("maximumCookiesPerDomain"), -1);
+
+    m_cookies.insert(1000, generatedCookies(1000));
+    m_cookies.insert(10000, generatedCookies(10000));
+    m_cookies.insert(100000, generatedCookies(100000));
+
+    // Visits follow the same distribution as the cookies, a tenth
+    // of them go to sites without any cookies
+    qsrand(1);
+    int sites = 100000 / 4;
+    for (int i = 0; i < 1000; ++i) {
+        QString host = (i % 10 == 0)
+            ? QString("www.unknown%1.com").arg(i)
+            : QLatin1String("www.") + siteName(skewed(sites));
+        m_urls.append(QUrl(QString("http://%1/path%2/page.html").arg(host).arg(i % 3)));
+    }
+    for (int i = 0; i < 1000; ++i)
+        m_updates.append(generatedCookie(skewed(sites), i));
+}
+
+// This will be called after the last test function is executed.
+// It is only called once.
+void tst_CookieJarBenchmark::cleanupTestCase()
+{
+    QFile::remove(BrowserApplication::dataFilePath(QLatin1String("cookies.dat")));
+    QFile::remove(BrowserApplication::dataFilePath(QLatin1String("cookies.dat.journal")));
+    QFile::remove(BrowserApplication::dataFilePath(QLatin1String("cookies.ini")));
+}
+
+// This will be called before each test function is executed.
+void tst_CookieJarBenchmark::init()
+{
+}
+
+// This will be called after every test function.
+void tst_CookieJarBenchmark::cleanup()
+{
+}
+
+void tst_CookieJarBenchmark::addSizes()
+{
+    QTest::addColumn<int>("size");
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("100k") << 100000;
+}
+
+void tst_CookieJarBenchmark::setAllCookies_data()
+{
+    addSizes();
+}
+
+void tst_CookieJarBenchmark::setAllCookies()
+{
+    QFETCH(int, size);
+    const QList<QNetworkCookie> cookies = m_cookies.value(size);
+    SubCookieJar jar;
+    QBENCHMARK {
+        jar.call_setAllCookies(cookies);
+    }
+}
+
+void tst_CookieJarBenchmark::cookiesForUrl_data()
+{
+    addSizes();
+}
+
+// More distinct urls than the lookup cache holds
+void tst_CookieJarBenchmark::cookiesForUrl()
+{
+    QFETCH(int, size);
+    SubCookieJar jar;
+    jar.call_setAllCookies(m_cookies.value(size));
+    int found = 0;
+    QBENCHMARK {
+        found = 0;
+        foreach (const QUrl &url, m_urls)
+            found += jar.NetworkCookieJar::cookiesForUrl(url).count();
+    }
+    qDebug() << "cookies found:" << found << "for" << m_urls.count() << "urls";
+}
+
+void tst_CookieJarBenchmark::cookiesForUrlRepeated_data()
+{
+    addSizes();
+}
+
+// The same few urls over and over, like the resources of one page
+void tst_CookieJarBenchmark::cookiesForUrlRepeated()
+{
+    QFETCH(int, size);
+    SubCookieJar jar;
+    jar.call_setAllCookies(m_cookies.value(size));
+    QList<QUrl> urls = m_urls.mid(0, 20);
+    QBENCHMARK {
+        for (int i = 0; i < 50; ++i) {
+            foreach (const QUrl &url, urls)
+                jar.NetworkCookieJar::cookiesForUrl(url);
+        }
+    }
+}
+
+void tst_CookieJarBenchmark::setCookiesFromUrl_data()
+{
+    addSizes();
+}
+
+void tst_CookieJarBenchmark::setCookiesFromUrl()
+{
+    QFETCH(int, size);
+    SubCookieJar jar;
+    jar.call_setAllCookies(m_cookies.value(size));
+    QList<QPair<QUrl, QList<QNetworkCookie> > > headers;
+    foreach (const QNetworkCookie &cookie, m_updates) {
+        QString host = cookie.domain();
+        if (host.startsWith(QLatin1Char('.')))
+            host = QLatin1String("www") + host;
+        headers.append(qMakePair(QUrl(QLatin1String("http://") + host + QLatin1Char('/')),
+                                 QList<QNetworkCookie>() << cookie));
+    }
+    QBENCHMARK {
+        for (int i = 0; i < headers.count(); ++i)
+            jar.NetworkCookieJar::setCookiesFromUrl(headers.at(i).second, headers.at(i).first);
+    }
+}
+
+void tst_CookieJarBenchmark::saveState_data()
+{
+    addSizes();
+}
+
+void tst_CookieJarBenchmark::saveState()
+{
+    QFETCH(int, size);
+    SubCookieJar jar;
+    jar.call_setAllCookies(m_cookies.value(size));
+    QByteArray state;
+    QBENCHMARK {
+        state = jar.call_saveState();
+    }
+    qDebug() << "state size (kB):" << state.size() / 1024;
+}
+
+void tst_CookieJarBenchmark::restoreState_data()
+{
+    addSizes();
+}
+
+void tst_CookieJarBenchmark::restoreState()
+{
+    QFETCH(int, size);
+    SubCookieJar jar;
+    jar.call_setAllCookies(m_cookies.value(size));
+    QByteArray state = jar.call_saveState();
+    SubCookieJar restored;
+    QBENCHMARK {
+        QVERIFY(restored.call_restoreState(state));
+    }
+}
+
+void tst_CookieJarBenchmark::save_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("snapshot");
+    QTest::newRow("1k-snapshot") << 1000 << true;
+    QTest::newRow("10k-snapshot") << 10000 << true;
+    QTest::newRow("100k-snapshot") << 100000 << true;
+    QTest::newRow("1k-journal") << 1000 << false;
+    QTest::newRow("10k-journal") << 10000 << false;
+    QTest::newRow("100k-journal") << 100000 << false;
+}
+
+/*
+    A snapshot writes the whole jar, the journal rows only write the
+    hundred cookies that changed since the previous save.
+ */
+void tst_CookieJarBenchmark::save()
+{
+    QFETCH(int, size);
+    QFETCH(bool, snapshot);
+    SubCookieJar jar;
+    jar.setCookies(m_cookies.value(size));
+    jar.call_save();
+    QList<QNetworkCookie> updates = m_updates.mid(0, 100);
+    QBENCHMARK {
+        if (snapshot) {
+            jar.call_setAllCookies(m_cookies.value(size));
+        } else {
+            foreach (const QNetworkCookie &cookie, updates)
+                jar.call_insertCookie(cookie);
+        }
+        jar.call_save();
+    }
+    QFileInfo info(BrowserApplication::dataFilePath(QLatin1String("cookies.dat")));
+    qDebug() << "store size (kB):" << info.size() / 1024;
+}
+
+void tst_CookieJarBenchmark::load_data()
+{
+    addSizes();
+}
+
+void tst_CookieJarBenchmark::load()
+{
+    QFETCH(int, size);
+    {
+        SubCookieJar jar;
+        jar.setCookies(m_cookies.value(size));
+        jar.call_save();
+    }
+    QBENCHMARK {
+        SubCookieJar jar;
+        jar.cookies();
+    }
+}
+
+void tst_CookieJarBenchmark::loadFirstUrl_data()
+{
+    addSizes();
+}
+
+// A cold start that only reads the cookies of the first site visited
+void tst_CookieJarBenchmark::loadFirstUrl()
+{
+    QFETCH(int, size);
+    {
+        SubCookieJar jar;
+        jar.setCookies(m_cookies.value(size));
+        jar.call_save();
+    }
+    QBENCHMARK {
+        SubCookieJar jar;
+        jar.cookiesForUrl(m_urls.first());
+    }
+}
+
+void tst_CookieJarBenchmark::purgeOldCookies_data()
+{
+    addSizes();
+}
+
+// Compare with setAllCookies, which is part of every iteration here
+void tst_CookieJarBenchmark::purgeOldCookies()
+{
+    QFETCH(int, size);
+    const QList<QNetworkCookie> cookies = m_cookies.value(size);
+    SubCookieJar jar;
+    QBENCHMARK {
+        jar.call_setAllCookies(cookies);
+        QVERIFY(jar.call_removeExpiredCookies());
+    }
+}
+
+void tst_CookieJarBenchmark::memory_data()
+{
+    addSizes();
+}
+
+void tst_CookieJarBenchmark::memory()
+{
+    QFETCH(int, size);
+    if (residentMemory() == -1)
+        QSKIP("Resident memory is not available on this platform", SkipSingle);
+
+    // Restored cookies do not share any data with m_cookies
+    QByteArray state;
+    {
+        SubCookieJar jar;
+        jar.call_setAllCookies(m_cookies.value(size));
+        state = jar.call_saveState();
+    }
+    qint64 before = residentMemory();
+    SubCookieJar *jar = new SubCookieJar;
+    QVERIFY(jar->call_restoreState(state));
+    qint64 after = residentMemory();
+    qDebug() << "resident kB:" << after - before
+             << "per cookie (bytes):" << (after - before) * 1024 / size;
+    delete jar;
+}
+
+QTEST_MAIN(tst_CookieJarBenchmark)
+#include "tst_cookiejarbenchmark.moc"
@@ -0,0 +1,257 @@
+/*
+ * Copyright 2009 Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include <QtTest/QtTest>
+#include <cookiestore.h>
+
+class tst_CookieStore : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+private slots:
+    void cookiestore();
+    void writeSnapshot();
+    void append();
+    void truncatedJournal();
+    void staleJournal();
+    void needsCompaction();
+    void topLevelDomain_data();
+    void topLevelDomain();
+    void loadTopLevelDomain();
+
+private:
+    QString m_fileName;
+};
+
+// This will be called before the first test function is executed.
+// It is only called once.
+void tst_CookieStore::initTestCase()
+{
+    m_fileName = QDir::tempPath() + QLatin1String("/tst_cookiestore.dat");
+}
+
+// This will be called after the last test function is executed.
+// It is only called once.
+void tst_CookieStore::cleanupTestCase()
+{
+}
+
+// This will be called before each test function is executed.
+void tst_CookieStore::init()
+{
+    QFile::remove(m_fileName);
+    QFile::remove(m_fileName + QLatin1String(".journal"));
+}
+
+// This will be called after every test function.
+void tst_CookieStore::cleanup()
+{
+    init();
+}
+
+static QNetworkCookie cookie(const QString &name, const QString &value)
+{
+    QNetworkCookie cookie(name.toLatin1(), value.toLatin1());
+    cookie.setDomain(QLatin1String(".example.com"));
+    cookie.setPath(QLatin1String("/"));
+    cookie.setExpirationDate(QDateTime(QDate(2030, 1, 1), QTime(12, 0), Qt::UTC));
+    return cookie;
+}
+
+static QList<QNetworkCookie> sorted(QList<QNetworkCookie> cookies)
+{
+    QMap<QByteArray, QNetworkCookie> map;
+    foreach (const QNetworkCookie &cookie, cookies)
+        map.insert(cookie.name(), cookie);
+    return map.values();
+}
+
+void tst_CookieStore::cookiestore()
+{
+    CookieStore store(m_fileName);
+    QCOMPARE(store.fileName(), m_fileName);
+    QCOMPARE(store.exists(), false);
+    QCOMPARE(store.load(), QList<QNetworkCookie>());
+    QCOMPARE(store.append(QList<NetworkCookieChange>()), false);
+    QCOMPARE(store.needsCompaction(), false);
+}
+
+void tst_CookieStore::writeSnapshot()
+{
+    QList<QNetworkCookie> cookies;
+    cookies << cookie("a", "1");
+    cookies << cookie("b", "2");
+    cookies[1].setSecure(true);
+    cookies[1].setHttpOnly(true);
+    QNetworkCookie session("session", "3");
+    cookies << session;
+
+    CookieStore store(m_fileName);
+    QVERIFY(store.writeSnapshot(cookies));
+    QVERIFY(store.exists());
+
+    CookieStore loaded(m_fileName);
+    cookies.removeLast();
+    QCOMPARE(sorted(loaded.load()), cookies);
+}
+
+void tst_CookieStore::append()
+{
+    QList<QNetworkCookie> cookies;
+    cookies << cookie("a", "1");
+    cookies << cookie("b", "2");
+    CookieStore store(m_fileName);
+    QVERIFY(store.writeSnapshot(cookies));
+
+    QList<NetworkCookieChange> changes;
+    changes << NetworkCookieChange(NetworkCookieChange::Removed, cookies.at(0));
+    changes << NetworkCookieChange(NetworkCookieChange::Inserted, cookie("a", "4"));
+    changes << NetworkCookieChange(NetworkCookieChange::Removed, cookies.at(1));
+    changes << NetworkCookieChange(NetworkCookieChange::Inserted, cookie("c", "5"));
+    QVERIFY(store.append(changes));
+
+    CookieStore loaded(m_fileName);
+    QList<QNetworkCookie> expected;
+    expected << cookie("a", "4") << cookie("c", "5");
+    QCOMPARE(sorted(loaded.load()), expected);
+    QVERIFY(loaded.append(QList<NetworkCookieChange>()
+                          << NetworkCookieChange(NetworkCookieChange::Removed, expected.at(1))));
+    expected.removeLast();
+    QCOMPARE(sorted(CookieStore(m_fileName).load()), expected);
+}
+
+void tst_CookieStore::truncatedJournal()
+{
+    CookieStore store(m_fileName);
+    QVERIFY(store.writeSnapshot(QList<QNetworkCookie>() << cookie("a", "1")));
+    QVERIFY(store.append(QList<NetworkCookieChange>()
+                         << NetworkCookieChange(NetworkCookieChange::Inserted, cookie("b", "2"))
+                         << NetworkCookieChange(NetworkCookieChange::Inserted, cookie("c", "3"))));
+
+    QFile journal(m_fileName + QLatin1String(".journal"));
+    QVERIFY(journal.resize(journal.size() - 3));
+
+    QList<QNetworkCookie> expected;
+    expected << cookie("a", "1") << cookie("b", "2");
+    CookieStore loaded(m_fileName);
+    QCOMPARE(sorted(loaded.load()), expected);
+
+    // Changes saved after the truncated record are not lost
+    QVERIFY(loaded.append(QList<NetworkCookieChange>()
+                          << NetworkCookieChange(NetworkCookieChange::Inserted, cookie("d", "4"))));
+    expected << cookie("d", "4");
+    QCOMPARE(sorted(CookieStore(m_fileName).load()), expected);
+}
+
+void tst_CookieStore::staleJournal()
+{
+    CookieStore store(m_fileName);
+    QVERIFY(store.writeSnapshot(QList<QNetworkCookie>() << cookie("a", "1")));
+    QVERIFY(store.append(QList<NetworkCookieChange>()
+                         << NetworkCookieChange(NetworkCookieChange::Inserted, cookie("b", "2"))));
+    QFile journal(m_fileName + QLatin1String(".journal"));
+    QVERIFY(journal.open(QFile::ReadOnly));
+    QByteArray oldJournal = journal.readAll();
+    journal.close();
+
+    // A journal that belongs to an older snapshot is ignored
+    QVERIFY(store.writeSnapshot(QList<QNetworkCookie>() << cookie("c", "3")));
+    QVERIFY(journal.open(QFile::WriteOnly | QFile::Truncate));
+    journal.write(oldJournal);
+    journal.close();
+
+    CookieStore loaded(m_fileName);
+    QCOMPARE(loaded.load(), QList<QNetworkCookie>() << cookie("c", "3"));
+    QCOMPARE(loaded.append(QList<NetworkCookieChange>()), false);
+}
+
+void tst_CookieStore::needsCompaction()
+{
+    CookieStore store(m_fileName);
+    QVERIFY(store.writeSnapshot(QList<QNetworkCookie>() << cookie("a", "1")));
+    QList<NetworkCookieChange> changes;
+    for (int i = 0; i < 256; ++i)
+        changes << NetworkCookieChange(NetworkCookieChange::Inserted, cookie("a", QString::number(i)));
+    QVERIFY(store.append(changes));
+    QCOMPARE(store.needsCompaction(), false);
+    QVERIFY(store.append(changes.mid(0, 1)));
+    QCOMPARE(store.needsCompaction(), true);
+    QVERIFY(store.writeSnapshot(QList<QNetworkCookie>() << changes.first().cookie));
+    QCOMPARE(store.needsCompaction(), false);
+}
+
+void tst_CookieStore::topLevelDomain_data()
+{
+    QTest::addColumn<QString>("host");
+    QTest::addColumn<QString>("topLevelDomain");
+    QTest::newRow("null") << QString() << QString();
+    QTest::newRow("dots") << QString("..") << QString();
+    QTest::newRow("single") << QString("localhost") << QString("localhost");
+    QTest::newRow("host") << QString("www.example.com") << QString("com");
+    QTest::newRow("domain") << QString(".example.co.uk") << QString("uk");
+    QTest::newRow("trailing-dot") << QString("example.ORG.") << QString("org");
+}
+
+// public static QString topLevelDomain(QString const &host)
+void tst_CookieStore::topLevelDomain()
+{
+    QFETCH(QString, host);
+    QFETCH(QString, topLevelDomain);
+    QCOMPARE(CookieStore::topLevelDomain(host), topLevelDomain);
+}
+
+void tst_CookieStore::loadTopLevelDomain()
+{
+    QList<QNetworkCookie> com;
+    com << cookie("a", "1") << cookie("b", "2");
+    QNetworkCookie org = cookie("c", "3");
+    org.setDomain(QLatin1String("www.example.org"));
+    CookieStore store(m_fileName);
+    QVERIFY(store.writeSnapshot(QList<QNetworkCookie>() << com << org));
+    QCOMPARE(store.hasUnloadedCookies(), false);
+    QVERIFY(store.append(QList<NetworkCookieChange>()
+                         << NetworkCookieChange(NetworkCookieChange::Removed, com.at(1))
+                         << NetworkCookieChange(NetworkCookieChange::Inserted, cookie("d", "4"))));
+
+    CookieStore loaded(m_fileName);
+    QVERIFY(loaded.open());
+    QCOMPARE(loaded.hasUnloadedCookies(), true);
+    QCOMPARE(loaded.load(QLatin1String("net")), QList<QNetworkCookie>());
+    QList<QNetworkCookie> expected;
+    expected << com.at(0) << cookie("d", "4");
+    QCOMPARE(sorted(loaded.load(QLatin1String("com"))), expected);
+    QCOMPARE(loaded.load(QLatin1String("com")), QList<QNetworkCookie>());
+    QCOMPARE(loaded.hasUnloadedCookies(), true);
+    QCOMPARE(loaded.load(), QList<QNetworkCookie>() << org);
+    QCOMPARE(loaded.hasUnloadedCookies(), false);
+
+    // Changes can still be appended after loading part of the store
+    QVERIFY(loaded.append(QList<NetworkCookieChange>()
+                          << NetworkCookieChange(NetworkCookieChange::Removed, org)));
+    QCOMPARE(sorted(CookieStore(m_fileName).load()), expected);
+}
+
+QTEST_MAIN(tst_CookieStore)
+#include "tst_cookiestore.moc"
@@ -0,0 +1,431 @@
+/*
+ * Copyright 2009 Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include <QtTest/QtTest>
+#include <networkcookiejar.h>
+
+class tst_NetworkCookieJar : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+private slots:
+    void cookiesForUrl_data();
+    void cookiesForUrl();
+    void setCookiesFromUrl();
+    void removeExpiredCookies();
+    void insertCookie();
+    void cookiesForUrlCache();
+    void saveState();
+    void cookieLimits();
+    void secondLevelDomains();
+    void endSession();
+};
+
+// Subclass that exposes the protected functions.
+class SubNetworkCookieJar : public NetworkCookieJar
+{
+public:
+    QByteArray call_saveState() const
+        { return saveState(); }
+
+    bool call_restoreState(const QByteArray &state)
+        { return restoreState(state); }
+
+    QList<QNetworkCookie> call_allCookies() const
+        { return allCookies(); }
+
+    void call_setAllCookies(const QList<QNetworkCookie> &cookieList)
+        { setAllCookies(cookieList); }
+
+    void call_addCookies(const QList<QNetworkCookie> &cookieList)
+        { addCookies(cookieList); }
+
+    bool call_removeExpiredCookies()
+        { return removeExpiredCookies(); }
+
+    void call_insertCookie(const QNetworkCookie &cookie)
+        { insertCookie(cookie); }
+
+    void call_setSecondLevelDomains(const QStringList &secondLevelDomains)
+        { setSecondLevelDomains(secondLevelDomains); }
+
+    void call_endSession()
+        { endSession(); }
+
+    void call_setMaximumCookies(int maximum)
+        { setMaximumCookies(maximum); }
+
+    void call_setMaximumCookiesPerDomain(int maximum)
+        { setMaximumCookiesPerDomain(maximum); }
+};
+
+// This will be called before the first test function is executed.
+// It is only called once.
+void tst_NetworkCookieJar::initTestCase()
+{
+}
+
+// This will be called after the last test function is executed.
+// It is only called once.
+void tst_NetworkCookieJar::cleanupTestCase()
+{
+}
+
+// This will be called before each test function is executed.
+void tst_NetworkCookieJar::init()
+{
+}
+
+// This will be called after every test function.
+void tst_NetworkCookieJar::cleanup()
+{
+}
+
+static QNetworkCookie cookie(const QString &name, const QString &domain)
+{
+    QNetworkCookie cookie(name.toLatin1(), "value");
+    cookie.setDomain(domain);
+    cookie.setPath(QLatin1String("/"));
+    return cookie;
+}
+
+void tst_NetworkCookieJar::cookiesForUrl_data()
+{
+    QTest::addColumn<QString>("domain");
+    QTest::addColumn<QUrl>("url");
+    QTest::addColumn<bool>("found");
+
+    QTest::newRow("host") << "www.example.com" << QUrl("http://www.example.com/") << true;
+    QTest::newRow("host-parent") << "www.example.com" << QUrl("http://example.com/") << false;
+    QTest::newRow("host-child") << "www.example.com" << QUrl("http://a.www.example.com/") << true;
+    QTest::newRow("host-sibling") << "www.example.com" << QUrl("http://a.example.com/") << false;
+    QTest::newRow("trailing-dot") << "www.example.com" << QUrl("http://www.example.com./") << true;
+    QTest::newRow("domain") << ".example.com" << QUrl("http://www.example.com/") << true;
+    QTest::newRow("domain-exact") << ".example.com" << QUrl("http://example.com/") << true;
+    QTest::newRow("domain-deep") << ".example.com" << QUrl("http://a.b.example.com/") << true;
+    QTest::newRow("domain-other") << ".example.com" << QUrl("http://www.example.org/") << false;
+    QTest::newRow("domain-suffix") << "ample.com" << QUrl("http://www.example.com/") << false;
+    QTest::newRow("tld") << "com" << QUrl("http://www.example.com/") << false;
+    QTest::newRow("second-level") << "com.br" << QUrl("http://www.example.com.br/") << false;
+    QTest::newRow("second-level-domain") << "example.com.br" << QUrl("http://www.example.com.br/") << true;
+    QTest::newRow("file") << "localhost" << QUrl("file:///tmp/") << true;
+}
+
+// public QList<QNetworkCookie> cookiesForUrl(QUrl const &url) const
+void tst_NetworkCookieJar::cookiesForUrl()
+{
+    QFETCH(QString, domain);
+    QFETCH(QUrl, url);
+    QFETCH(bool, found);
+
+    SubNetworkCookieJar jar;
+    QList<QNetworkCookie> cookies;
+    cookies << cookie("a", domain);
+    cookies << cookie("b", QLatin1String("unrelated.example.net"));
+    jar.call_setAllCookies(cookies);
+
+    QList<QNetworkCookie> result = jar.cookiesForUrl(url);
+    QCOMPARE(result.count(), found ? 1 : 0);
+    if (found)
+        QCOMPARE(result.first(), cookies.first());
+}
+
+// public bool setCookiesFromUrl(QList<QNetworkCookie> const &cookieList, QUrl const &url)
+void tst_NetworkCookieJar::setCookiesFromUrl()
+{
+    SubNetworkCookieJar jar;
+    QUrl url("http://www.example.com/");
+    QList<QNetworkCookie> cookies;
+    cookies << cookie("a", QLatin1String(".example.com"));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, url), true);
+    QCOMPARE(jar.cookiesForUrl(url).count(), 1);
+
+    // Replacing keeps a single cookie
+    cookies.first().setValue("other");
+    QCOMPARE(jar.setCookiesFromUrl(cookies, url), true);
+    QCOMPARE(jar.cookiesForUrl(url), cookies);
+
+    // An expired cookie removes the existing one
+    cookies.first().setExpirationDate(QDateTime::currentDateTime().addDays(-1));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, url), false);
+    QCOMPARE(jar.cookiesForUrl(url).count(), 0);
+    QCOMPARE(jar.call_allCookies().count(), 0);
+
+    // Nodes that were removed can be used again
+    cookies.first().setExpirationDate(QDateTime());
+    QCOMPARE(jar.setCookiesFromUrl(cookies, url), true);
+    QCOMPARE(jar.cookiesForUrl(url), cookies);
+}
+
+// protected bool removeExpiredCookies()
+void tst_NetworkCookieJar::removeExpiredCookies()
+{
+    SubNetworkCookieJar jar;
+    QDateTime now = QDateTime::currentDateTime();
+    QList<QNetworkCookie> cookies;
+    cookies << cookie("a", QLatin1String("www.example.com"));
+    cookies << cookie("b", QLatin1String("www.example.com"));
+    cookies << cookie("c", QLatin1String("www.example.com"));
+    cookies << cookie("d", QLatin1String("www.example.com"));
+    cookies[0].setExpirationDate(now.addDays(2));
+    cookies[1].setExpirationDate(now.addDays(-1));
+    cookies[2].setExpirationDate(now.addDays(-2));
+    jar.call_setAllCookies(cookies);
+
+    // Lookups skip expired cookies but leave them in the jar
+    QUrl url("http://www.example.com/");
+    QCOMPARE(jar.cookiesForUrl(url).count(), 2);
+    QCOMPARE(jar.call_allCookies().count(), 4);
+
+    QCOMPARE(jar.call_removeExpiredCookies(), true);
+    QList<QNetworkCookie> all = jar.call_allCookies();
+    QCOMPARE(all.count(), 2);
+    QVERIFY(all.contains(cookies.at(0)));
+    QVERIFY(all.contains(cookies.at(3)));
+    QCOMPARE(jar.call_removeExpiredCookies(), false);
+
+    // Setting cookies removes the ones that have expired
+    QList<QNetworkCookie> expired;
+    expired << cookie("e", QLatin1String("www.example.com"));
+    expired[0].setExpirationDate(now.addSecs(-60));
+    jar.call_setAllCookies(expired);
+    QCOMPARE(jar.setCookiesFromUrl(QList<QNetworkCookie>() << cookies.at(0), url), true);
+    QCOMPARE(jar.call_allCookies(), QList<QNetworkCookie>() << cookies.at(0));
+    QCOMPARE(jar.call_removeExpiredCookies(), false);
+}
+
+// protected void insertCookie(QNetworkCookie const &cookie)
+void tst_NetworkCookieJar::insertCookie()
+{
+    SubNetworkCookieJar jar;
+    QUrl url("http://www.example.com/");
+    jar.call_insertCookie(cookie("a", QLatin1String("www.example.com")));
+    jar.call_insertCookie(cookie("a", QLatin1String(".www.example.com")));
+    QNetworkCookie other = cookie("a", QLatin1String("www.example.com"));
+    other.setPath(QLatin1String("/other"));
+    jar.call_insertCookie(other);
+    QCOMPARE(jar.call_allCookies().count(), 3);
+
+    // Same name, domain and path replaces
+    QNetworkCookie replacement = cookie("a", QLatin1String("www.example.com"));
+    replacement.setValue("replaced");
+    jar.call_insertCookie(replacement);
+    QList<QNetworkCookie> all = jar.call_allCookies();
+    QCOMPARE(all.count(), 3);
+    QVERIFY(all.contains(replacement));
+    QCOMPARE(jar.cookiesForUrl(url).count(), 2);
+}
+
+void tst_NetworkCookieJar::cookiesForUrlCache()
+{
+    SubNetworkCookieJar jar;
+    QUrl url("http://a.b.example.com/path");
+    jar.call_insertCookie(cookie("a", QLatin1String("www.example.com")));
+    QCOMPARE(jar.cookiesForUrl(url).count(), 0);
+    QCOMPARE(jar.cookiesForUrl(url).count(), 0);
+
+    // A node created below the closest one
+    QNetworkCookie b = cookie("b", QLatin1String("b.example.com"));
+    jar.call_insertCookie(b);
+    QCOMPARE(jar.cookiesForUrl(url), QList<QNetworkCookie>() << b);
+
+    // A parent domain
+    QNetworkCookie c = cookie("c", QLatin1String(".example.com"));
+    jar.call_insertCookie(c);
+    QCOMPARE(jar.cookiesForUrl(url).count(), 2);
+
+    // Replacing and removing
+    c.setValue("replaced");
+    jar.call_insertCookie(c);
+    QVERIFY(jar.cookiesForUrl(url).contains(c));
+    c.setExpirationDate(QDateTime::currentDateTime().addDays(-1));
+    QCOMPARE(jar.setCookiesFromUrl(QList<QNetworkCookie>() << c, url), false);
+    QCOMPARE(jar.cookiesForUrl(url), QList<QNetworkCookie>() << b);
+
+    // Secure and path are part of the key
+    QNetworkCookie secure = cookie("s", QLatin1String("b.example.com"));
+    secure.setSecure(true);
+    secure.setPath(QLatin1String("/path"));
+    jar.call_insertCookie(secure);
+    QCOMPARE(jar.cookiesForUrl(url).count(), 1);
+    QCOMPARE(jar.cookiesForUrl(QUrl("https://a.b.example.com/path")).count(), 2);
+    QCOMPARE(jar.cookiesForUrl(QUrl("https://a.b.example.com/")).count(), 1);
+
+    jar.call_setAllCookies(QList<QNetworkCookie>());
+    QCOMPARE(jar.cookiesForUrl(url).count(), 0);
+}
+
+// protected QByteArray saveState() const
+void tst_NetworkCookieJar::saveState()
+{
+    SubNetworkCookieJar jar;
+    QList<QNetworkCookie> cookies;
+    cookies << cookie("a", QLatin1String("www.example.com"));
+    cookies << cookie("b", QLatin1String(".example.com"));
+    cookies << cookie("c", QLatin1String("example.org"));
+    cookies << cookie("d", QLatin1String("www.example.com"));
+    jar.call_setAllCookies(cookies);
+
+    SubNetworkCookieJar restored;
+    QVERIFY(restored.call_restoreState(jar.call_saveState()));
+    QList<QNetworkCookie> all = restored.call_allCookies();
+    QCOMPARE(all.count(), cookies.count());
+    foreach (const QNetworkCookie &cookie, cookies)
+        QVERIFY(all.contains(cookie));
+    QCOMPARE(restored.cookiesForUrl(QUrl("http://www.example.com/")).count(), 3);
+}
+
+// protected void setMaximumCookies(int maximum)
+// protected void setMaximumCookiesPerDomain(int maximum)
+void tst_NetworkCookieJar::cookieLimits()
+{
+    SubNetworkCookieJar jar;
+    jar.call_setMaximumCookiesPerDomain(4);
+    jar.call_insertCookie(cookie("a", QLatin1String("example.org")));
+    for (int i = 0; i < 3; ++i)
+        jar.call_insertCookie(cookie(QString("a%1").arg(i), QLatin1String("www.example.com")));
+    for (int i = 0; i < 3; ++i)
+        jar.call_insertCookie(cookie(QString("b%1").arg(i), QLatin1String(".example.com")));
+    QNetworkCookie last = cookie("c", QLatin1String("mail.example.com"));
+    jar.call_insertCookie(last);
+
+    // Subdomains share the limit of their registrable domain
+    QList<QNetworkCookie> all = jar.call_allCookies();
+    QCOMPARE(all.count(), 5);
+    QVERIFY(all.contains(last));
+    QVERIFY(all.contains(cookie("a", QLatin1String("example.org"))));
+
+    // Replacing a cookie does not evict anything
+    QNetworkCookie replacement = last;
+    replacement.setValue("replaced");
+    jar.call_insertCookie(replacement);
+    QCOMPARE(jar.call_allCookies().count(), 5);
+
+    // Second level domains are not grouped together
+    jar.call_insertCookie(cookie("a", QLatin1String("one.co.uk")));
+    jar.call_insertCookie(cookie("a", QLatin1String("two.co.uk")));
+    QCOMPARE(jar.call_allCookies().count(), 7);
+
+    SubNetworkCookieJar global;
+    global.call_setMaximumCookies(20);
+    for (int i = 0; i < 20; ++i)
+        global.call_insertCookie(cookie("a", QString("site%1.com").arg(i)));
+    QCOMPARE(global.call_allCookies().count(), 20);
+    global.call_insertCookie(last);
+    all = global.call_allCookies();
+    QVERIFY(all.count() < 20);
+    QVERIFY(all.contains(last));
+
+    global.call_setMaximumCookies(-1);
+    for (int i = 0; i < 20; ++i)
+        global.call_insertCookie(cookie("b", QString("site%1.com").arg(i)));
+    QCOMPARE(global.call_allCookies().count(), all.count() + 20);
+
+    // Cookies read back from storage are checked too, the ones that
+    // expire first go
+    QList<QNetworkCookie> stored;
+    for (int i = 0; i < 6; ++i) {
+        QNetworkCookie persistent = cookie(QString("p%1").arg(i), QLatin1String("example.net"));
+        persistent.setExpirationDate(QDateTime::currentDateTime().addDays(10 - i));
+        stored.append(persistent);
+    }
+    SubNetworkCookieJar loaded;
+    loaded.call_setMaximumCookiesPerDomain(4);
+    loaded.call_addCookies(stored);
+    all = loaded.call_allCookies();
+    QCOMPARE(all.count(), 4);
+    QVERIFY(all.contains(stored.at(0)));
+    QVERIFY(all.contains(stored.at(3)));
+    QVERIFY(!all.contains(stored.at(4)));
+    QVERIFY(!all.contains(stored.at(5)));
+
+    loaded.call_setMaximumCookiesPerDomain(-1);
+    loaded.call_setMaximumCookies(3);
+    loaded.call_setAllCookies(stored);
+    QCOMPARE(loaded.call_allCookies().count(), 3);
+}
+
+// protected void setSecondLevelDomains(QStringList const &secondLevelDomains)
+void tst_NetworkCookieJar::secondLevelDomains()
+{
+    SubNetworkCookieJar jar;
+    QList<QNetworkCookie> cookies;
+    cookies << cookie("a", QLatin1String(".co.uk"));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, QUrl("http://www.example.co.uk/")), false);
+    cookies.first().setDomain(QLatin1String(".example.co.uk"));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, QUrl("http://www.example.co.uk/")), true);
+
+    // The first and last entries of the public suffix table
+    cookies.first().setDomain(QLatin1String(".co.ao"));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, QUrl("http://www.example.co.ao/")), false);
+    cookies.first().setDomain(QLatin1String(".co.zw"));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, QUrl("http://www.example.co.zw/")), false);
+    cookies.first().setDomain(QLatin1String(".co.zz"));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, QUrl("http://www.example.co.zz/")), true);
+
+    // A wildcard with an exception, *.ck and !www.ck
+    cookies.first().setDomain(QLatin1String(".foo.ck"));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, QUrl("http://www.foo.ck/")), false);
+    cookies.first().setDomain(QLatin1String(".www.foo.ck"));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, QUrl("http://www.foo.ck/")), true);
+    cookies.first().setDomain(QLatin1String(".www.ck"));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, QUrl("http://www.ck/")), true);
+    QCOMPARE(jar.cookiesForUrl(QUrl("http://www.ck/")).count(), 1);
+
+    jar.call_setSecondLevelDomains(QStringList() << QLatin1String("zz"));
+    cookies.first().setDomain(QLatin1String(".co.uk"));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, QUrl("http://www.example.co.uk/")), true);
+    cookies.first().setDomain(QLatin1String(".co.zz"));
+    QCOMPARE(jar.setCookiesFromUrl(cookies, QUrl("http://www.example.co.zz/")), false);
+}
+
+// protected void endSession()
+void tst_NetworkCookieJar::endSession()
+{
+    SubNetworkCookieJar jar;
+    QList<QNetworkCookie> cookies;
+    QDateTime future = QDateTime::currentDateTime().addDays(1);
+    for (int i = 0; i < 10; ++i) {
+        QNetworkCookie session = cookie(QString("s%1").arg(i), QString("site%1.com").arg(i % 3));
+        QNetworkCookie persistent = cookie(QString("p%1").arg(i), QString("site%1.com").arg(i % 4));
+        persistent.setExpirationDate(future);
+        cookies << session << persistent;
+    }
+    jar.call_setAllCookies(cookies);
+    jar.call_endSession();
+
+    QList<QNetworkCookie> all = jar.call_allCookies();
+    QCOMPARE(all.count(), 10);
+    foreach (const QNetworkCookie &cookie, all)
+        QVERIFY(!cookie.isSessionCookie());
+    QCOMPARE(jar.cookiesForUrl(QUrl("http://site2.com/")).count(), 2);
+    QCOMPARE(jar.cookiesForUrl(QUrl("http://site3.com/")).count(), 2);
+
+    jar.call_endSession();
+    QCOMPARE(jar.call_allCookies().count(), 10);
+}
+
+QTEST_MAIN(tst_NetworkCookieJar)
+#include "tst_networkcookiejar.moc"
@@ -0,0 +1,21 @@
+#!/bin/sh
+
+# Runs the benchmarks and keeps the results of every run as xml in
+# benchmarks/<date>/ so they can be compared over time.
+
+results=`pwd`/benchmarks/`date +%Y%m%d-%H%M%S`
+mkdir -p $results
+
+for benchmark in adblock/adblockbenchmark cookiejarbenchmark
+do
+    name=`basename $benchmark`
+
+    if [ ! -f $benchmark/$name ]
+    then
+        printf "$benchmark/$name is not compiled.\n"
+        continue
+    fi
+
+    (cd $benchmark && ./$name -xml -o $results/$name.xml)
+    printf "$name: $results/$name.xml\n"
+done
@@ -14,6 +14,12 @@ do
         continue
     fi
 
+    # Run by runBenchmarks.sh
+    if [ $name == "cookiejarbenchmark" ]
+    then
+        continue
+    fi
+
     cd $name
 
     if [ ! -f $name ]
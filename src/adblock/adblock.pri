@@ -4,22 +4,28 @@ DEPENDPATH += $$PWD
 HEADERS += \
     adblockblockednetworkreply.h \
     adblockdialog.h \
+    adblockengine.h \
+    adblockindex.h \
     adblockmanager.h \
     adblockmodel.h \
     adblocknetwork.h \
     adblockpage.h \
     adblockrule.h \
+    adblockrulestore.h \
     adblockschemeaccesshandler.h \
     adblocksubscription.h
 
 SOURCES += \
     adblockblockednetworkreply.cpp \
     adblockdialog.cpp \
+    adblockengine.cpp \
+    adblockindex.cpp \
     adblockmanager.cpp \
     adblockmodel.cpp \
     adblocknetwork.cpp \
     adblockpage.cpp \
     adblockrule.cpp \
+    adblockrulestore.cpp \
     adblockschemeaccesshandler.cpp \
     adblocksubscription.cpp
 
@@ -37,7 +37,7 @@ class AdBlockBlockedNetworkReply : public QNetworkReply
     Q_OBJECT
 
 public:
-    AdBlockBlockedNetworkReply(const QNetworkRequest &request, const AdBlockRule *rule, QObject *parent = 0);
+    AdBlockBlockedNetworkReply(const QNetworkRequest &request, const AdBlockRule &rule, QObject *parent = 0);
     void abort() {};
 
 protected:
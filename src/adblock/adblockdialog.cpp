@@ -34,7 +34,11 @@
 #include "treesortfilterproxymodel.h"
 
 #include <qdesktopservices.h>
+#include <qfile.h>
+#include <qfiledialog.h>
+#include <qheaderview.h>
 #include <qmenu.h>
+#include <qmessagebox.h>
 #include <qurl.h>
 
 #include <qdebug.h>
@@ -47,6 +51,11 @@ AdBlockDialog::AdBlockDialog(QWidget *parent)
     m_proxyModel = new TreeSortFilterProxyModel(this);
     m_proxyModel->setSourceModel(m_adBlockModel);
     treeView->setModel(m_proxyModel);
+    // The rules take the room left by the statistics columns
+    treeView->header()->setStretchLastSection(false);
+    treeView->header()->setResizeMode(0, QHeaderView::Stretch);
+    for (int i = 1; i < m_adBlockModel->columnCount(); ++i)
+        treeView->header()->setResizeMode(i, QHeaderView::ResizeToContents);
     connect(search, SIGNAL(textChanged(QString)),
             m_proxyModel, SLOT(setFilterFixedString(QString)));
 
@@ -96,6 +105,14 @@ void AdBlockDialog::aboutToShowActionMenu()
     connect(removeSubscription, SIGNAL(triggered()), this, SLOT(removeSubscription()));
     if (!idx.isValid())
         removeSubscription->setEnabled(false);
+
+    menu->addSeparator();
+
+    QAction *exportStatistics = menu->addAction(tr("Export Statistics..."));
+    connect(exportStatistics, SIGNAL(triggered()), this, SLOT(exportStatistics()));
+
+    QAction *resetStatistics = menu->addAction(tr("Reset Statistics"));
+    connect(resetStatistics, SIGNAL(triggered()), this, SLOT(resetStatistics()));
 }
 
 void AdBlockDialog::addCustomRule(const QString &rule)
@@ -148,3 +165,21 @@ void AdBlockDialog::removeSubscription()
     AdBlockManager::instance()->removeSubscription(subscription);
 }
 
+void AdBlockDialog::exportStatistics()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save File"),
+                                tr("%1 AdBlock Statistics.csv").arg(QCoreApplication::applicationName()),
+                                tr("Comma separated values (*.csv)"));
+    if (fileName.isEmpty())
+        return;
+
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)
+        || !m_adBlockModel->exportStatistics(&file))
+        QMessageBox::critical(this, tr("Export error"), tr("error saving statistics"));
+}
+
+void AdBlockDialog::resetStatistics()
+{
+    m_adBlockModel->resetStatistics();
+}
@@ -50,6 +50,8 @@ private slots:
     void updateSubscription();
     void browseSubscriptions();
     void removeSubscription();
+    void exportStatistics();
+    void resetStatistics();
 
 private:
     AdBlockModel *m_adBlockModel;
@@ -0,0 +1,300 @@
+/**
+ * Copyright (c) 2009, Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Benjamin Meyer nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "adblockengine.h"
+
+#include "adblocksubscription.h"
+
+#include <qdebug.h>
+#include <qset.h>
+#include <qurl.h>
+
+// #define ADBLOCKENGINE_DEBUG
+
+AdBlockEngine::AdBlockEngine()
+{
+}
+
+void AdBlockEngine::clear()
+{
+    m_exceptionRules.clear();
+    m_blockRules.clear();
+    m_rules.clear();
+    m_genericSelectors.clear();
+    m_genericStyleSheet.clear();
+    m_genericExceptions.clear();
+    m_domainSelectors.clear();
+    m_domainIndex.clear();
+}
+
+int AdBlockEngine::count() const
+{
+    return m_exceptionRules.count() + m_blockRules.count();
+}
+
+void AdBlockEngine::addSubscription(const AdBlockSubscription *subscription)
+{
+    if (!subscription || !subscription->isEnabled())
+        return;
+
+    addRules(subscription->ruleStore(), subscription);
+}
+
+void AdBlockEngine::addRules(const QExplicitlySharedDataPointer<AdBlockRuleStore> &rules,
+                             const AdBlockSubscription *subscription)
+{
+    if (!rules)
+        return;
+    m_rules.append(SubscriptionRules(subscription, rules));
+    for (int i = 0; i < rules->count(); ++i) {
+        int id = rules->id(i);
+        if (!rules->isEnabled(id))
+            continue;
+        if (rules->isCSSRule(id))
+            addElementHidingRule(rules->filter(id));
+        else
+            networkIndex(rules.constData(), id)->addRule(rules.constData(), id, subscription);
+    }
+#if defined(ADBLOCKENGINE_DEBUG)
+    qDebug() << "AdBlockEngine::" << __FUNCTION__ << rules->count()
+             << m_exceptionRules.count() << m_blockRules.count();
+#endif
+}
+
+void AdBlockEngine::addRules(const QList<AdBlockRule> &rules,
+                             const AdBlockSubscription *subscription)
+{
+    QExplicitlySharedDataPointer<AdBlockRuleStore> store(new AdBlockRuleStore);
+    foreach (const AdBlockRule &rule, rules)
+        store->append(rule);
+    addRules(store, subscription);
+}
+
+AdBlockIndex *AdBlockEngine::networkIndex(const AdBlockRuleStore *rules, int id)
+{
+    return rules->isException(id) ? &m_exceptionRules : &m_blockRules;
+}
+
+/*
+    rules is the subscription's store after the change, the engine still
+    has the one from before, which holds a removed or replaced rule as it
+    was.  Element hiding rules are compiled into one stylesheet and can not
+    be taken out again, false is returned when the engine has to be built
+    again instead.
+ */
+bool AdBlockEngine::updateRules(const QExplicitlySharedDataPointer<AdBlockRuleStore> &rules,
+                                const AdBlockSubscription *subscription,
+                                const AdBlockRuleChange &change)
+{
+    int i = 0;
+    while (i < m_rules.count() && m_rules.at(i).first != subscription)
+        ++i;
+    if (i == m_rules.count() || !rules || change.type == AdBlockRuleChange::Reset)
+        return false;
+
+    const AdBlockRuleStore *oldRules = m_rules.at(i).second.constData();
+    bool removed = (change.type == AdBlockRuleChange::Removed
+                    || change.type == AdBlockRuleChange::Replaced);
+    bool added = (change.type == AdBlockRuleChange::Added
+                  || change.type == AdBlockRuleChange::Replaced);
+    if (removed) {
+        if (oldRules == rules.constData())
+            return false;
+        if (oldRules->isEnabled(change.id) && oldRules->isCSSRule(change.id))
+            return false;
+    }
+    if (added && rules->isEnabled(change.id) && rules->isCSSRule(change.id))
+        return false;
+
+    if (removed && oldRules->isEnabled(change.id))
+        networkIndex(oldRules, change.id)->removeRule(oldRules, change.id);
+    m_exceptionRules.replaceRuleStore(oldRules, rules.constData());
+    m_blockRules.replaceRuleStore(oldRules, rules.constData());
+    m_rules[i].second = rules;
+    if (added && rules->isEnabled(change.id))
+        networkIndex(rules.constData(), change.id)->addRule(rules.constData(), change.id, subscription);
+#if defined(ADBLOCKENGINE_DEBUG)
+    qDebug() << "AdBlockEngine::" << __FUNCTION__ << change.type << change.id
+             << m_exceptionRules.count() << m_blockRules.count();
+#endif
+    return true;
+}
+
+AdBlockEngine::Result AdBlockEngine::match(const QString &encodedUrl,
+                                           AdBlockRule *rule,
+                                           const AdBlockSubscription **subscription) const
+{
+    if (count() == 0)
+        return NoMatch;
+
+    AdBlockRequestContext context(QUrl::fromEncoded(encodedUrl.toUtf8()));
+    return match(encodedUrl, context, rule, subscription);
+}
+
+AdBlockEngine::Result AdBlockEngine::match(const QString &encodedUrl,
+                                           const AdBlockRequestContext &context,
+                                           AdBlockRule *rule,
+                                           const AdBlockSubscription **subscription) const
+{
+    if (count() == 0)
+        return NoMatch;
+
+    QVector<uint> urlTokens = AdBlockIndex::tokenize(encodedUrl);
+
+    const AdBlockSubscription *matchedSubscription = 0;
+    AdBlockRule matchedRule = m_exceptionRules.match(encodedUrl, urlTokens, context, &matchedSubscription);
+    Result result = Allowed;
+    if (matchedRule.isNull()) {
+        matchedRule = m_blockRules.match(encodedUrl, urlTokens, context, &matchedSubscription);
+        result = matchedRule.isNull() ? NoMatch : Blocked;
+    }
+
+    if (rule)
+        *rule = matchedRule;
+    if (subscription)
+        *subscription = matchedSubscription;
+    return result;
+}
+
+static inline QString hidingRule(const QString &selector)
+{
+    // One rule per selector, a selector WebKit does not understand would
+    // otherwise drop every other selector in the same rule.
+    return selector + QLatin1String(" { display: none !important; }\n");
+}
+
+/*
+    example.com,~foo.example.com##div.ads hides div.ads on example.com and
+    its subdomains except foo.example.com, a rule with only excluded
+    domains applies everywhere else.
+ */
+void AdBlockEngine::addElementHidingRule(const QString &filter)
+{
+    int offset = filter.indexOf(QLatin1String("##"));
+    if (offset == -1)
+        return;
+
+    QString selector = filter.mid(offset + 2).trimmed();
+    if (selector.isEmpty()
+        || selector.contains(QLatin1Char('{'))
+        || selector.contains(QLatin1Char('}')))
+        return;
+
+    QStringList includedDomains;
+    QStringList excludedDomains;
+    QStringList domains = filter.left(offset).split(QLatin1Char(','), QString::SkipEmptyParts);
+    foreach (const QString &domain, domains) {
+        QString name = domain.trimmed().toLower();
+        if (name.startsWith(QLatin1Char('~')))
+            excludedDomains.append(name.mid(1));
+        else if (!name.isEmpty())
+            includedDomains.append(name);
+    }
+
+    if (includedDomains.isEmpty()) {
+        int index = m_genericSelectors.count();
+        m_genericSelectors.append(selector);
+        m_genericStyleSheet += hidingRule(selector);
+        foreach (const QString &domain, excludedDomains)
+            m_genericExceptions[domain].append(index);
+        return;
+    }
+
+    int index = m_domainSelectors.count();
+    DomainSelector domainSelector;
+    domainSelector.selector = selector;
+    domainSelector.excludedDomains = excludedDomains;
+    m_domainSelectors.append(domainSelector);
+    foreach (const QString &domain, includedDomains)
+        m_domainIndex[domain].append(index);
+}
+
+/*
+    The host and each of its parent domains are looked up once, so the
+    cost does not depend on the number of element hiding rules that are
+    for other sites.
+ */
+QString AdBlockEngine::elementHidingStyleSheet(const QString &host) const
+{
+    QStringList domains;
+    QString name = host.toLower();
+    while (!name.isEmpty()) {
+        domains.append(name);
+        int dot = name.indexOf(QLatin1Char('.'));
+        if (dot == -1)
+            break;
+        name = name.mid(dot + 1);
+    }
+
+    QSet<int> excluded;
+    if (!m_genericExceptions.isEmpty()) {
+        foreach (const QString &domain, domains) {
+            QHash<QString, QList<int> >::const_iterator it = m_genericExceptions.constFind(domain);
+            if (it == m_genericExceptions.constEnd())
+                continue;
+            foreach (int index, it.value())
+                excluded.insert(index);
+        }
+    }
+
+    QString styleSheet;
+    if (excluded.isEmpty()) {
+        styleSheet = m_genericStyleSheet;
+    } else {
+        for (int i = 0; i < m_genericSelectors.count(); ++i) {
+            if (!excluded.contains(i))
+                styleSheet += hidingRule(m_genericSelectors.at(i));
+        }
+    }
+
+    QSet<int> added;
+    foreach (const QString &domain, domains) {
+        QHash<QString, QList<int> >::const_iterator it = m_domainIndex.constFind(domain);
+        if (it == m_domainIndex.constEnd())
+            continue;
+        foreach (int index, it.value()) {
+            if (added.contains(index))
+                continue;
+            added.insert(index);
+            const DomainSelector &domainSelector = m_domainSelectors.at(index);
+            bool isExcluded = false;
+            foreach (const QString &excludedDomain, domainSelector.excludedDomains) {
+                if (domains.contains(excludedDomain)) {
+                    isExcluded = true;
+                    break;
+                }
+            }
+            if (!isExcluded)
+                styleSheet += hidingRule(domainSelector.selector);
+        }
+    }
+#if defined(ADBLOCKENGINE_DEBUG)
+    qDebug() << "AdBlockEngine::" << __FUNCTION__ << host << styleSheet.length();
+#endif
+    return styleSheet;
+}
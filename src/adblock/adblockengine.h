@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2009, Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Benjamin Meyer nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef ADBLOCKENGINE_H
+#define ADBLOCKENGINE_H
+
+#include "adblockindex.h"
+#include "adblockrule.h"
+#include "adblockrulestore.h"
+
+#include <qhash.h>
+#include <qlist.h>
+#include <qpair.h>
+#include <qstringlist.h>
+#include <qvector.h>
+
+/*
+    All of the enabled network rules of every subscription compiled into
+    one exception index and one block index.  Exceptions are checked first
+    across all subscriptions so an exception in one subscription overrides
+    a blocking rule in any other.
+
+    The engine keeps a reference to each subscription's rule store, which
+    the subscription detaches from before changing its rules.  addRules()
+    only uses the subscription to tag the rules, so an engine can be built
+    on a worker thread from a snapshot of the rules.  updateRules() swaps
+    in a subscription's changed store and updates the indexes for just the
+    rule that changed.
+
+    Element hiding (##) rules are compiled into one generic stylesheet and
+    a table of per domain selectors that is looked up by host suffix.
+ */
+class AdBlockRuleChange;
+class AdBlockSubscription;
+class AdBlockEngine
+{
+
+public:
+    enum Result {
+        NoMatch,
+        Blocked,
+        Allowed
+    };
+
+    AdBlockEngine();
+
+    void clear();
+    void addSubscription(const AdBlockSubscription *subscription);
+    void addRules(const QExplicitlySharedDataPointer<AdBlockRuleStore> &rules,
+                  const AdBlockSubscription *subscription);
+    void addRules(const QList<AdBlockRule> &rules, const AdBlockSubscription *subscription);
+    bool updateRules(const QExplicitlySharedDataPointer<AdBlockRuleStore> &rules,
+                     const AdBlockSubscription *subscription,
+                     const AdBlockRuleChange &change);
+    int count() const;
+
+    Result match(const QString &encodedUrl,
+                 AdBlockRule *rule = 0,
+                 const AdBlockSubscription **subscription = 0) const;
+    Result match(const QString &encodedUrl,
+                 const AdBlockRequestContext &context,
+                 AdBlockRule *rule = 0,
+                 const AdBlockSubscription **subscription = 0) const;
+
+    QString elementHidingStyleSheet(const QString &host) const;
+
+private:
+    void addElementHidingRule(const QString &filter);
+    AdBlockIndex *networkIndex(const AdBlockRuleStore *rules, int id);
+
+    struct DomainSelector {
+        QString selector;
+        QStringList excludedDomains;
+    };
+
+    typedef QPair<const AdBlockSubscription*, QExplicitlySharedDataPointer<AdBlockRuleStore> > SubscriptionRules;
+    QList<SubscriptionRules> m_rules;
+    AdBlockIndex m_exceptionRules;
+    AdBlockIndex m_blockRules;
+
+    QStringList m_genericSelectors;
+    QString m_genericStyleSheet;
+    QHash<QString, QList<int> > m_genericExceptions;
+    QVector<DomainSelector> m_domainSelectors;
+    QHash<QString, QList<int> > m_domainIndex;
+};
+
+#endif // ADBLOCKENGINE_H
+
@@ -0,0 +1,377 @@
+/**
+ * Copyright (c) 2009, Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Benjamin Meyer nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "adblockindex.h"
+
+#include "adblockrulestore.h"
+
+#include <qdatetime.h>
+#include <qdebug.h>
+#include <qurl.h>
+
+// #define ADBLOCKINDEX_DEBUG
+
+// A power of two
+static const uint EVALUATION_SAMPLE_RATE = 64;
+
+AdBlockIndex::AdBlockIndex()
+    : m_count(0)
+    , m_evaluations(0)
+{
+}
+
+void AdBlockIndex::clear()
+{
+    m_sources.clear();
+    m_hosts.clear();
+    m_buckets.clear();
+    m_fallback.clear();
+    m_count = 0;
+}
+
+int AdBlockIndex::count() const
+{
+    return m_count;
+}
+
+static inline ushort toLowerAscii(ushort c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+uint AdBlockIndex::tokenHash(const QChar *data, int length)
+{
+    // The same hash function that qHash(QString) uses, but case folded
+    // so that urls do not need to be lowered before they are tokenized
+    uint h = 0;
+    for (int i = 0; i < length; ++i) {
+        h = (h << 4) + toLowerAscii(data[i].unicode());
+        h ^= (h & 0xf0000000) >> 23;
+        h &= 0x0fffffff;
+    }
+    return h;
+}
+
+// tokenHash() over the characters from right to left
+static inline uint hostHashStep(uint h, ushort c)
+{
+    h = (h << 4) + toLowerAscii(c);
+    h ^= (h & 0xf0000000) >> 23;
+    return h & 0x0fffffff;
+}
+
+static uint hostHash(const QString &host)
+{
+    uint h = 0;
+    for (int i = host.length() - 1; i >= 0; --i)
+        h = hostHashStep(h, host.at(i).unicode());
+    return h;
+}
+
+static inline bool isHostCharacter(ushort c)
+{
+    return AdBlockIndex::isTokenCharacter(c) || c == '-' || c == '.' || c == '_';
+}
+
+/*
+    The host of scheme://[user@]host[:port]/... in an encoded url.
+ */
+static bool findHost(const QString &encodedUrl, int *hostStart, int *hostEnd)
+{
+    const QChar *data = encodedUrl.constData();
+    const int length = encodedUrl.length();
+
+    int start = encodedUrl.indexOf(QLatin1String("://"));
+    if (start <= 0)
+        return false;
+    start += 3;
+    int end = start;
+    while (end < length && isHostCharacter(data[end].unicode()))
+        ++end;
+    if (end < length && data[end] == QLatin1Char('@')) {
+        start = end + 1;
+        end = start;
+        while (end < length && isHostCharacter(data[end].unicode()))
+            ++end;
+    }
+    if (end == start)
+        return false;
+    *hostStart = start;
+    *hostEnd = end;
+    return true;
+}
+
+QVector<uint> AdBlockIndex::tokenize(const QString &encodedUrl)
+{
+    QVector<uint> tokens;
+    const QChar *data = encodedUrl.constData();
+    const int length = encodedUrl.length();
+    int start = -1;
+    for (int i = 0; i <= length; ++i) {
+        bool tokenCharacter = (i < length) && isTokenCharacter(data[i].unicode());
+        if (tokenCharacter) {
+            if (start == -1)
+                start = i;
+            continue;
+        }
+        if (start != -1) {
+            tokens.append(tokenHash(data + start, i - start));
+            start = -1;
+        }
+    }
+
+    // Each bucket only needs to be visited once
+    qSort(tokens.begin(), tokens.end());
+    int unique = 0;
+    for (int i = 0; i < tokens.count(); ++i) {
+        if (i == 0 || tokens.at(i) != tokens.at(unique - 1))
+            tokens[unique++] = tokens.at(i);
+    }
+    tokens.resize(unique);
+    return tokens;
+}
+
+int AdBlockIndex::sourceOf(const AdBlockRuleStore *rules) const
+{
+    for (int i = 0; i < m_sources.count(); ++i) {
+        if (m_sources.at(i).rules == rules)
+            return i;
+    }
+    return -1;
+}
+
+void AdBlockIndex::addRule(const AdBlockRuleStore *rules, int id, const AdBlockSubscription *subscription)
+{
+    if (!rules)
+        return;
+    ++m_count;
+    Entry entry;
+    entry.source = sourceOf(rules);
+    entry.id = id;
+    if (entry.source == -1) {
+        Source source;
+        source.rules = rules;
+        source.subscription = subscription;
+        entry.source = m_sources.count();
+        m_sources.append(source);
+    }
+
+    const QString host = rules->hostAnchor(id);
+    if (!host.isEmpty()) {
+        HostEntry hostEntry;
+        hostEntry.host = host;
+        hostEntry.entry = entry;
+        m_hosts[hostHash(host)].append(hostEntry);
+        return;
+    }
+
+    const QString token = rules->token(id);
+    if (token.isEmpty()) {
+        m_fallback.append(entry);
+        return;
+    }
+    m_buckets[tokenHash(token.constData(), token.length())].append(entry);
+}
+
+// Keeps the order of the other entries, the first rule that matches wins
+bool AdBlockIndex::removeEntry(Bucket *bucket, const Entry &entry)
+{
+    for (int i = 0; i < bucket->count(); ++i) {
+        const Entry &other = bucket->at(i);
+        if (other.source == entry.source && other.id == entry.id) {
+            bucket->remove(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    The rule has to still be in the store, where it is filed is worked out
+    from its host or token again so only one bucket is searched.
+ */
+void AdBlockIndex::removeRule(const AdBlockRuleStore *rules, int id)
+{
+    Entry entry;
+    entry.source = sourceOf(rules);
+    entry.id = id;
+    if (entry.source == -1)
+        return;
+
+    const QString host = rules->hostAnchor(id);
+    if (!host.isEmpty()) {
+        QHash<uint, HostBucket>::iterator bucket = m_hosts.find(hostHash(host));
+        if (bucket == m_hosts.end())
+            return;
+        HostBucket &entries = bucket.value();
+        for (int i = 0; i < entries.count(); ++i) {
+            const Entry &other = entries.at(i).entry;
+            if (other.source == entry.source && other.id == entry.id) {
+                entries.remove(i);
+                --m_count;
+                break;
+            }
+        }
+        if (entries.isEmpty())
+            m_hosts.erase(bucket);
+        return;
+    }
+
+    const QString token = rules->token(id);
+    if (token.isEmpty()) {
+        if (removeEntry(&m_fallback, entry))
+            --m_count;
+        return;
+    }
+    QHash<uint, Bucket>::iterator bucket = m_buckets.find(tokenHash(token.constData(), token.length()));
+    if (bucket == m_buckets.end())
+        return;
+    if (removeEntry(&bucket.value(), entry))
+        --m_count;
+    if (bucket.value().isEmpty())
+        m_buckets.erase(bucket);
+}
+
+/*
+    Used when a store was detached, the rules keep their ids in the copy.
+ */
+void AdBlockIndex::replaceRuleStore(const AdBlockRuleStore *oldRules, const AdBlockRuleStore *newRules)
+{
+    for (int i = 0; i < m_sources.count(); ++i) {
+        if (m_sources.at(i).rules == oldRules)
+            m_sources[i].rules = newRules;
+    }
+}
+
+AdBlockRule AdBlockIndex::match(const QString &encodedUrl) const
+{
+    if (m_count == 0)
+        return AdBlockRule();
+    AdBlockRequestContext context(QUrl::fromEncoded(encodedUrl.toUtf8()));
+    return match(encodedUrl, tokenize(encodedUrl), context);
+}
+
+const AdBlockIndex::Entry *AdBlockIndex::matchBucket(const Bucket &bucket, const QString &encodedUrl,
+                                                      const AdBlockRequestContext &context) const
+{
+    const Source *sources = m_sources.constData();
+    Bucket::const_iterator end = bucket.constEnd();
+    for (Bucket::const_iterator it = bucket.constBegin(); it != end; ++it) {
+        const AdBlockRuleStore *rules = sources[it->source].rules;
+        if ((++m_evaluations & (EVALUATION_SAMPLE_RATE - 1)) != 0) {
+            if (rules->networkMatch(it->id, encodedUrl, context))
+                return it;
+            continue;
+        }
+        // QTime only counts milliseconds, but a sample crosses a tick with
+        // a chance that grows with how long it took, so the average of the
+        // samples of a rule still comes out right in microseconds
+        QTime timer;
+        timer.start();
+        bool matched = rules->networkMatch(it->id, encodedUrl, context);
+        rules->recordEvaluation(it->id, timer.elapsed() * 1000);
+        if (matched)
+            return it;
+    }
+    return 0;
+}
+
+/*
+    Hash the host from right to left and probe the table every time a
+    complete domain (the host itself or one of its parent domains) has
+    been hashed, so www.ads.example.com costs at most four lookups.
+ */
+const AdBlockIndex::Entry *AdBlockIndex::matchHost(const QString &encodedUrl) const
+{
+    int hostStart;
+    int hostEnd;
+    if (!findHost(encodedUrl, &hostStart, &hostEnd))
+        return 0;
+
+    const QChar *data = encodedUrl.constData();
+    uint h = 0;
+    for (int i = hostEnd - 1; i >= hostStart; --i) {
+        h = hostHashStep(h, data[i].unicode());
+        if (i != hostStart && data[i - 1] != QLatin1Char('.'))
+            continue;
+
+        QHash<uint, HostBucket>::const_iterator bucket = m_hosts.constFind(h);
+        if (bucket == m_hosts.constEnd())
+            continue;
+        const int length = hostEnd - i;
+        const HostBucket &entries = bucket.value();
+        for (int j = 0; j < entries.count(); ++j) {
+            const HostEntry &entry = entries.at(j);
+            if (entry.host.length() != length)
+                continue;
+            const QChar *host = entry.host.constData();
+            int k = 0;
+            while (k < length && host[k].unicode() == toLowerAscii(data[i + k].unicode()))
+                ++k;
+            if (k != length)
+                continue;
+            return &entry.entry;
+        }
+    }
+    return 0;
+}
+
+AdBlockRule AdBlockIndex::match(const QString &encodedUrl, const QVector<uint> &urlTokens,
+                                const AdBlockRequestContext &context,
+                                const AdBlockSubscription **subscription) const
+{
+    if (m_count == 0)
+        return AdBlockRule();
+
+    const Entry *entry = 0;
+    if (!m_hosts.isEmpty())
+        entry = matchHost(encodedUrl);
+
+    if (!entry && !m_buckets.isEmpty()) {
+        for (int i = 0; i < urlTokens.count() && !entry; ++i) {
+            QHash<uint, Bucket>::const_iterator bucket = m_buckets.constFind(urlTokens.at(i));
+            if (bucket != m_buckets.constEnd())
+                entry = matchBucket(bucket.value(), encodedUrl, context);
+        }
+    }
+
+    if (!entry)
+        entry = matchBucket(m_fallback, encodedUrl, context);
+
+    if (!entry) {
+#if defined(ADBLOCKINDEX_DEBUG)
+        qDebug() << "AdBlockIndex::" << __FUNCTION__ << "no match" << encodedUrl << m_hosts.count() << m_buckets.count() << m_fallback.count();
+#endif
+        return AdBlockRule();
+    }
+    const Source &source = m_sources.at(entry->source);
+    if (subscription)
+        *subscription = source.subscription;
+    return source.rules->rule(entry->id);
+}
+
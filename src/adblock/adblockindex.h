@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2009, Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Benjamin Meyer nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef ADBLOCKINDEX_H
+#define ADBLOCKINDEX_H
+
+#include "adblockrule.h"
+
+#include <qhash.h>
+#include <qvector.h>
+
+/*
+    Buckets network rules by the hash of a literal token taken from their
+    filter so that a url only has to be tested against the rules that share
+    one of its tokens.  Rules without a usable token are kept in a small
+    fallback list that is always checked.
+
+    Plain ||example.com^ rules are not tested at all, they are looked up
+    by the hash of the url's host and each of its parent domains.
+
+    One in EVALUATION_SAMPLE_RATE rule evaluations is timed and added to
+    the rule's statistics in its store.
+
+    Rules are kept by their id in the store, so a rule can be added or
+    removed without rebuilding the index.  The index does not keep the
+    rule stores alive, whoever fills it does.
+ */
+class AdBlockRuleStore;
+class AdBlockSubscription;
+class AdBlockIndex
+{
+
+public:
+    AdBlockIndex();
+
+    void clear();
+    void addRule(const AdBlockRuleStore *rules, int id, const AdBlockSubscription *subscription = 0);
+    void removeRule(const AdBlockRuleStore *rules, int id);
+    void replaceRuleStore(const AdBlockRuleStore *oldRules, const AdBlockRuleStore *newRules);
+    int count() const;
+
+    AdBlockRule match(const QString &encodedUrl) const;
+    AdBlockRule match(const QString &encodedUrl, const QVector<uint> &urlTokens,
+                      const AdBlockRequestContext &context,
+                      const AdBlockSubscription **subscription = 0) const;
+
+    static QVector<uint> tokenize(const QString &encodedUrl);
+    static uint tokenHash(const QChar *data, int length);
+    static inline bool isTokenCharacter(ushort c)
+    {
+        return (c >= 'a' && c <= 'z')
+            || (c >= 'A' && c <= 'Z')
+            || (c >= '0' && c <= '9')
+            || c == '%';
+    }
+
+private:
+    struct Source {
+        const AdBlockRuleStore *rules;
+        const AdBlockSubscription *subscription;
+    };
+    struct Entry {
+        int source;
+        int id;
+    };
+    typedef QVector<Entry> Bucket;
+    struct HostEntry {
+        QString host;
+        Entry entry;
+    };
+    typedef QVector<HostEntry> HostBucket;
+
+    int sourceOf(const AdBlockRuleStore *rules) const;
+    static bool removeEntry(Bucket *bucket, const Entry &entry);
+    const Entry *matchBucket(const Bucket &bucket, const QString &encodedUrl,
+                             const AdBlockRequestContext &context) const;
+    const Entry *matchHost(const QString &encodedUrl) const;
+
+    QVector<Source> m_sources;
+    QHash<uint, HostBucket> m_hosts;
+    QHash<uint, Bucket> m_buckets;
+    Bucket m_fallback;
+    int m_count;
+    mutable uint m_evaluations;
+};
+
+#endif // ADBLOCKINDEX_H
+
@@ -30,19 +30,25 @@
 
 #include "autosaver.h"
 #include "adblockdialog.h"
+#include "adblockengine.h"
 #include "adblocknetwork.h"
 #include "adblockpage.h"
 #include "adblocksubscription.h"
 #include "browserapplication.h"
 #include "networkaccessmanager.h"
 
+#include <qpair.h>
 #include <qstringlist.h>
 #include <qsettings.h>
+#include <qtconcurrentrun.h>
 
 #include <qdebug.h>
 
 // #define ADBLOCKMANAGER_DEBUG
 
+// Engines with more rules than this are built on a worker thread
+static const int ADBLOCK_ASYNC_RULES = 1000;
+
 AdBlockManager *AdBlockManager::s_adBlockManager = 0;
 
 AdBlockManager::AdBlockManager(QObject *parent)
@@ -53,14 +59,30 @@ AdBlockManager::AdBlockManager(QObject *parent)
     , m_adBlockDialog(0)
     , m_adBlockNetwork(0)
     , m_adBlockPage(0)
+    , m_engine(new AdBlockEngine)
+    , m_engineWatcher(new QFutureWatcher<AdBlockEngine*>(this))
+    , m_engineGeneration(0)
+    , m_engineDirty(true)
+    , m_engineBuilding(false)
+    , m_engineBuildingComplete(false)
+    , m_engineBuildingReleased(0)
+    , m_engineReady(false)
+    , m_failClosed(false)
 {
     connect(this, SIGNAL(rulesChanged()),
             m_saveTimer, SLOT(changeOccurred()));
+    connect(m_engineWatcher, SIGNAL(finished()),
+            this, SLOT(engineBuilt()));
 }
 
 AdBlockManager::~AdBlockManager()
 {
     m_saveTimer->saveIfNeccessary();
+    if (m_engineBuilding) {
+        m_engineWatcher->waitForFinished();
+        delete m_engineWatcher->result();
+    }
+    delete m_engine.fetchAndStoreOrdered(0);
 }
 
 AdBlockManager *AdBlockManager::instance()
@@ -86,6 +108,7 @@ void AdBlockManager::setEnabled(bool enabled)
     if (isEnabled() == enabled)
         return;
     m_enabled = enabled;
+    invalidateEngine();
     emit rulesChanged();
 }
 
@@ -103,6 +126,135 @@ AdBlockPage *AdBlockManager::page()
     return m_adBlockPage;
 }
 
+void AdBlockManager::invalidateEngine()
+{
+    m_engineDirty = true;
+}
+
+/*
+    A single edited rule is applied to the current engine when it is up
+    to date, anything else builds a new engine.
+ */
+void AdBlockManager::subscriptionRulesChanged(const AdBlockRuleChange &change)
+{
+    AdBlockSubscription *subscription = qobject_cast<AdBlockSubscription*>(sender());
+    AdBlockEngine *engine = m_engine;
+    if (subscription && engine && !m_engineDirty && !m_engineBuilding
+        && engine->updateRules(subscription->ruleStore(), subscription, change)) {
+        ++m_engineGeneration;
+    } else {
+        invalidateEngine();
+    }
+    emit rulesChanged();
+}
+
+typedef QPair<const AdBlockSubscription*, QExplicitlySharedDataPointer<AdBlockRuleStore> > SubscriptionRules;
+
+// Runs on a worker thread for large rule sets
+static AdBlockEngine *buildEngine(const QList<SubscriptionRules> &subscriptions)
+{
+    AdBlockEngine *engine = new AdBlockEngine;
+    foreach (const SubscriptionRules &subscription, subscriptions)
+        engine->addRules(subscription.second, subscription.first);
+    return engine;
+}
+
+/*
+    The engine is rebuilt the first time it is needed after any of the
+    subscriptions or their rules changed.  Large rule sets are built in the
+    background while requests keep being checked against the previous
+    engine.
+
+    Until an engine with all of the subscriptions loaded is ready requests
+    are let through (fail open) unless the failClosed setting is on, then
+    loading is finished on the spot so no request goes out unchecked.
+ */
+const AdBlockEngine *AdBlockManager::engine()
+{
+    if (!m_loaded)
+        load();
+    if (m_failClosed && !m_engineReady && m_engineBuilding) {
+        m_engineWatcher->waitForFinished();
+        engineBuilt();
+    }
+    if ((m_engineDirty || (m_failClosed && !m_engineReady)) && !m_engineBuilding)
+        rebuildEngine();
+    return m_engine;
+}
+
+/*
+    Changes every time a new engine is published, anything remembered
+    about an older engine (like its rule pointers) is stale.
+ */
+int AdBlockManager::engineGeneration() const
+{
+    return m_engineGeneration;
+}
+
+void AdBlockManager::rebuildEngine()
+{
+    bool failClosed = m_failClosed && !m_engineReady;
+    if (failClosed) {
+        foreach (AdBlockSubscription *subscription, m_subscriptions)
+            subscription->waitForRules();
+    }
+
+    m_engineDirty = false;
+    int released = m_removedSubscriptions.count();
+    bool complete = true;
+    int count = 0;
+    QList<SubscriptionRules> subscriptions;
+    foreach (AdBlockSubscription *subscription, m_subscriptions) {
+        if (!subscription->isEnabled())
+            continue;
+        if (subscription->isLoading())
+            complete = false;
+        QExplicitlySharedDataPointer<AdBlockRuleStore> rules = subscription->ruleStore();
+        count += rules->count();
+        subscriptions.append(SubscriptionRules(subscription, rules));
+    }
+
+    if (failClosed || count < ADBLOCK_ASYNC_RULES) {
+        setEngine(buildEngine(subscriptions), complete, released);
+        return;
+    }
+
+#if defined(ADBLOCKMANAGER_DEBUG)
+    qDebug() << "AdBlockManager::" << __FUNCTION__ << "building in the background" << count << "rules";
+#endif
+    m_engineBuilding = true;
+    m_engineBuildingComplete = complete;
+    m_engineBuildingReleased = released;
+    m_engineWatcher->setFuture(QtConcurrent::run(buildEngine, subscriptions));
+}
+
+void AdBlockManager::engineBuilt()
+{
+    if (!m_engineBuilding)
+        return;
+    m_engineBuilding = false;
+    setEngine(m_engineWatcher->result(), m_engineBuildingComplete, m_engineBuildingReleased);
+}
+
+/*
+    The first \a released removed subscriptions were gone before \a engine
+    was built, nothing refers to them any more once it replaces the old one.
+ */
+void AdBlockManager::setEngine(AdBlockEngine *engine, bool complete, int released)
+{
+    AdBlockEngine *oldEngine = m_engine.fetchAndStoreOrdered(engine);
+    delete oldEngine;
+    ++m_engineGeneration;
+    for (int i = 0; i < released; ++i)
+        m_removedSubscriptions.at(i)->deleteLater();
+    m_removedSubscriptions = m_removedSubscriptions.mid(released);
+    if (complete)
+        m_engineReady = true;
+#if defined(ADBLOCKMANAGER_DEBUG)
+    qDebug() << "AdBlockManager::" << __FUNCTION__ << engine->count() << "rules" << "complete:" << complete;
+#endif
+}
+
 static QUrl customSubscriptionLocation()
 {
     QString fileName = BrowserApplication::dataFilePath(QLatin1String("adblock_subscription_custom"));
@@ -150,8 +302,13 @@ void AdBlockManager::removeSubscription(AdBlockSubscription *subscription)
 #endif
     m_saveTimer->saveIfNeccessary();
     m_subscriptions.removeOne(subscription);
+    disconnect(subscription, 0, this, 0);
+    disconnect(subscription, 0, m_saveTimer, 0);
+    // The engine in use and the one being built point to the subscription,
+    // it is deleted once an engine without it takes their place
     if (subscription->parent() == this)
-        subscription->deleteLater();
+        m_removedSubscriptions.append(subscription);
+    invalidateEngine();
     emit rulesChanged();
 }
 
@@ -163,8 +320,12 @@ void AdBlockManager::addSubscription(AdBlockSubscription *subscription)
     qDebug() << "AdBlockManager::" << __FUNCTION__ << subscription->location();
 #endif
     m_subscriptions.append(subscription);
-    connect(subscription, SIGNAL(rulesChanged()), this, SIGNAL(rulesChanged()));
+    connect(subscription, SIGNAL(rulesChanged(AdBlockRuleChange)),
+            this, SLOT(subscriptionRulesChanged(AdBlockRuleChange)));
+    connect(subscription, SIGNAL(changed()), this, SLOT(invalidateEngine()));
     connect(subscription, SIGNAL(changed()), this, SIGNAL(rulesChanged()));
+    connect(subscription, SIGNAL(metaDataChanged()), m_saveTimer, SLOT(changeOccurred()));
+    invalidateEngine();
     emit rulesChanged();
 }
 
@@ -179,6 +340,7 @@ void AdBlockManager::save()
     QSettings settings;
     settings.beginGroup(QLatin1String("AdBlock"));
     settings.setValue(QLatin1String("enabled"), m_enabled);
+    settings.setValue(QLatin1String("failClosed"), m_failClosed);
     QStringList subscriptions;
     foreach (AdBlockSubscription *subscription, m_subscriptions) {
         if (!subscription)
@@ -202,6 +364,7 @@ void AdBlockManager::load()
     QSettings settings;
     settings.beginGroup(QLatin1String("AdBlock"));
     m_enabled = settings.value(QLatin1String("enabled"), m_enabled).toBool();
+    m_failClosed = settings.value(QLatin1String("failClosed"), m_failClosed).toBool();
 
     QStringList defaultSubscriptions;
     defaultSubscriptions.append(QString::fromUtf8(customSubscriptionUrl().toEncoded()));
@@ -211,8 +374,11 @@ void AdBlockManager::load()
     foreach (const QString &subscription, subscriptions) {
         QUrl url = QUrl::fromEncoded(subscription.toUtf8());
         AdBlockSubscription *adBlockSubscription = new AdBlockSubscription(url, this);
-        connect(adBlockSubscription, SIGNAL(rulesChanged()), this, SIGNAL(rulesChanged()));
+        connect(adBlockSubscription, SIGNAL(rulesChanged(AdBlockRuleChange)),
+                this, SLOT(subscriptionRulesChanged(AdBlockRuleChange)));
+        connect(adBlockSubscription, SIGNAL(changed()), this, SLOT(invalidateEngine()));
         connect(adBlockSubscription, SIGNAL(changed()), this, SIGNAL(rulesChanged()));
+        connect(adBlockSubscription, SIGNAL(metaDataChanged()), m_saveTimer, SLOT(changeOccurred()));
         m_subscriptions.append(adBlockSubscription);
     }
 }
@@ -31,13 +31,17 @@
 
 #include <qobject.h>
 
+#include <qatomic.h>
+#include <qfuturewatcher.h>
 #include <qpointer.h>
 
 class QUrl;
 class AutoSaver;
 class AdBlockDialog;
+class AdBlockEngine;
 class AdBlockNetwork;
 class AdBlockPage;
+class AdBlockRuleChange;
 class AdBlockSubscription;
 class AdBlockManager : public QObject
 {
@@ -62,6 +66,8 @@ public:
     AdBlockNetwork *network();
     AdBlockPage *page();
     AdBlockSubscription *customRules();
+    const AdBlockEngine *engine();
+    int engineGeneration() const;
 
 public slots:
     void setEnabled(bool enabled);
@@ -69,8 +75,13 @@ public slots:
 
 private slots:
     void save();
+    void invalidateEngine();
+    void subscriptionRulesChanged(const AdBlockRuleChange &change);
+    void engineBuilt();
 
 private:
+    void rebuildEngine();
+    void setEngine(AdBlockEngine *engine, bool complete, int released);
     static QUrl customSubscriptionUrl();
     static AdBlockManager *s_adBlockManager;
 
@@ -80,7 +91,17 @@ private:
     QPointer<AdBlockDialog> m_adBlockDialog;
     AdBlockNetwork *m_adBlockNetwork;
     AdBlockPage *m_adBlockPage;
+    QAtomicPointer<AdBlockEngine> m_engine;
+    QFutureWatcher<AdBlockEngine*> *m_engineWatcher;
+    int m_engineGeneration;
+    bool m_engineDirty;
+    bool m_engineBuilding;
+    bool m_engineBuildingComplete;
+    int m_engineBuildingReleased;
+    bool m_engineReady;
+    bool m_failClosed;
     QList<AdBlockSubscription*> m_subscriptions;
+    QList<AdBlockSubscription*> m_removedSubscriptions;
 
 };
 
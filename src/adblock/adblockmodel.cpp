@@ -32,6 +32,9 @@
 #include "adblocksubscription.h"
 #include "adblockmanager.h"
 
+#include <qiodevice.h>
+#include <qtextstream.h>
+
 AdBlockModel::AdBlockModel(QObject *parent)
     : QAbstractItemModel(parent)
     , m_manager(AdBlockManager::instance())
@@ -48,7 +51,7 @@ const AdBlockRule AdBlockModel::rule(const QModelIndex &index) const
 {
     const AdBlockSubscription *parent = static_cast<AdBlockSubscription*>(index.internalPointer());
     Q_ASSERT(parent);
-    return parent->allRules().at(index.row());
+    return parent->rule(index.row());
 }
 
 AdBlockSubscription *AdBlockModel::subscription(const QModelIndex &index) const
@@ -75,17 +78,99 @@ QVariant AdBlockModel::headerData(int section, Qt::Orientation orientation, int
     if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
         switch (section) {
         case 0: return tr("Rule");
+        case 1: return tr("Hits");
+        case 2: return tr("Time (usec)");
+        case 3: return tr("Saved (KB)");
         }
     }
     return QAbstractItemModel::headerData(section, orientation, role);
 }
 
+/*
+    Hits is how often a rule matched a request, or for a subscription how
+    many requests its rules blocked.  Time is the average of the sampled
+    evaluations of a rule and Saved what the blocked requests of a
+    subscription weighed in the disk cache.
+ */
+QVariant AdBlockModel::statistics(const QModelIndex &index) const
+{
+    if (index.parent().isValid()) {
+        const AdBlockRule r = rule(index);
+        switch (index.column()) {
+        case 1:
+            return r.hits();
+        case 2:
+            if (r.sampledEvaluations() == 0)
+                return QVariant();
+            return double(r.sampledTime()) / r.sampledEvaluations();
+        }
+        return QVariant();
+    }
+
+    AdBlockSubscription *sub = subscription(index);
+    if (!sub)
+        return QVariant();
+    switch (index.column()) {
+    case 1:
+        return sub->blockedRequests();
+    case 3:
+        return sub->bytesSaved() / 1024;
+    }
+    return QVariant();
+}
+
+static QString csvField(const QString &text)
+{
+    if (!text.contains(QLatin1Char(',')) && !text.contains(QLatin1Char('"')))
+        return text;
+    QString quoted = text;
+    quoted.replace(QLatin1String("\""), QLatin1String("\"\""));
+    return QLatin1Char('"') + quoted + QLatin1Char('"');
+}
+
+/*
+    Comma separated, a line for each subscription followed by a line for
+    each of its rules, including the ones that never matched.
+ */
+bool AdBlockModel::exportStatistics(QIODevice *device) const
+{
+    if (!device || !device->isWritable())
+        return false;
+
+    QTextStream stream(device);
+    stream << "subscription,rule,hits,sampled evaluations,sampled time (usec),bytes saved" << endl;
+    foreach (AdBlockSubscription *subscription, m_manager->subscriptions()) {
+        QString title = csvField(subscription->title());
+        stream << title << ",," << subscription->blockedRequests() << ",,,"
+               << subscription->bytesSaved() << endl;
+        for (int i = 0; i < subscription->ruleCount(); ++i) {
+            const AdBlockRule r = subscription->rule(i);
+            stream << title << ',' << csvField(r.filter()) << ',' << r.hits() << ','
+                   << r.sampledEvaluations() << ',' << r.sampledTime() << ',' << endl;
+        }
+    }
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
+
+void AdBlockModel::resetStatistics()
+{
+    foreach (AdBlockSubscription *subscription, m_manager->subscriptions())
+        subscription->resetStatistics();
+    reset();
+}
+
 QVariant AdBlockModel::data(const QModelIndex &index, int role) const
 {
     if (!index.isValid()
-        || index.model() != this
-        || index.column() != 0)
+        || index.model() != this)
+        return QVariant();
+
+    if (index.column() != 0) {
+        if (role == Qt::DisplayRole)
+            return statistics(index);
         return QVariant();
+    }
 
     switch (role) {
     case Qt::EditRole:
@@ -118,7 +203,7 @@ QVariant AdBlockModel::data(const QModelIndex &index, int role) const
 
 int AdBlockModel::columnCount(const QModelIndex &parent) const
 {
-    return (parent.column() > 0) ? 0 : 1;
+    return (parent.column() > 0) ? 0 : 4;
 }
 
 int AdBlockModel::rowCount(const QModelIndex &parent) const
@@ -133,7 +218,7 @@ int AdBlockModel::rowCount(const QModelIndex &parent) const
         return 0;
 
     const AdBlockSubscription *parentNode = subscription(parent);
-    return parentNode ? parentNode->allRules().count() : 0;
+    return parentNode ? parentNode->ruleCount() : 0;
 }
 
 QModelIndex AdBlockModel::index(int row, int column, const QModelIndex &parent) const
@@ -168,14 +253,18 @@ Qt::ItemFlags AdBlockModel::flags(const QModelIndex &index) const
         return Qt::NoItemFlags;
 
     Qt::ItemFlags flags = Qt::ItemIsSelectable;
+    // The statistics can only be looked at
+    Qt::ItemFlags editable = (index.column() == 0)
+                             ? Qt::ItemIsUserCheckable | Qt::ItemIsEditable
+                             : Qt::ItemFlags(0);
 
     if (index.parent().isValid()) {
-        flags |= Qt::ItemIsUserCheckable | Qt::ItemIsEditable;
+        flags |= editable;
         const AdBlockSubscription *parentNode = subscription(index.parent());
         if (parentNode && parentNode->isEnabled())
             flags |= Qt::ItemIsEnabled;
     } else {
-        flags |= Qt::ItemIsUserCheckable | Qt::ItemIsEditable | Qt::ItemIsEnabled;
+        flags |= editable | Qt::ItemIsEnabled;
     }
 
     return flags;
@@ -201,7 +290,6 @@ bool AdBlockModel::removeRows(int row, int count, const QModelIndex &parent)
         if (sub) {
             disconnect(m_manager, SIGNAL(rulesChanged()), this, SLOT(rulesChanged()));
             beginRemoveRows(parent, row, row + count - 1);
-            QList<AdBlockRule> rules = sub->allRules();
             for (int i = row + count - 1; i >= row; --i)
                 sub->removeRule(i);
             endRemoveRows();
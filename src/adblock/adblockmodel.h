@@ -31,6 +31,7 @@
 
 #include <qabstractitemmodel.h>
 
+class QIODevice;
 class AdBlockRule;
 class AdBlockSubscription;
 class AdBlockManager;
@@ -56,10 +57,15 @@ public:
     AdBlockSubscription *subscription(const QModelIndex &index) const;
     QModelIndex index(AdBlockSubscription *subscription);
 
+    bool exportStatistics(QIODevice *device) const;
+    void resetStatistics();
+
 private slots:
     void rulesChanged();
 
 private:
+    QVariant statistics(const QModelIndex &index) const;
+
     AdBlockManager *m_manager;
 };
 
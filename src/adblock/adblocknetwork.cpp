@@ -29,18 +29,72 @@
 #include "adblocknetwork.h"
 
 #include "adblockblockednetworkreply.h"
+#include "adblockengine.h"
 #include "adblockmanager.h"
 #include "adblocksubscription.h"
+#include "webpageproxy.h"
 
 #include <qdebug.h>
+#include <qwebframe.h>
+#include <qwebpage.h>
 
 // #define ADBLOCKNETWORK_DEBUG
 
 AdBlockNetwork::AdBlockNetwork(QObject *parent)
     : QObject(parent)
+    , m_verdicts(2048)
+    , m_generation(-1)
+    , m_cacheHits(0)
+    , m_cacheMisses(0)
 {
 }
 
+/*
+    The url of the page a request was made for, empty for navigation
+    requests of the main frame (those are their own page) or requests that
+    did not come from a page.  Frames inside a page navigate for that page.
+ */
+static QUrl pageUrl(const QNetworkRequest &request)
+{
+    QVariant variant = request.attribute((QNetworkRequest::Attribute)(WebPageProxy::pageAttributeId()));
+    QWebPage *page = static_cast<QWebPage*>(qvariant_cast<void*>(variant));
+    if (!page || !page->mainFrame())
+        return QUrl();
+    QVariant navigationType = request.attribute((QNetworkRequest::Attribute)(WebPageProxy::pageAttributeId() + 1));
+    if (navigationType.isValid()) {
+        QVariant frame = request.attribute((QNetworkRequest::Attribute)(WebPageProxy::pageAttributeId() + 2));
+        if (qvariant_cast<void*>(frame) == (void *) page->mainFrame())
+            return QUrl();
+    }
+    return page->mainFrame()->url();
+}
+
+int AdBlockNetwork::cacheSize() const
+{
+    return m_verdicts.maxCost();
+}
+
+void AdBlockNetwork::setCacheSize(int size)
+{
+    m_verdicts.setMaxCost(size);
+}
+
+int AdBlockNetwork::cacheHits() const
+{
+    return m_cacheHits;
+}
+
+int AdBlockNetwork::cacheMisses() const
+{
+    return m_cacheMisses;
+}
+
+void AdBlockNetwork::resetCacheStatistics()
+{
+    m_cacheHits = 0;
+    m_cacheMisses = 0;
+}
+
 QNetworkReply *AdBlockNetwork::block(const QNetworkRequest &request)
 {
     QUrl url = request.url();
@@ -52,27 +106,52 @@ QNetworkReply *AdBlockNetwork::block(const QNetworkRequest &request)
     if (!manager->isEnabled())
         return 0;
 
-    QString urlString = QString::fromUtf8(url.toEncoded());
-    const AdBlockRule *blockedRule = 0;
-    const AdBlockSubscription *blockingSubscription = 0;
+    const AdBlockEngine *engine = manager->engine();
+    int generation = manager->engineGeneration();
+    QByteArray encodedUrl = url.toEncoded();
+    QUrl page = pageUrl(request);
+    AdBlockRule matchedRule;
+    const AdBlockSubscription *matchedSubscription = 0;
+    bool blocked = false;
 
-    QList<AdBlockSubscription*> subscriptions = manager->subscriptions();
-    foreach (AdBlockSubscription *subscription, subscriptions) {
-        if (subscription->allow(urlString))
-            return 0;
+    // Rule options depend on the page, the same url can get another verdict
+    QByteArray key = encodedUrl;
+    if (!page.isEmpty())
+        key += ' ' + page.host().toUtf8();
 
-        if (const AdBlockRule *rule = subscription->block(urlString)) {
-            blockedRule = rule;
-            blockingSubscription = subscription;
-            break;
-        }
+    if (generation != m_generation) {
+        m_verdicts.clear();
+        m_generation = generation;
     }
 
-    if (blockedRule) {
+    Verdict *verdict = m_verdicts.object(key);
+    if (verdict) {
+        ++m_cacheHits;
+        matchedRule = verdict->rule;
+        matchedSubscription = verdict->subscription;
+        blocked = verdict->blocked;
+    } else {
+        ++m_cacheMisses;
+        QString urlString = QString::fromUtf8(encodedUrl);
+        AdBlockRequestContext context(url, page);
+        blocked = (engine->match(urlString, context, &matchedRule, &matchedSubscription) == AdBlockEngine::Blocked);
+        verdict = new Verdict;
+        verdict->rule = matchedRule;
+        verdict->subscription = matchedSubscription;
+        verdict->blocked = blocked;
+        m_verdicts.insert(key, verdict);
+    }
+
+    // Exceptions that let a request through count as hits too
+    matchedRule.recordHit();
+
+    if (blocked) {
 #if defined(ADBLOCKNETWORK_DEBUG)
-        qDebug() << "AdBlockNetwork::" << __FUNCTION__ << "rule:" << blockedRule->filter() << "subscription:" << blockingSubscription->title() << url;
+        qDebug() << "AdBlockNetwork::" << __FUNCTION__ << "rule:" << matchedRule.filter() << "subscription:" << matchedSubscription->title() << url;
 #endif
-       AdBlockBlockedNetworkReply *reply = new AdBlockBlockedNetworkReply(request, blockedRule, this);
+        if (matchedSubscription)
+            matchedSubscription->recordBlocked(encodedUrl);
+        AdBlockBlockedNetworkReply *reply = new AdBlockBlockedNetworkReply(request, matchedRule, this);
         return reply;
     }
     return 0;
@@ -31,8 +31,13 @@
 
 #include <qobject.h>
 
+#include "adblockrule.h"
+
+#include <qcache.h>
+
 class QNetworkRequest;
 class QNetworkReply;
+class AdBlockSubscription;
 class AdBlockNetwork : public QObject
 {
     Q_OBJECT
@@ -42,6 +47,28 @@ public:
 
     QNetworkReply *block(const QNetworkRequest &request);
 
+    int cacheSize() const;
+    void setCacheSize(int size);
+    int cacheHits() const;
+    int cacheMisses() const;
+    void resetCacheStatistics();
+
+private:
+    /*
+        The outcome of matching a url with the engine of m_generation, the
+        rule keeps its store alive so the cache is dropped for a new engine.
+        rule is the exception rule when the request was allowed by one.
+     */
+    struct Verdict {
+        AdBlockRule rule;
+        const AdBlockSubscription *subscription;
+        bool blocked;
+    };
+    QCache<QByteArray, Verdict> m_verdicts;
+    int m_generation;
+    int m_cacheHits;
+    int m_cacheMisses;
+
 };
 
 #endif // ADBLOCKNETWORK_H
@@ -28,15 +28,13 @@
 
 #include "adblockpage.h"
 
+#include "adblockengine.h"
 #include "adblockmanager.h"
-#include "adblocksubscription.h"
-#include "adblockrule.h"
 
-#if QT_VERSION >= 0x040600
-#include <qwebelement.h>
-#endif
+#include <qfile.h>
 #include <qwebpage.h>
 #include <qwebframe.h>
+#include <qwebsettings.h>
 
 #include <qdebug.h>
 
@@ -44,76 +42,91 @@
 
 AdBlockPage::AdBlockPage(QObject *parent)
     : QObject(parent)
+    , m_styleSheets(16)
+    , m_generation(-1)
 {
 }
 
-void AdBlockPage::checkRule(const AdBlockRule *rule, QWebPage *page, const QString &host)
+/*
+    The contents of the global user stylesheet, a page can only have one
+    user stylesheet so ours has to include it.  Only data: urls and local
+    files can be read, false is returned for anything else.
+ */
+static bool userStyleSheet(const QUrl &url, QByteArray *styleSheet)
 {
-    if (!rule->isEnabled())
-        return;
-
-    QString filter = rule->filter();
-    int offset = filter.indexOf(QLatin1String("##"));
-    if (offset == -1)
-        return;
-
-    QString selectorQuery;
-    if (offset > 0) {
-        QString domainRules = filter.mid(0, offset);
-        selectorQuery = filter.mid(offset + 2);
-        QStringList domains = domainRules.split(QLatin1Char(','));
+    styleSheet->clear();
+    if (url.isEmpty())
+        return true;
 
-        bool match = false;
-        foreach (const QString &domain, domains) {
-            bool reverse = (domain[0] == QLatin1Char('~'));
-            if (reverse) {
-                QString xdomain = domain.mid(1);
-                if (host.endsWith(xdomain))
-                    return;
-                match = true;
-            }
-            if (host.endsWith(domain))
-                match = true;
-        }
-        if (!match)
-            return;
-    }
-
-    if (offset == 0)
-        selectorQuery = filter.mid(2);
-
-    Q_UNUSED(page);
-#if QT_VERSION >= 0x040600
-    QWebElement document = page->mainFrame()->documentElement();
-    QWebElementCollection elements = document.findAll(selectorQuery);
-#if defined(ADBLOCKPAGE_DEBUG)
-    if (elements.count() != 0)
-        qDebug() << "AdBlockPage::" << __FUNCTION__ << "blocking" << elements.count() << "items" << selectorQuery << elements.count() << "rule:" << rule->filter();
-#endif
-    foreach (QWebElement element, elements) {
-        element.setStyleProperty(QLatin1String("visibility"), QLatin1String("hidden"));
-        element.removeFromDocument();
+    if (url.scheme() == QLatin1String("data")) {
+        QByteArray encoded = url.toEncoded();
+        int comma = encoded.indexOf(',');
+        if (comma == -1)
+            return false;
+        QByteArray header = encoded.left(comma);
+        QByteArray data = encoded.mid(comma + 1);
+        if (header.endsWith(";base64"))
+            *styleSheet = QByteArray::fromBase64(data);
+        else
+            *styleSheet = QByteArray::fromPercentEncoding(data);
+        return true;
     }
 
-#endif
+    QString fileName = url.toLocalFile();
+    if (fileName.isEmpty())
+        return false;
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+        return false;
+    *styleSheet = file.readAll();
+    return true;
 }
 
+/*
+    Instead of querying the document for every element hiding rule once it
+    has loaded the rules for the page's host are handed to WebKit as the
+    page's user stylesheet, which applies before the page is laid out.
+
+    A global user stylesheet that can not be read is never replaced, the
+    page then goes without element hiding.
+ */
 void AdBlockPage::applyRulesToPage(QWebPage *page)
 {
     if (!page || !page->mainFrame())
         return;
     AdBlockManager *manager = AdBlockManager::instance();
-    if (!manager->isEnabled())
+    if (!manager->isEnabled()) {
+        // An empty url falls back to the global user stylesheet
+        page->settings()->setUserStyleSheetUrl(QUrl());
         return;
-#if QT_VERSION >= 0x040600
+    }
+
+    const AdBlockEngine *engine = manager->engine();
+    QUrl globalStyleSheetUrl = QWebSettings::globalSettings()->userStyleSheetUrl();
+    if (m_generation != manager->engineGeneration()
+        || m_globalStyleSheetUrl != globalStyleSheetUrl) {
+        m_styleSheets.clear();
+        m_generation = manager->engineGeneration();
+        m_globalStyleSheetUrl = globalStyleSheetUrl;
+    }
+
     QString host = page->mainFrame()->url().host();
-    QList<AdBlockSubscription*> subscriptions = manager->subscriptions();
-    foreach (AdBlockSubscription *subscription, subscriptions) {
-        QList<const AdBlockRule*> rules = subscription->pageRules();
-        foreach (const AdBlockRule *rule, rules) {
-            checkRule(rule, page, host);
+    QUrl *styleSheetUrl = m_styleSheets.object(host);
+    if (!styleSheetUrl) {
+        styleSheetUrl = new QUrl;
+        QString styleSheet = engine->elementHidingStyleSheet(host);
+        QByteArray data;
+        if (!styleSheet.isEmpty() && userStyleSheet(globalStyleSheetUrl, &data)) {
+            if (!data.isEmpty())
+                data += '\n';
+            data += styleSheet.toUtf8();
+            *styleSheetUrl = QUrl::fromEncoded("data:text/css;charset=utf-8;base64," + data.toBase64());
         }
-    }
+        m_styleSheets.insert(host, styleSheetUrl);
+#if defined(ADBLOCKPAGE_DEBUG)
+        qDebug() << "AdBlockPage::" << __FUNCTION__ << host << styleSheet.length();
 #endif
+    }
+    page->settings()->setUserStyleSheetUrl(*styleSheetUrl);
 }
 
@@ -31,7 +31,9 @@
 
 #include <qobject.h>
 
-class AdBlockRule;
+#include <qcache.h>
+#include <qurl.h>
+
 class QWebPage;
 class AdBlockPage : public QObject
 {
@@ -43,7 +45,10 @@ public:
     void applyRulesToPage(QWebPage *page);
 
 private:
-    void checkRule(const AdBlockRule *rule, QWebPage *page, const QString &host);
+    // host -> user stylesheet url
+    QCache<QString, QUrl> m_styleSheets;
+    int m_generation;
+    QUrl m_globalStyleSheetUrl;
 };
 
 #endif // ADBLOCKPAGE_H
@@ -29,170 +29,288 @@
 
 #include "adblockrule.h"
 
-#include "adblocksubscription.h"
+#include "adblockrulestore.h"
 
+#include <qdatastream.h>
 #include <qdebug.h>
-#include <qregexp.h>
 #include <qurl.h>
 
 // #define ADBLOCKRULE_DEBUG
 
 AdBlockRule::AdBlockRule(const QString &filter)
+    : m_id(0)
 {
     setFilter(filter);
 }
 
-QString AdBlockRule::filter() const
+AdBlockRule::AdBlockRule(const AdBlockRuleStore *store, int id)
+    : d(const_cast<AdBlockRuleStore*>(store))
+    , m_id(id)
 {
-    return m_filter;
 }
 
-void AdBlockRule::setFilter(const QString &filter)
+AdBlockRule::AdBlockRule(const AdBlockRule &other)
+    : d(other.d)
+    , m_id(other.m_id)
 {
-    m_filter = filter;
-
-    m_cssRule = false;
-    m_enabled = true;
-    m_exception = false;
-    bool regExpRule = false;
-
-    if (filter.startsWith(QLatin1String("!"))
-        || filter.trimmed().isEmpty())
-        m_enabled = false;
+}
 
-    if (filter.contains(QLatin1String("##")))
-        m_cssRule = true;
+AdBlockRule::~AdBlockRule()
+{
+}
 
-    QString parsedLine = filter;
-    if (parsedLine.startsWith(QLatin1String("@@"))) {
-        m_exception = true;
-        parsedLine = parsedLine.mid(2);
-    }
-    if (parsedLine.startsWith(QLatin1Char('/'))) {
-        if (parsedLine.endsWith(QLatin1Char('/'))) {
-            parsedLine = parsedLine.mid(1);
-            parsedLine = parsedLine.left(parsedLine.size() - 1);
-            regExpRule = true;
-        }
-    }
-    int options = parsedLine.indexOf(QLatin1String("$"), 0);
-    if (options >= 0) {
-        m_options = parsedLine.mid(options + 1).split(QLatin1Char(','));
-        parsedLine = parsedLine.left(options);
-    }
+AdBlockRule &AdBlockRule::operator=(const AdBlockRule &other)
+{
+    d = other.d;
+    m_id = other.m_id;
+    return *this;
+}
 
-    setPattern(parsedLine, regExpRule);
+/*
+    A rule without a filter, also what the matching functions return when
+    nothing matched.
+ */
+bool AdBlockRule::isNull() const
+{
+    return !d;
+}
 
-    if (m_options.contains(QLatin1String("match-case"))) {
-        m_regExp.setCaseSensitivity(Qt::CaseSensitive);
-        m_options.removeOne(QLatin1String("match-case"));
-    }
+// Give the rule a store that nothing else refers to before changing it
+void AdBlockRule::detach()
+{
+    if (d && d->ref == 1 && d->count() == 1)
+        return;
+    AdBlockRuleStore *store = new AdBlockRuleStore;
+    m_id = store->append(*this);
+    d = store;
 }
 
-bool AdBlockRule::networkMatch(const QString &encodedUrl) const
+QString AdBlockRule::filter() const
 {
-    if (m_cssRule) {
-#if defined(ADBLOCKRULE_DEBUG)
-        qDebug() << "AdBlockRule::" << __FUNCTION__ << "m_cssRule" << m_cssRule;
-#endif
-        return false;
-    }
+    return d ? d->filter(m_id) : QString();
+}
 
-    if (!m_enabled) {
-#if defined(ADBLOCKRULE_DEBUG)
-        qDebug() << "AdBlockRule::" << __FUNCTION__ << "is not enabled";
-#endif
-        return false;
+void AdBlockRule::setFilter(const QString &filter)
+{
+    m_id = 0;
+    if (filter.isEmpty()) {
+        d = 0;
+        return;
     }
+    AdBlockRuleStore *store = new AdBlockRuleStore;
+    m_id = store->append(filter);
+    d = store;
+}
 
-    bool matched = m_regExp.indexIn(encodedUrl) != -1;
-
-    if (matched
-        && !m_options.isEmpty()) {
-
-        // we only support domain right now
-        if (m_options.count() == 1) {
-            foreach (const QString &option, m_options) {
-                if (option.startsWith(QLatin1String("domain="))) {
-                    QUrl url = QUrl::fromEncoded(encodedUrl.toUtf8());
-                    QString host = url.host();
-                    QStringList domainOptions = option.mid(7).split(QLatin1Char('|'));
-                    foreach (QString domainOption, domainOptions) {
-                        bool negate = domainOption.at(0) == QLatin1Char('~');
-                        if (negate)
-                            domainOption = domainOption.mid(1);
-                        bool hostMatched = domainOption == host;
-                        if (hostMatched && !negate)
-                            return true;
-                        if (!hostMatched && negate)
-                            return true;
-                    }
-                }
-            }
-        }
+bool AdBlockRule::isCSSRule() const
+{
+    return d && d->isCSSRule(m_id);
+}
 
+bool AdBlockRule::networkMatch(const QString &encodedUrl) const
+{
+    if (!d) {
 #if defined(ADBLOCKRULE_DEBUG)
-        qDebug() << "AdBlockRule::" << __FUNCTION__ << "options are currently not supported" << m_options;
+        qDebug() << "AdBlockRule::" << __FUNCTION__ << "null rule";
 #endif
         return false;
     }
-#if defined(ADBLOCKRULE_DEBUG)
-    //qDebug() << "AdBlockRule::" << __FUNCTION__ << encodedUrl << "MATCHED" << matched << filter();
-#endif
+    return d->networkMatch(m_id, encodedUrl);
+}
 
-    return matched;
+bool AdBlockRule::networkMatch(const QString &encodedUrl, const AdBlockRequestContext &context) const
+{
+    return d && d->networkMatch(m_id, encodedUrl, context);
 }
 
 bool AdBlockRule::isException() const
 {
-    return m_exception;
+    return d && d->isException(m_id);
 }
 
 void AdBlockRule::setException(bool exception)
 {
-    m_exception = exception;
+    detach();
+    d->setException(m_id, exception);
 }
 
 bool AdBlockRule::isEnabled() const
 {
-    return m_enabled;
+    return d && d->isEnabled(m_id);
 }
 
 void AdBlockRule::setEnabled(bool enabled)
 {
-    m_enabled = enabled;
-    if (!enabled) {
-        m_filter = QLatin1String("!") + m_filter;
-    } else {
-        m_filter = m_filter.mid(1);
-    }
+    detach();
+    d->setEnabled(m_id, enabled);
 }
 
 QString AdBlockRule::regExpPattern() const
 {
-    return m_regExp.pattern();
+    return d ? d->regExpPattern(m_id) : QString();
+}
+
+AdBlockRule::MatchType AdBlockRule::matchType() const
+{
+    return d ? d->matchType(m_id) : StringContainsMatch;
+}
+
+QString AdBlockRule::token() const
+{
+    return d ? d->token(m_id) : QString();
 }
 
-static QString convertPatternToRegExp(const QString &wildcardPattern) {
-    QString pattern = wildcardPattern;
-    return pattern.replace(QRegExp(QLatin1String("\\*+")), QLatin1String("*"))   // remove multiple wildcards
-        .replace(QRegExp(QLatin1String("\\^\\|$")), QLatin1String("^"))        // remove anchors following separator placeholder
-        .replace(QRegExp(QLatin1String("^(\\*)")), QLatin1String(""))          // remove leading wildcards
-        .replace(QRegExp(QLatin1String("(\\*)$")), QLatin1String(""))          // remove trailing wildcards
-        .replace(QRegExp(QLatin1String("(\\W)")), QLatin1String("\\\\1"))      // escape special symbols
-        .replace(QRegExp(QLatin1String("^\\\\\\|\\\\\\|")),
-                 QLatin1String("^[\\w\\-]+:\\/+(?!\\/)(?:[^\\/]+\\.)?"))       // process extended anchor at expression start
-        .replace(QRegExp(QLatin1String("\\\\\\^")),
-                 QLatin1String("(?:[^\\w\\d\\-.%]|$)"))                        // process separator placeholders
-        .replace(QRegExp(QLatin1String("^\\\\\\|")), QLatin1String("^"))       // process anchor at expression start
-        .replace(QRegExp(QLatin1String("\\\\\\|$")), QLatin1String("$"))       // process anchor at expression end
-        .replace(QRegExp(QLatin1String("\\\\\\*")), QLatin1String(".*"))       // replace wildcards by .*
-        ;
+QString AdBlockRule::hostAnchor() const
+{
+    return d ? d->hostAnchor(m_id) : QString();
+}
+
+/*
+    The statistics of the rule in its store, a rule changed after it was
+    taken from a subscription starts over.
+ */
+int AdBlockRule::hits() const
+{
+    return d ? d->hits(m_id) : 0;
+}
+
+int AdBlockRule::sampledEvaluations() const
+{
+    return d ? d->sampledEvaluations(m_id) : 0;
+}
+
+// microseconds
+int AdBlockRule::sampledTime() const
+{
+    return d ? d->sampledTime(m_id) : 0;
 }
 
-void AdBlockRule::setPattern(const QString &pattern, bool isRegExp)
+void AdBlockRule::recordHit() const
 {
-    m_regExp = QRegExp(isRegExp ? pattern : convertPatternToRegExp(pattern),
-                           Qt::CaseInsensitive, QRegExp::RegExp2);
+    if (d)
+        d->recordHit(m_id);
 }
 
+// A rule is streamed as a store holding only that rule
+QDataStream &operator<<(QDataStream &stream, const AdBlockRule &rule)
+{
+    AdBlockRuleStore store;
+    store.append(rule);
+    stream << store;
+    return stream;
+}
+
+QDataStream &operator>>(QDataStream &stream, AdBlockRule &rule)
+{
+    AdBlockRuleStore *store = new AdBlockRuleStore;
+    stream >> *store;
+    if (stream.status() != QDataStream::Ok || store->count() != 1) {
+        delete store;
+        if (stream.status() == QDataStream::Ok)
+            stream.setStatus(QDataStream::ReadCorruptData);
+        return stream;
+    }
+    rule.d = store;
+    rule.m_id = store->id(0);
+    return stream;
+}
+
+AdBlockRequestContext::AdBlockRequestContext(const QUrl &url, const QUrl &pageUrl)
+{
+    init(url, pageUrl.host());
+}
+
+AdBlockRequestContext::AdBlockRequestContext(const QUrl &url)
+{
+    init(url, QString());
+}
+
+void AdBlockRequestContext::init(const QUrl &url, const QString &pageHost)
+{
+    QString host = url.host().toLower();
+    QString domain = pageHost.isEmpty() ? host : pageHost.toLower();
+    thirdParty = isThirdParty(host, domain);
+    type = resourceType(url);
+    while (!domain.isEmpty()) {
+        pageDomains.append(domain);
+        int dot = domain.indexOf(QLatin1Char('.'));
+        if (dot == -1)
+            break;
+        domain = domain.mid(dot + 1);
+    }
+}
+
+/*
+    QtWebKit does not tell us what a request is for, guess from the url.
+ */
+AdBlockRule::ResourceType AdBlockRequestContext::resourceType(const QUrl &url)
+{
+    QString path = url.path();
+    int dot = path.lastIndexOf(QLatin1Char('.'));
+    if (dot == -1 || dot < path.lastIndexOf(QLatin1Char('/')))
+        return AdBlockRule::OtherType;
+
+    QString extension = path.mid(dot + 1).toLower();
+    if (extension == QLatin1String("js"))
+        return AdBlockRule::ScriptType;
+    if (extension == QLatin1String("css"))
+        return AdBlockRule::StyleSheetType;
+    if (extension == QLatin1String("gif")
+        || extension == QLatin1String("jpg")
+        || extension == QLatin1String("jpeg")
+        || extension == QLatin1String("png")
+        || extension == QLatin1String("bmp")
+        || extension == QLatin1String("ico")
+        || extension == QLatin1String("svg"))
+        return AdBlockRule::ImageType;
+    if (extension == QLatin1String("swf"))
+        return AdBlockRule::ObjectType;
+    if (extension == QLatin1String("html")
+        || extension == QLatin1String("htm"))
+        return AdBlockRule::SubdocumentType;
+    return AdBlockRule::OtherType;
+}
+
+static bool isGenericSecondLevel(const QString &label)
+{
+    return label == QLatin1String("ac")
+        || label == QLatin1String("co")
+        || label == QLatin1String("com")
+        || label == QLatin1String("edu")
+        || label == QLatin1String("gov")
+        || label == QLatin1String("net")
+        || label == QLatin1String("org")
+        || label == QLatin1String("ne")
+        || label == QLatin1String("or");
+}
+
+/*
+    The registrable part of a host, approximated as the last two labels or
+    the last three when the host is under a country's generic second level
+    domain (example.co.uk).
+ */
+static QString siteOf(const QString &host)
+{
+    int last = host.lastIndexOf(QLatin1Char('.'));
+    if (last <= 0)
+        return host;
+    int secondLast = host.lastIndexOf(QLatin1Char('.'), last - 1);
+    if (secondLast == -1)
+        return host;
+    int topLevelLength = host.length() - last - 1;
+    QString secondLevel = host.mid(secondLast + 1, last - secondLast - 1);
+    if (topLevelLength == 2 && isGenericSecondLevel(secondLevel)) {
+        int thirdLast = secondLast > 0 ? host.lastIndexOf(QLatin1Char('.'), secondLast - 1) : -1;
+        return thirdLast == -1 ? host : host.mid(thirdLast + 1);
+    }
+    return host.mid(secondLast + 1);
+}
+
+bool AdBlockRequestContext::isThirdParty(const QString &host, const QString &pageHost)
+{
+    if (host.isEmpty() || pageHost.isEmpty())
+        return false;
+    if (host == pageHost)
+        return false;
+    return siteOf(host) != siteOf(pageHost);
+}
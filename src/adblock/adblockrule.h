@@ -29,21 +29,68 @@
 #ifndef ADBLOCKRULE_H
 #define ADBLOCKRULE_H
 
+#include <qshareddata.h>
 #include <qstringlist.h>
 
+/*
+    A handle to a rule in an AdBlockRuleStore.  Copies are cheap and share
+    the store, changing a rule first copies it into a store of its own.
+ */
+class QDataStream;
 class QUrl;
-class QRegExp;
+class AdBlockRequestContext;
+class AdBlockRuleStore;
 class AdBlockRule
 {
+    friend class AdBlockRuleStore;
+    friend QDataStream &operator>>(QDataStream &stream, AdBlockRule &rule);
 
 public:
+    /*
+        How a network filter is matched, decided once when the filter is
+        parsed.  Only real /regexp/ filters are handed to QRegExp, all of
+        the other classes are matched with plain string searches.
+     */
+    enum MatchType {
+        StringContainsMatch,    // ads/banner
+        StringStartsMatch,      // |http://ads.
+        StringEndsMatch,        // .swf|
+        StringEqualsMatch,      // |http://example.com/|
+        DomainMatch,            // ||example.com/banner.gif
+        SeparatorMatch,         // http://example.com^
+        WildcardMatch,          // /ads/*/banner^
+        RegExpMatch             // /banner\d+/
+    };
+
+    // The $type options, a rule without any applies to all of them
+    enum ResourceType {
+        OtherType = 0x001,
+        ScriptType = 0x002,
+        ImageType = 0x004,
+        StyleSheetType = 0x008,
+        ObjectType = 0x010,
+        ObjectSubrequestType = 0x020,
+        SubdocumentType = 0x040,
+        XmlHttpRequestType = 0x080,
+        XblType = 0x100,
+        PingType = 0x200,
+        DtdType = 0x400,
+        AllTypes = 0x7ff
+    };
+
     AdBlockRule(const QString &filter = QString());
+    AdBlockRule(const AdBlockRule &other);
+    ~AdBlockRule();
+    AdBlockRule &operator=(const AdBlockRule &other);
+
+    bool isNull() const;
 
     QString filter() const;
     void setFilter(const QString &filter);
 
-    bool isCSSRule() const { return m_cssRule; }
+    bool isCSSRule() const;
     bool networkMatch(const QString &encodedUrl) const;
+    bool networkMatch(const QString &encodedUrl, const AdBlockRequestContext &context) const;
 
     bool isException() const;
     void setException(bool exception);
@@ -52,17 +99,51 @@ public:
     void setEnabled(bool enabled);
 
     QString regExpPattern() const;
-    void setPattern(const QString &pattern, bool isRegExp);
+
+    MatchType matchType() const;
+    QString token() const;
+    QString hostAnchor() const;
+
+    int hits() const;
+    int sampledEvaluations() const;
+    int sampledTime() const;
+    void recordHit() const;
 
 private:
-    QString m_filter;
+    AdBlockRule(const AdBlockRuleStore *store, int id);
+    void detach();
 
-    bool m_cssRule;
-    bool m_exception;
-    bool m_enabled;
-    QRegExp m_regExp;
-    QStringList m_options;
+    QExplicitlySharedDataPointer<AdBlockRuleStore> d;
+    int m_id;
 };
 
+/*
+    What the options of a rule are checked against, worked out once per
+    request: the resource type guessed from the url, the domains of the
+    page that made the request and whether the request goes to another
+    site.  Without a page the request is taken to come from its own host.
+ */
+class AdBlockRequestContext
+{
+
+public:
+    AdBlockRequestContext(const QUrl &url, const QUrl &pageUrl);
+    explicit AdBlockRequestContext(const QUrl &url);
+
+    static AdBlockRule::ResourceType resourceType(const QUrl &url);
+    static bool isThirdParty(const QString &host, const QString &pageHost);
+
+    // the page's host followed by each of its parent domains
+    QStringList pageDomains;
+    AdBlockRule::ResourceType type;
+    bool thirdParty;
+
+private:
+    void init(const QUrl &url, const QString &pageHost);
+};
+
+QDataStream &operator<<(QDataStream &stream, const AdBlockRule &rule);
+QDataStream &operator>>(QDataStream &stream, AdBlockRule &rule);
+
 #endif // ADBLOCKRULE_H
 
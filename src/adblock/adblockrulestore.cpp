@@ -0,0 +1,1241 @@
+/**
+ * Copyright (c) 2009, Zsombor Gegesy <gzsombor@gmail.com>
+ * Copyright (c) 2009, Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Benjamin Meyer nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "adblockrulestore.h"
+
+#include "adblockindex.h"
+
+#include <qdatastream.h>
+#include <qdebug.h>
+#include <qregexp.h>
+#include <qurl.h>
+
+// #define ADBLOCKRULESTORE_DEBUG
+
+/*
+    Record::flags, the resource types a rule applies to are kept in the
+    upper bits.
+ */
+enum RecordFlag {
+    MatchTypeMask = 0x0007,
+    CaseSensitiveFlag = 0x0008,
+    AnchoredStartFlag = 0x0010,
+    AnchoredEndFlag = 0x0020,
+    CSSRuleFlag = 0x0040,
+    ExceptionFlag = 0x0080,
+    EnabledFlag = 0x0100,
+    OptionsFlag = 0x0200,
+    UnsupportedOptionsFlag = 0x0400,
+    ThirdPartyOnlyFlag = 0x0800,
+    FirstPartyOnlyFlag = 0x1000,
+    ResourceTypeShift = 16,
+    ResourceTypeMask = AdBlockRule::AllTypes << ResourceTypeShift
+};
+
+// Longer patterns do not fit a record, no list has any
+static const int MAXIMUM_PATTERN_LENGTH = 0xffff;
+
+// Rules per chunk, changing a rule of a shared store copies its chunk
+static const int CHUNK_SIZE = 256;
+static const int ORDER_CHUNK_SIZE = 1024;
+
+static inline int slot(int id)
+{
+    return id % CHUNK_SIZE;
+}
+
+AdBlockRuleStore::Chunk::Chunk()
+    : unused(0)
+{
+}
+
+AdBlockRuleStore::Chunk::Chunk(const Chunk &other)
+    : QSharedData(other)
+    , text(other.text)
+    , records(other.records)
+    , counters(other.counters)
+    , unused(other.unused)
+{
+    // Counters are written through a const store and must not detach then
+    counters.detach();
+    compiled.reserve(other.compiled.count());
+    foreach (const Compiled *entry, other.compiled)
+        compiled.append(entry ? copyCompiled(entry) : 0);
+}
+
+AdBlockRuleStore::Chunk::~Chunk()
+{
+    foreach (Compiled *entry, compiled)
+        deleteCompiled(entry);
+}
+
+AdBlockRuleStore::AdBlockRuleStore()
+    : m_count(0)
+{
+}
+
+AdBlockRuleStore::AdBlockRuleStore(const AdBlockRuleStore &other)
+    : QSharedData(other)
+    , m_chunks(other.m_chunks)
+    , m_order(other.m_order)
+    , m_orderStarts(other.m_orderStarts)
+    , m_freeIds(other.m_freeIds)
+    , m_count(other.m_count)
+{
+}
+
+AdBlockRuleStore::~AdBlockRuleStore()
+{
+}
+
+AdBlockRuleStore::Compiled *AdBlockRuleStore::copyCompiled(const Compiled *compiled)
+{
+    Compiled *copy = new Compiled(*compiled);
+    if (compiled->regExp)
+        copy->regExp = new QRegExp(*compiled->regExp);
+    return copy;
+}
+
+void AdBlockRuleStore::deleteCompiled(Compiled *compiled)
+{
+    if (!compiled)
+        return;
+    delete compiled->regExp;
+    delete compiled;
+}
+
+int AdBlockRuleStore::count() const
+{
+    return m_count;
+}
+
+void AdBlockRuleStore::reserve(int rules)
+{
+    m_chunks.reserve(rules / CHUNK_SIZE + 1);
+    m_order.reserve(rules / ORDER_CHUNK_SIZE + 1);
+    m_orderStarts.reserve(rules / ORDER_CHUNK_SIZE + 1);
+}
+
+void AdBlockRuleStore::clear()
+{
+    m_chunks.clear();
+    m_order.clear();
+    m_orderStarts.clear();
+    m_freeIds.clear();
+    m_count = 0;
+}
+
+static int appendText(QString *text, const QChar *data, int length)
+{
+    int offset = text->length();
+    text->resize(offset + length);
+    qMemCopy(text->data() + offset, data, length * sizeof(QChar));
+    return offset;
+}
+
+static inline int blockLength(int patternLength, int optionsLength)
+{
+    return patternLength + (optionsLength ? optionsLength + 1 : 0);
+}
+
+// Parsing points the pattern into the filter, setEnabled() moves the filter
+static inline bool isInFilter(int filter, int filterLength, int pattern, int block)
+{
+    return pattern >= filter && pattern + block <= filter + filterLength;
+}
+
+// The characters of the text that belong to the record
+static inline int usedLength(int filter, int filterLength, int pattern, int block)
+{
+    if (isInFilter(filter, filterLength, pattern, block))
+        return filterLength;
+    return filterLength + block;
+}
+
+/*
+    Copy the rules of the chunk into a new text without the filters that
+    were removed or replaced.
+ */
+void AdBlockRuleStore::Chunk::squeeze()
+{
+    QString squeezed;
+    squeezed.reserve(text.length() - unused);
+    const QChar *data = text.constData();
+    QVector<Compiled*> used;
+    for (int i = 0; i < records.count(); ++i) {
+        Record &record = records[i];
+        if (record.filterLength == -1)
+            continue;
+        int block = blockLength(record.patternLength, record.optionsLength);
+        bool inFilter = isInFilter(record.filter, record.filterLength, record.pattern, block);
+        int filter = appendText(&squeezed, data + record.filter, record.filterLength);
+        if (inFilter)
+            record.pattern = filter + (record.pattern - record.filter);
+        else
+            record.pattern = appendText(&squeezed, data + record.pattern, block);
+        record.filter = filter;
+        if (record.compiled != -1) {
+            used.append(compiled.at(record.compiled));
+            record.compiled = used.count() - 1;
+        }
+    }
+    text = squeezed;
+    compiled = used;
+    unused = 0;
+}
+
+/*
+    Copy the rules into new texts without the filters that were removed
+    or replaced.  The ids of the rules do not change.
+ */
+void AdBlockRuleStore::squeeze()
+{
+    for (int i = 0; i < m_chunks.count(); ++i) {
+        if (m_chunks.at(i)->unused == 0)
+            continue;
+        m_chunks[i].detach();
+        m_chunks[i]->squeeze();
+    }
+}
+
+inline const AdBlockRuleStore::Chunk *AdBlockRuleStore::chunk(int id) const
+{
+    return m_chunks.at(id / CHUNK_SIZE).constData();
+}
+
+inline const AdBlockRuleStore::Record &AdBlockRuleStore::record(int id) const
+{
+    return m_chunks.at(id / CHUNK_SIZE)->records.at(slot(id));
+}
+
+AdBlockRuleStore::Chunk *AdBlockRuleStore::detachedChunk(int id)
+{
+    QExplicitlySharedDataPointer<Chunk> &chunk = m_chunks[id / CHUNK_SIZE];
+    chunk.detach();
+    return chunk.data();
+}
+
+// The order chunk that holds the position
+int AdBlockRuleStore::orderChunk(int position) const
+{
+    return qUpperBound(m_orderStarts.constBegin(), m_orderStarts.constEnd(), position)
+        - m_orderStarts.constBegin() - 1;
+}
+
+int AdBlockRuleStore::id(int position) const
+{
+    int index = orderChunk(position);
+    return m_order.at(index)->ids.at(position - m_orderStarts.at(index));
+}
+
+void AdBlockRuleStore::appendOrder(int id)
+{
+    if (m_order.isEmpty() || m_order.last()->ids.count() == ORDER_CHUNK_SIZE) {
+        m_order.append(QExplicitlySharedDataPointer<OrderChunk>(new OrderChunk));
+        m_orderStarts.append(m_count);
+    }
+    QExplicitlySharedDataPointer<OrderChunk> &chunk = m_order.last();
+    chunk.detach();
+    chunk->ids.append(id);
+    ++m_count;
+}
+
+int AdBlockRuleStore::takeOrder(int position)
+{
+    int index = orderChunk(position);
+    QExplicitlySharedDataPointer<OrderChunk> &chunk = m_order[index];
+    chunk.detach();
+    int offset = position - m_orderStarts.at(index);
+    int id = chunk->ids.at(offset);
+    chunk->ids.remove(offset);
+    if (chunk->ids.isEmpty()) {
+        m_order.remove(index);
+        m_orderStarts.remove(index);
+    } else {
+        ++index;
+    }
+    for (; index < m_orderStarts.count(); ++index)
+        --m_orderStarts[index];
+    --m_count;
+    return id;
+}
+
+// Give the rule the id of a removed rule if there is one
+int AdBlockRuleStore::allocateId()
+{
+    if (!m_freeIds.isEmpty()) {
+        int id = m_freeIds.last();
+        m_freeIds.remove(m_freeIds.count() - 1);
+        detachedChunk(id)->counters[slot(id)] = Counters();
+        return id;
+    }
+    if (m_chunks.isEmpty() || m_chunks.last()->records.count() == CHUNK_SIZE)
+        m_chunks.append(QExplicitlySharedDataPointer<Chunk>(new Chunk));
+    int id = (m_chunks.count() - 1) * CHUNK_SIZE + m_chunks.last()->records.count();
+    Chunk *chunk = detachedChunk(id);
+    chunk->records.resize(chunk->records.count() + 1);
+    chunk->counters.resize(chunk->records.count());
+    return id;
+}
+
+AdBlockRuleStore::Record AdBlockRuleStore::parseRecord(Chunk *chunk, const QString &filter)
+{
+    Record record;
+    record.filter = appendText(&chunk->text, filter.constData(), filter.length());
+    record.filterLength = filter.length();
+    parse(chunk, filter, &record);
+    return record;
+}
+
+// Copy the characters of the record into the chunk, not its compiled part
+AdBlockRuleStore::Record AdBlockRuleStore::copyText(Chunk *chunk, const QChar *data, const Record &source)
+{
+    Record record = source;
+    record.filter = appendText(&chunk->text, data + source.filter, source.filterLength);
+    int block = blockLength(source.patternLength, source.optionsLength);
+    if (isInFilter(source.filter, source.filterLength, source.pattern, block))
+        record.pattern = record.filter + (source.pattern - source.filter);
+    else
+        record.pattern = appendText(&chunk->text, data + source.pattern, block);
+    record.compiled = -1;
+    return record;
+}
+
+AdBlockRuleStore::Record AdBlockRuleStore::copyRecord(Chunk *chunk, const AdBlockRuleStore &other, int id)
+{
+    const Chunk *source = other.chunk(id);
+    // Keeps the characters alive if the rule is in the same chunk
+    const QString text = source->text;
+    const Record sourceRecord = source->records.at(slot(id));
+    Record record = copyText(chunk, text.constData(), sourceRecord);
+    if (sourceRecord.compiled != -1) {
+        Compiled *compiled = copyCompiled(source->compiled.at(sourceRecord.compiled));
+        record.compiled = chunk->compiled.count();
+        chunk->compiled.append(compiled);
+    }
+    return record;
+}
+
+int AdBlockRuleStore::append(const QString &filter)
+{
+    int id = allocateId();
+    Chunk *chunk = detachedChunk(id);
+    chunk->records[slot(id)] = parseRecord(chunk, filter);
+    appendOrder(id);
+    return id;
+}
+
+int AdBlockRuleStore::append(const AdBlockRule &rule)
+{
+    if (!rule.d)
+        return append(QString());
+    int id = allocateId();
+    Chunk *chunk = detachedChunk(id);
+    chunk->records[slot(id)] = copyRecord(chunk, *rule.d, rule.m_id);
+    appendOrder(id);
+    return id;
+}
+
+// The rule keeps its id
+void AdBlockRuleStore::replace(int position, const AdBlockRule &rule)
+{
+    int id = this->id(position);
+    Chunk *chunk = detachedChunk(id);
+    Record old = chunk->records.at(slot(id));
+    Record record = rule.d ? copyRecord(chunk, *rule.d, rule.m_id) : parseRecord(chunk, QString());
+    chunk->records[slot(id)] = record;
+    chunk->counters[slot(id)] = Counters();
+    releaseRecord(chunk, old);
+}
+
+void AdBlockRuleStore::remove(int position)
+{
+    int id = takeOrder(position);
+    Chunk *chunk = detachedChunk(id);
+    Record old = chunk->records.at(slot(id));
+    chunk->records[slot(id)].filterLength = -1;
+    m_freeIds.append(id);
+    releaseRecord(chunk, old);
+}
+
+void AdBlockRuleStore::releaseRecord(Chunk *chunk, const Record &record)
+{
+    chunk->unused += usedLength(record.filter, record.filterLength, record.pattern,
+                                blockLength(record.patternLength, record.optionsLength));
+    if (record.compiled != -1) {
+        deleteCompiled(chunk->compiled.at(record.compiled));
+        chunk->compiled[record.compiled] = 0;
+    }
+    if (chunk->unused > 1024 && chunk->unused > chunk->text.length() / 2)
+        chunk->squeeze();
+}
+
+AdBlockRule AdBlockRuleStore::rule(int id) const
+{
+    return AdBlockRule(this, id);
+}
+
+QString AdBlockRuleStore::filter(int id) const
+{
+    const Record &record = this->record(id);
+    return chunk(id)->text.mid(record.filter, record.filterLength);
+}
+
+bool AdBlockRuleStore::isCSSRule(int id) const
+{
+    return record(id).flags & CSSRuleFlag;
+}
+
+bool AdBlockRuleStore::isException(int id) const
+{
+    return record(id).flags & ExceptionFlag;
+}
+
+void AdBlockRuleStore::setException(int id, bool exception)
+{
+    Record &record = detachedChunk(id)->records[slot(id)];
+    if (exception)
+        record.flags |= ExceptionFlag;
+    else
+        record.flags &= ~ExceptionFlag;
+}
+
+bool AdBlockRuleStore::isEnabled(int id) const
+{
+    return record(id).flags & EnabledFlag;
+}
+
+/*
+    Disabling a rule comments out its filter, the parsed pattern is kept
+    and still refers to the old text.
+ */
+void AdBlockRuleStore::setEnabled(int id, bool enabled)
+{
+    QString text = filter(id);
+    text = enabled ? text.mid(1) : QLatin1String("!") + text;
+
+    Chunk *chunk = detachedChunk(id);
+    Record &record = chunk->records[slot(id)];
+    int block = blockLength(record.patternLength, record.optionsLength);
+    // Only the pattern is still used of the old text
+    chunk->unused += usedLength(record.filter, record.filterLength, record.pattern, block) - block;
+    record.filter = appendText(&chunk->text, text.constData(), text.length());
+    record.filterLength = text.length();
+    if (enabled)
+        record.flags |= EnabledFlag;
+    else
+        record.flags &= ~EnabledFlag;
+}
+
+AdBlockRule::MatchType AdBlockRuleStore::matchType(int id) const
+{
+    return AdBlockRule::MatchType(record(id).flags & MatchTypeMask);
+}
+
+// Only used to describe a rule, matching does not go through QRegExp
+static QString convertPatternToRegExp(const QString &wildcardPattern) {
+    QString pattern = wildcardPattern;
+    return pattern.replace(QRegExp(QLatin1String("\\*+")), QLatin1String("*"))   // remove multiple wildcards
+        .replace(QRegExp(QLatin1String("\\^\\|$")), QLatin1String("^"))        // remove anchors following separator placeholder
+        .replace(QRegExp(QLatin1String("^(\\*)")), QLatin1String(""))          // remove leading wildcards
+        .replace(QRegExp(QLatin1String("(\\*)$")), QLatin1String(""))          // remove trailing wildcards
+        .replace(QRegExp(QLatin1String("(\\W)")), QLatin1String("\\\\1"))      // escape special symbols
+        .replace(QRegExp(QLatin1String("^\\\\\\|\\\\\\|")),
+                 QLatin1String("^[\\w\\-]+:\\/+(?!\\/)(?:[^\\/]+\\.)?"))       // process extended anchor at expression start
+        .replace(QRegExp(QLatin1String("\\\\\\^")),
+                 QLatin1String("(?:[^\\w\\d\\-.%]|$)"))                        // process separator placeholders
+        .replace(QRegExp(QLatin1String("^\\\\\\|")), QLatin1String("^"))       // process anchor at expression start
+        .replace(QRegExp(QLatin1String("\\\\\\|$")), QLatin1String("$"))       // process anchor at expression end
+        .replace(QRegExp(QLatin1String("\\\\\\*")), QLatin1String(".*"))       // replace wildcards by .*
+        ;
+}
+
+QString AdBlockRuleStore::regExpPattern(int id) const
+{
+    const Record &record = this->record(id);
+    QString pattern(chunk(id)->text.constData() + record.pattern, record.patternLength);
+    if ((record.flags & MatchTypeMask) == AdBlockRule::RegExpMatch)
+        return pattern;
+    return convertPatternToRegExp(pattern);
+}
+
+QString AdBlockRuleStore::token(int id) const
+{
+    const Record &record = this->record(id);
+    if (record.tokenLength == 0)
+        return QString();
+    return QString(chunk(id)->text.constData() + record.pattern + record.token, record.tokenLength).toLower();
+}
+
+/*
+    The host of a plain ||example.com^ filter, which matches that host and
+    all of its subdomains and nothing else, or an empty string for any
+    other kind of filter.
+ */
+QString AdBlockRuleStore::hostAnchor(int id) const
+{
+    const Record &record = this->record(id);
+    if ((record.flags & MatchTypeMask) != AdBlockRule::DomainMatch
+        || (record.flags & (AnchoredEndFlag | CSSRuleFlag | CaseSensitiveFlag | OptionsFlag)))
+        return QString();
+
+    const QChar *data = chunk(id)->text.constData() + record.pattern + record.match;
+    int length = record.matchLength - 1;
+    if (length <= 0 || data[length] != QLatin1Char('^'))
+        return QString();
+    if (data[0] == QLatin1Char('.') || data[length - 1] == QLatin1Char('.'))
+        return QString();
+    for (int i = 0; i < length; ++i) {
+        ushort c = data[i].unicode();
+        if (c == '%'
+            || (!AdBlockIndex::isTokenCharacter(c) && c != '-' && c != '.' && c != '_'))
+            return QString();
+    }
+    return QString(data, length).toLower();
+}
+
+static bool isCommonToken(const QString &token)
+{
+    // Found in nearly every url, a bucket for them would be checked always
+    return token == QLatin1String("http")
+        || token == QLatin1String("https")
+        || token == QLatin1String("www")
+        || token == QLatin1String("com");
+}
+
+/*
+    Find the longest run of token characters in the pattern that must
+    appear in a matching url as a complete token, that is a run that is
+    not next to a wildcard and not at an unanchored start or end.
+ */
+static bool findToken(const QChar *data, int length, int *tokenStart, int *tokenLength)
+{
+    int begin = 0;
+    int end = length;
+    bool anchoredStart = false;
+    bool anchoredEnd = false;
+    if (end >= 2 && data[0] == QLatin1Char('|') && data[1] == QLatin1Char('|')) {
+        begin = 2;
+        anchoredStart = true;
+    } else if (end >= 1 && data[0] == QLatin1Char('|')) {
+        begin = 1;
+        anchoredStart = true;
+    }
+    if (end > begin && data[end - 1] == QLatin1Char('|')) {
+        --end;
+        anchoredEnd = true;
+    }
+
+    int bestStart = -1;
+    int bestLength = 0;
+    bool bestIsCommon = false;
+    int start = -1;
+    for (int i = begin; i <= end; ++i) {
+        if (i < end && AdBlockIndex::isTokenCharacter(data[i].unicode())) {
+            if (start == -1)
+                start = i;
+            continue;
+        }
+        if (start == -1)
+            continue;
+        int runLength = i - start;
+        bool leftBounded = (start == begin) ? anchoredStart : data[start - 1] != QLatin1Char('*');
+        bool rightBounded = (i == end) ? anchoredEnd : data[i] != QLatin1Char('*');
+        if (leftBounded && rightBounded && runLength >= 2) {
+            bool common = isCommonToken(QString(data + start, runLength).toLower());
+            if (bestStart == -1
+                || (bestIsCommon && !common)
+                || (bestIsCommon == common && runLength > bestLength)) {
+                bestStart = start;
+                bestLength = runLength;
+                bestIsCommon = common;
+            }
+        }
+        start = -1;
+    }
+
+    if (bestStart == -1 || bestIsCommon)
+        return false;
+    *tokenStart = bestStart;
+    *tokenLength = bestLength;
+    return true;
+}
+
+static inline bool containsCharacter(const QChar *data, int length, char c)
+{
+    for (int i = 0; i < length; ++i) {
+        if (data[i] == QLatin1Char(c))
+            return true;
+    }
+    return false;
+}
+
+void AdBlockRuleStore::parse(Chunk *chunk, const QString &filter, Record *record)
+{
+    quint32 flags = EnabledFlag | (AdBlockRule::AllTypes << ResourceTypeShift);
+    record->pattern = record->filter;
+    record->patternLength = 0;
+    record->optionsLength = 0;
+    record->match = 0;
+    record->matchLength = 0;
+    record->token = 0;
+    record->tokenLength = 0;
+    record->compiled = -1;
+
+    if (filter.startsWith(QLatin1Char('!'))
+        || filter.trimmed().isEmpty())
+        flags &= ~EnabledFlag;
+
+    if (filter.contains(QLatin1String("##")))
+        flags |= CSSRuleFlag;
+
+    int start = 0;
+    int end = filter.length();
+    if (filter.startsWith(QLatin1String("@@"))) {
+        flags |= ExceptionFlag;
+        start = 2;
+    }
+    bool regExpRule = false;
+    if (start < end
+        && filter.at(start) == QLatin1Char('/')
+        && filter.at(end - 1) == QLatin1Char('/')) {
+        ++start;
+        end = qMax(start, end - 1);
+        regExpRule = true;
+    }
+
+    QStringList options;
+    int optionsStart = filter.indexOf(QLatin1Char('$'), start);
+    int optionsLength = 0;
+    if (optionsStart != -1 && optionsStart < end) {
+        optionsLength = end - optionsStart - 1;
+        options = filter.mid(optionsStart + 1, optionsLength).split(QLatin1Char(','));
+        end = optionsStart;
+    }
+    if (options.contains(QLatin1String("match-case"))) {
+        flags |= CaseSensitiveFlag;
+        options.removeOne(QLatin1String("match-case"));
+    }
+    if (!options.isEmpty())
+        flags |= OptionsFlag;
+
+    if (end - start > MAXIMUM_PATTERN_LENGTH || optionsLength > MAXIMUM_PATTERN_LENGTH) {
+        record->flags = flags | OptionsFlag | UnsupportedOptionsFlag;
+        return;
+    }
+    record->pattern = record->filter + start;
+    record->patternLength = end - start;
+    record->optionsLength = optionsLength;
+
+    const QChar *pattern = filter.constData() + start;
+    const int length = end - start;
+    Qt::CaseSensitivity caseSensitivity = (flags & CaseSensitiveFlag) ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    Compiled compiled;
+    compiled.regExp = 0;
+
+    if (regExpRule) {
+        flags |= AdBlockRule::RegExpMatch;
+        compiled.regExp = new QRegExp(QString(pattern, length), caseSensitivity, QRegExp::RegExp2);
+    } else {
+        int tokenStart;
+        int tokenLength;
+        if (findToken(pattern, length, &tokenStart, &tokenLength)) {
+            record->token = tokenStart;
+            record->tokenLength = tokenLength;
+        }
+
+        // The same normalization that convertPatternToRegExp() does
+        int matchStart = 0;
+        int matchEnd = length;
+        if (matchEnd - matchStart >= 2
+            && pattern[matchEnd - 1] == QLatin1Char('|')
+            && pattern[matchEnd - 2] == QLatin1Char('^'))
+            --matchEnd;
+        while (matchStart < matchEnd && pattern[matchStart] == QLatin1Char('*'))
+            ++matchStart;
+        while (matchEnd > matchStart && pattern[matchEnd - 1] == QLatin1Char('*'))
+            --matchEnd;
+
+        bool domainAnchor = false;
+        bool anchoredStart = false;
+        bool anchoredEnd = false;
+        if (matchEnd - matchStart >= 2
+            && pattern[matchStart] == QLatin1Char('|')
+            && pattern[matchStart + 1] == QLatin1Char('|')) {
+            domainAnchor = true;
+            matchStart += 2;
+        } else if (matchStart < matchEnd && pattern[matchStart] == QLatin1Char('|')) {
+            anchoredStart = true;
+            ++matchStart;
+        }
+        if (matchEnd > matchStart && pattern[matchEnd - 1] == QLatin1Char('|')) {
+            anchoredEnd = true;
+            --matchEnd;
+        }
+        record->match = matchStart;
+        record->matchLength = matchEnd - matchStart;
+        if (anchoredStart)
+            flags |= AnchoredStartFlag;
+        if (anchoredEnd)
+            flags |= AnchoredEndFlag;
+
+        const QChar *match = pattern + matchStart;
+        const int matchLength = matchEnd - matchStart;
+        if (domainAnchor)
+            flags |= AdBlockRule::DomainMatch;
+        else if (containsCharacter(match, matchLength, '*'))
+            flags |= AdBlockRule::WildcardMatch;
+        else if (containsCharacter(match, matchLength, '^'))
+            flags |= AdBlockRule::SeparatorMatch;
+        else if (anchoredStart && anchoredEnd)
+            flags |= AdBlockRule::StringEqualsMatch;
+        else if (anchoredStart)
+            flags |= AdBlockRule::StringStartsMatch;
+        else if (anchoredEnd)
+            flags |= AdBlockRule::StringEndsMatch;
+        else
+            flags |= AdBlockRule::StringContainsMatch;
+    }
+
+    record->flags = flags;
+    if (!options.isEmpty())
+        parseOptions(options, record, &compiled);
+
+    if (compiled.regExp
+        || !compiled.includedDomains.isEmpty()
+        || !compiled.excludedDomains.isEmpty()) {
+        record->compiled = chunk->compiled.count();
+        chunk->compiled.append(new Compiled(compiled));
+    }
+}
+
+/*
+    Rebuild the compiled part of a record that was read from a stream.
+ */
+void AdBlockRuleStore::compile(Chunk *chunk, Record *record)
+{
+    const QChar *pattern = chunk->text.constData() + record->pattern;
+    Compiled *compiled = new Compiled;
+    compiled->regExp = 0;
+    if ((record->flags & MatchTypeMask) == AdBlockRule::RegExpMatch) {
+        Qt::CaseSensitivity caseSensitivity = (record->flags & CaseSensitiveFlag) ? Qt::CaseSensitive : Qt::CaseInsensitive;
+        compiled->regExp = new QRegExp(QString(pattern, record->patternLength), caseSensitivity, QRegExp::RegExp2);
+    }
+    if (record->optionsLength) {
+        QString options(pattern + record->patternLength + 1, record->optionsLength);
+        parseOptions(options.split(QLatin1Char(',')), record, compiled);
+    }
+    record->compiled = chunk->compiled.count();
+    chunk->compiled.append(compiled);
+}
+
+static const struct {
+    const char *name;
+    AdBlockRule::ResourceType type;
+} resourceTypeNames[] = {
+    { "other", AdBlockRule::OtherType },
+    { "script", AdBlockRule::ScriptType },
+    { "image", AdBlockRule::ImageType },
+    { "background", AdBlockRule::ImageType },
+    { "stylesheet", AdBlockRule::StyleSheetType },
+    { "object", AdBlockRule::ObjectType },
+    { "object-subrequest", AdBlockRule::ObjectSubrequestType },
+    { "subdocument", AdBlockRule::SubdocumentType },
+    { "xmlhttprequest", AdBlockRule::XmlHttpRequestType },
+    { "xbl", AdBlockRule::XblType },
+    { "ping", AdBlockRule::PingType },
+    { "dtd", AdBlockRule::DtdType },
+    { 0, AdBlockRule::OtherType }
+};
+
+static int resourceTypeFromName(const QString &name)
+{
+    for (int i = 0; resourceTypeNames[i].name; ++i) {
+        if (name == QLatin1String(resourceTypeNames[i].name))
+            return resourceTypeNames[i].type;
+    }
+    return 0;
+}
+
+/*
+    Compile the options once so matching only has to test bits and look up
+    the page's domains.  A rule with an option we do not understand (like
+    collapse, or document which whitelists whole pages) never matches
+    rather than matching more than it should.
+ */
+void AdBlockRuleStore::parseOptions(const QStringList &options, Record *record, Compiled *compiled)
+{
+    quint32 flags = record->flags & ~(UnsupportedOptionsFlag | ThirdPartyOnlyFlag
+                                      | FirstPartyOnlyFlag | ResourceTypeMask);
+    compiled->includedDomains.clear();
+    compiled->excludedDomains.clear();
+
+    int includedTypes = 0;
+    int excludedTypes = 0;
+    foreach (const QString &rawOption, options) {
+        QString option = rawOption.trimmed().toLower();
+        bool negate = option.startsWith(QLatin1Char('~'));
+        if (negate)
+            option = option.mid(1);
+
+        if (option.startsWith(QLatin1String("domain="))) {
+            QStringList domains = option.mid(7).split(QLatin1Char('|'), QString::SkipEmptyParts);
+            foreach (const QString &domain, domains) {
+                if (domain.startsWith(QLatin1Char('~')))
+                    compiled->excludedDomains.insert(domain.mid(1));
+                else
+                    compiled->includedDomains.insert(domain);
+            }
+            if (negate)
+                flags |= UnsupportedOptionsFlag;
+            continue;
+        }
+
+        if (option == QLatin1String("third-party")) {
+            flags |= negate ? FirstPartyOnlyFlag : ThirdPartyOnlyFlag;
+            continue;
+        }
+
+        if (option == QLatin1String("match-case"))
+            continue;
+
+        // Older lists spell object-subrequest with an underscore
+        int type = resourceTypeFromName(option.replace(QLatin1Char('_'), QLatin1Char('-')));
+        if (type) {
+            if (negate)
+                excludedTypes |= type;
+            else
+                includedTypes |= type;
+            continue;
+        }
+
+        // Not restricting a page level option is the same as leaving it out
+        if (negate
+            && (option == QLatin1String("document")
+                || option == QLatin1String("elemhide")))
+            continue;
+
+#if defined(ADBLOCKRULESTORE_DEBUG)
+        qDebug() << "AdBlockRuleStore::" << __FUNCTION__ << "unsupported option" << option;
+#endif
+        flags |= UnsupportedOptionsFlag;
+    }
+
+    int resourceTypes = includedTypes ? includedTypes : int(AdBlockRule::AllTypes);
+    resourceTypes &= ~excludedTypes;
+    record->flags = flags | (quint32(resourceTypes) << ResourceTypeShift);
+}
+
+bool AdBlockRuleStore::optionsMatch(const Chunk *chunk, const Record &record, const AdBlockRequestContext &context) const
+{
+    quint32 flags = record.flags;
+    if (flags & UnsupportedOptionsFlag)
+        return false;
+    if (!((flags >> ResourceTypeShift) & context.type))
+        return false;
+    if ((flags & ThirdPartyOnlyFlag) && !context.thirdParty)
+        return false;
+    if ((flags & FirstPartyOnlyFlag) && context.thirdParty)
+        return false;
+
+    if (record.compiled == -1)
+        return true;
+    const Compiled *compiled = chunk->compiled.at(record.compiled);
+    if (compiled->includedDomains.isEmpty() && compiled->excludedDomains.isEmpty())
+        return true;
+    // The most specific domain listed decides
+    foreach (const QString &domain, context.pageDomains) {
+        if (compiled->excludedDomains.contains(domain))
+            return false;
+        if (compiled->includedDomains.contains(domain))
+            return true;
+    }
+    return compiled->includedDomains.isEmpty();
+}
+
+bool AdBlockRuleStore::networkMatch(int id, const QString &encodedUrl) const
+{
+    const Chunk *chunk = this->chunk(id);
+    const Record &record = chunk->records.at(slot(id));
+    if (record.flags & CSSRuleFlag) {
+#if defined(ADBLOCKRULESTORE_DEBUG)
+        qDebug() << "AdBlockRuleStore::" << __FUNCTION__ << "css rule" << filter(id);
+#endif
+        return false;
+    }
+
+    if (!(record.flags & EnabledFlag)) {
+#if defined(ADBLOCKRULESTORE_DEBUG)
+        qDebug() << "AdBlockRuleStore::" << __FUNCTION__ << "is not enabled" << filter(id);
+#endif
+        return false;
+    }
+
+    if (!patternMatch(chunk, record, encodedUrl))
+        return false;
+    if (!(record.flags & OptionsFlag))
+        return true;
+
+    // Only rules with options need to know more about the request
+    AdBlockRequestContext context(QUrl::fromEncoded(encodedUrl.toUtf8()));
+    return optionsMatch(chunk, record, context);
+}
+
+bool AdBlockRuleStore::networkMatch(int id, const QString &encodedUrl, const AdBlockRequestContext &context) const
+{
+    const Chunk *chunk = this->chunk(id);
+    const Record &record = chunk->records.at(slot(id));
+    if ((record.flags & CSSRuleFlag) || !(record.flags & EnabledFlag))
+        return false;
+
+    if ((record.flags & OptionsFlag) && !optionsMatch(chunk, record, context))
+        return false;
+
+    return patternMatch(chunk, record, encodedUrl);
+}
+
+int AdBlockRuleStore::hits(int id) const
+{
+    return chunk(id)->counters.at(slot(id)).hits;
+}
+
+int AdBlockRuleStore::sampledEvaluations(int id) const
+{
+    return chunk(id)->counters.at(slot(id)).samples;
+}
+
+int AdBlockRuleStore::sampledTime(int id) const
+{
+    return chunk(id)->counters.at(slot(id)).time;
+}
+
+void AdBlockRuleStore::recordHit(int id) const
+{
+    chunk(id)->counters[slot(id)].hits.ref();
+}
+
+void AdBlockRuleStore::recordEvaluation(int id, int microseconds) const
+{
+    Counters &counters = chunk(id)->counters[slot(id)];
+    // Stop before the total can overflow, the average is all that is used
+    if (counters.time > 0x3fffffff)
+        return;
+    counters.samples.ref();
+    counters.time.fetchAndAddRelaxed(microseconds);
+}
+
+void AdBlockRuleStore::resetStatistics() const
+{
+    foreach (const QExplicitlySharedDataPointer<Chunk> &chunk, m_chunks) {
+        for (int i = 0; i < chunk->counters.count(); ++i)
+            chunk->counters[i] = Counters();
+    }
+}
+
+// The characters the ^ placeholder does not match: [\w\d\-.%]
+static inline bool isSeparator(const QChar &c)
+{
+    ushort u = c.unicode();
+    if (u < 0x80)
+        return !((u >= 'a' && u <= 'z')
+                 || (u >= 'A' && u <= 'Z')
+                 || (u >= '0' && u <= '9')
+                 || u == '_' || u == '-' || u == '.' || u == '%');
+    return !(c.isLetterOrNumber() || c.isMark());
+}
+
+static inline bool equalCharacters(const QChar &a, const QChar &b, Qt::CaseSensitivity cs)
+{
+    if (a == b)
+        return true;
+    if (cs == Qt::CaseSensitive)
+        return false;
+    ushort ua = a.unicode();
+    ushort ub = b.unicode();
+    if (ua < 0x80 && ub < 0x80) {
+        if (ua >= 'A' && ua <= 'Z')
+            ua += 'a' - 'A';
+        if (ub >= 'A' && ub <= 'Z')
+            ub += 'a' - 'A';
+        return ua == ub;
+    }
+    return a.toLower() == b.toLower();
+}
+
+/*
+    Match a part of a pattern that contains no wildcard at position in the
+    url, returning where the match ends or -1.  A ^ matches a separator
+    character or the end of the url.
+ */
+static int matchPartAt(const QString &url, int position, const QChar *part, int partLength, Qt::CaseSensitivity cs)
+{
+    const QChar *data = url.constData();
+    const int urlLength = url.length();
+    int u = position;
+    for (int i = 0; i < partLength; ++i) {
+        if (part[i] == QLatin1Char('^')) {
+            if (u == urlLength)
+                continue;
+            if (!isSeparator(data[u]))
+                return -1;
+            ++u;
+            continue;
+        }
+        if (u == urlLength || !equalCharacters(data[u], part[i], cs))
+            return -1;
+        ++u;
+    }
+    return u;
+}
+
+// Find the first position at or after from where the part matches
+static int findPart(const QString &url, int from, const QChar *part, int partLength, Qt::CaseSensitivity cs, int *matchEnd)
+{
+    const int urlLength = url.length();
+    for (int position = from; position <= urlLength; ++position) {
+        if (partLength > 0 && part[0] != QLatin1Char('^')) {
+            position = url.indexOf(part[0], position, cs);
+            if (position == -1)
+                return -1;
+        }
+        int end = matchPartAt(url, position, part, partLength, cs);
+        if (end != -1) {
+            *matchEnd = end;
+            return position;
+        }
+    }
+    return -1;
+}
+
+/*
+    Match a pattern made of parts separated by * wildcards, starting at
+    position.  The leftmost match of every part is good enough except for
+    the last part of an end anchored pattern, which has to end the url.
+ */
+static bool matchWildcards(const QString &url, int position, const QChar *pattern, int patternLength,
+                           bool anchoredStart, bool anchoredEnd, Qt::CaseSensitivity cs)
+{
+    const int urlLength = url.length();
+    int partStart = 0;
+    bool first = true;
+    forever {
+        int partEnd = partStart;
+        while (partEnd < patternLength && pattern[partEnd] != QLatin1Char('*'))
+            ++partEnd;
+        bool last = (partEnd == patternLength);
+        const QChar *part = pattern + partStart;
+        int partLength = partEnd - partStart;
+
+        int end = -1;
+        if (first && anchoredStart) {
+            end = matchPartAt(url, position, part, partLength, cs);
+            if (end == -1)
+                return false;
+            if (last && anchoredEnd)
+                return end == urlLength;
+        } else if (last && anchoredEnd) {
+            int from = position;
+            forever {
+                from = findPart(url, from, part, partLength, cs, &end);
+                if (from == -1)
+                    return false;
+                if (end == urlLength)
+                    return true;
+                ++from;
+            }
+        } else {
+            if (findPart(url, position, part, partLength, cs, &end) == -1)
+                return false;
+        }
+
+        if (last)
+            return true;
+        position = end;
+        partStart = partEnd + 1;
+        first = false;
+    }
+    return false;
+}
+
+/*
+    || matches the beginning of the host or of any of its subdomains, the
+    same positions as ^[\w\-]+:\/+(?!\/)(?:[^\/]+\.)? did.
+ */
+static bool matchDomain(const QString &url, const QChar *pattern, int patternLength,
+                        bool anchoredEnd, Qt::CaseSensitivity cs)
+{
+    const QChar *data = url.constData();
+    const int urlLength = url.length();
+
+    int hostStart = 0;
+    while (hostStart < urlLength
+           && (data[hostStart].isLetterOrNumber()
+               || data[hostStart] == QLatin1Char('_')
+               || data[hostStart] == QLatin1Char('-')))
+        ++hostStart;
+    if (hostStart == 0
+        || hostStart + 1 >= urlLength
+        || data[hostStart] != QLatin1Char(':')
+        || data[hostStart + 1] != QLatin1Char('/'))
+        return false;
+    ++hostStart;
+    while (hostStart < urlLength && data[hostStart] == QLatin1Char('/'))
+        ++hostStart;
+
+    if (matchWildcards(url, hostStart, pattern, patternLength, true, anchoredEnd, cs))
+        return true;
+    for (int i = hostStart + 1; i < urlLength && data[i] != QLatin1Char('/'); ++i) {
+        if (data[i] == QLatin1Char('.')
+            && matchWildcards(url, i + 1, pattern, patternLength, true, anchoredEnd, cs))
+            return true;
+    }
+    return false;
+}
+
+/*
+    Every match type but regular expressions is a plain scan of the url,
+    a pattern without wildcards or ^ is a single part of matchWildcards().
+ */
+bool AdBlockRuleStore::patternMatch(const Chunk *chunk, const Record &record, const QString &encodedUrl) const
+{
+    const QChar *match = chunk->text.constData() + record.pattern + record.match;
+    const int length = record.matchLength;
+    const int urlLength = encodedUrl.length();
+    Qt::CaseSensitivity cs = (record.flags & CaseSensitiveFlag) ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    bool anchoredStart = record.flags & AnchoredStartFlag;
+    bool anchoredEnd = record.flags & AnchoredEndFlag;
+    int end;
+
+    switch (record.flags & MatchTypeMask) {
+    case AdBlockRule::StringContainsMatch:
+        return findPart(encodedUrl, 0, match, length, cs, &end) != -1;
+    case AdBlockRule::StringStartsMatch:
+        return matchPartAt(encodedUrl, 0, match, length, cs) != -1;
+    case AdBlockRule::StringEndsMatch:
+        return urlLength >= length
+            && matchPartAt(encodedUrl, urlLength - length, match, length, cs) != -1;
+    case AdBlockRule::StringEqualsMatch:
+        return urlLength == length
+            && matchPartAt(encodedUrl, 0, match, length, cs) != -1;
+    case AdBlockRule::DomainMatch:
+        return matchDomain(encodedUrl, match, length, anchoredEnd, cs);
+    case AdBlockRule::SeparatorMatch:
+    case AdBlockRule::WildcardMatch:
+        return matchWildcards(encodedUrl, 0, match, length, anchoredStart, anchoredEnd, cs);
+    case AdBlockRule::RegExpMatch:
+        return record.compiled != -1
+            && chunk->compiled.at(record.compiled)->regExp->indexIn(encodedUrl) != -1;
+    }
+    return false;
+}
+
+/*
+    The texts of the chunks are written as one text followed by the records
+    so loading a store does not parse any filter again, only the compiled
+    parts are rebuilt.  The records are written in list order, a loaded
+    store numbers the rules from zero again.
+ */
+QDataStream &operator<<(QDataStream &stream, const AdBlockRuleStore &store)
+{
+    QString text;
+    QVector<int> offsets;
+    foreach (const QExplicitlySharedDataPointer<AdBlockRuleStore::Chunk> &chunk, store.m_chunks) {
+        offsets.append(text.length());
+        text += chunk->text;
+    }
+    stream << text;
+    stream << quint32(store.count());
+    for (int i = 0; i < store.count(); ++i) {
+        int id = store.id(i);
+        const AdBlockRuleStore::Record &record = store.record(id);
+        int offset = offsets.at(id / CHUNK_SIZE);
+        stream << qint32(record.filter + offset) << qint32(record.filterLength);
+        stream << qint32(record.pattern + offset) << record.patternLength << record.optionsLength;
+        stream << record.match << record.matchLength;
+        stream << record.token << record.tokenLength;
+        stream << record.flags;
+        stream << quint8(record.compiled != -1);
+    }
+    return stream;
+}
+
+QDataStream &operator>>(QDataStream &stream, AdBlockRuleStore &store)
+{
+    store.clear();
+
+    QString text;
+    quint32 count;
+    stream >> text >> count;
+    if (stream.status() != QDataStream::Ok)
+        return stream;
+
+    const int textLength = text.length();
+    QVector<AdBlockRuleStore::Record> records;
+    for (quint32 i = 0; i < count; ++i) {
+        AdBlockRuleStore::Record record;
+        qint32 filter;
+        qint32 filterLength;
+        qint32 pattern;
+        quint8 compiled;
+        stream >> filter >> filterLength;
+        stream >> pattern >> record.patternLength >> record.optionsLength;
+        stream >> record.match >> record.matchLength;
+        stream >> record.token >> record.tokenLength;
+        stream >> record.flags;
+        stream >> compiled;
+        if (stream.status() != QDataStream::Ok)
+            return stream;
+
+        int block = blockLength(record.patternLength, record.optionsLength);
+        if (filter < 0 || filterLength < 0 || filterLength > textLength - filter
+            || pattern < 0 || block > textLength - pattern
+            || record.match + record.matchLength > record.patternLength
+            || record.token + record.tokenLength > record.patternLength
+            || (record.flags & MatchTypeMask) > AdBlockRule::RegExpMatch) {
+            stream.setStatus(QDataStream::ReadCorruptData);
+            return stream;
+        }
+        record.filter = filter;
+        record.filterLength = filterLength;
+        record.pattern = pattern;
+        record.compiled = compiled ? 0 : -1;
+        records.append(record);
+    }
+
+    store.reserve(records.count());
+    foreach (const AdBlockRuleStore::Record &source, records) {
+        int id = store.allocateId();
+        AdBlockRuleStore::Chunk *chunk = store.detachedChunk(id);
+        AdBlockRuleStore::Record record = AdBlockRuleStore::copyText(chunk, text.constData(), source);
+        if (source.compiled != -1)
+            store.compile(chunk, &record);
+        chunk->records[slot(id)] = record;
+        store.appendOrder(id);
+    }
+    return stream;
+}
@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2009, Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Benjamin Meyer nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef ADBLOCKRULESTORE_H
+#define ADBLOCKRULESTORE_H
+
+#include "adblockrule.h"
+
+#include <qatomic.h>
+#include <qset.h>
+#include <qshareddata.h>
+#include <qstringlist.h>
+#include <qvector.h>
+
+/*
+    The rules of a subscription stored in chunks of a few hundred rules,
+    each with one string holding the text of its filters and a compact
+    record per rule with the offsets of its pattern, match string and
+    token in that text and its parsed flags.  Only regular expressions and
+    $domain= options need anything more and get a compiled entry of their
+    own.
+
+    A rule is known by an id that stays the same while other rules are
+    added, removed or replaced, so an index over the rules can be updated
+    one rule at a time.  id() gives the rule at a position in the list.
+
+    Every rule has counters for the requests it matched and for the time
+    spent on the evaluations of it that were sampled.  They can be updated
+    through a const store without taking a lock.
+
+    AdBlockRule is a handle to a rule in a store.  A store is shared by the
+    handles, the subscription and the engines built from it, and has to be
+    detached before it is changed.  A copy of a store shares its chunks
+    until one is changed, so an edit only copies the chunk of the rule.
+ */
+class QDataStream;
+class QRegExp;
+class AdBlockRuleStore : public QSharedData
+{
+    friend QDataStream &operator<<(QDataStream &stream, const AdBlockRuleStore &store);
+    friend QDataStream &operator>>(QDataStream &stream, AdBlockRuleStore &store);
+
+public:
+    AdBlockRuleStore();
+    AdBlockRuleStore(const AdBlockRuleStore &other);
+    ~AdBlockRuleStore();
+
+    int count() const;
+    void reserve(int rules);
+    void clear();
+    void squeeze();
+
+    int id(int position) const;
+    int append(const QString &filter);
+    int append(const AdBlockRule &rule);
+    void replace(int position, const AdBlockRule &rule);
+    void remove(int position);
+
+    AdBlockRule rule(int id) const;
+
+    QString filter(int id) const;
+    bool isCSSRule(int id) const;
+    bool isException(int id) const;
+    void setException(int id, bool exception);
+    bool isEnabled(int id) const;
+    void setEnabled(int id, bool enabled);
+
+    AdBlockRule::MatchType matchType(int id) const;
+    QString regExpPattern(int id) const;
+    QString token(int id) const;
+    QString hostAnchor(int id) const;
+
+    bool networkMatch(int id, const QString &encodedUrl) const;
+    bool networkMatch(int id, const QString &encodedUrl, const AdBlockRequestContext &context) const;
+
+    int hits(int id) const;
+    int sampledEvaluations(int id) const;
+    int sampledTime(int id) const;
+    void recordHit(int id) const;
+    void recordEvaluation(int id, int microseconds) const;
+    void resetStatistics() const;
+
+private:
+    struct Record {
+        int filter;
+        // -1 once the record was removed and its id is free
+        int filterLength;
+        // The pattern is followed by '$' and the options when it has any
+        int pattern;
+        quint16 patternLength;
+        quint16 optionsLength;
+        // relative to the pattern
+        quint16 match;
+        quint16 matchLength;
+        quint16 token;
+        quint16 tokenLength;
+        quint32 flags;
+        int compiled;
+    };
+
+    struct Counters {
+        QAtomicInt hits;
+        QAtomicInt samples;
+        // microseconds
+        QAtomicInt time;
+    };
+
+    struct Compiled {
+        QRegExp *regExp;
+        QSet<QString> includedDomains;
+        QSet<QString> excludedDomains;
+    };
+
+    // The rules with the ids from a multiple of CHUNK_SIZE on
+    struct Chunk : public QSharedData {
+        Chunk();
+        Chunk(const Chunk &other);
+        ~Chunk();
+        void squeeze();
+
+        QString text;
+        // indexed by id % CHUNK_SIZE
+        QVector<Record> records;
+        mutable QVector<Counters> counters;
+        QVector<Compiled*> compiled;
+        // characters of text no longer used by any record
+        int unused;
+    };
+
+    struct OrderChunk : public QSharedData {
+        QVector<int> ids;
+    };
+
+    static Compiled *copyCompiled(const Compiled *compiled);
+    static void deleteCompiled(Compiled *compiled);
+
+    const Chunk *chunk(int id) const;
+    const Record &record(int id) const;
+    Chunk *detachedChunk(int id);
+    int allocateId();
+    void appendOrder(int id);
+    int takeOrder(int position);
+    int orderChunk(int position) const;
+
+    static Record copyText(Chunk *chunk, const QChar *data, const Record &source);
+    Record parseRecord(Chunk *chunk, const QString &filter);
+    Record copyRecord(Chunk *chunk, const AdBlockRuleStore &other, int id);
+    void releaseRecord(Chunk *chunk, const Record &record);
+    void parse(Chunk *chunk, const QString &filter, Record *record);
+    void parseOptions(const QStringList &options, Record *record, Compiled *compiled);
+    void compile(Chunk *chunk, Record *record);
+    bool patternMatch(const Chunk *chunk, const Record &record, const QString &encodedUrl) const;
+    bool optionsMatch(const Chunk *chunk, const Record &record, const AdBlockRequestContext &context) const;
+
+    // indexed by id / CHUNK_SIZE
+    QVector<QExplicitlySharedDataPointer<Chunk> > m_chunks;
+    // the ids in list order
+    QVector<QExplicitlySharedDataPointer<OrderChunk> > m_order;
+    // the position of the first id of each order chunk
+    QVector<int> m_orderStarts;
+    QVector<int> m_freeIds;
+    int m_count;
+};
+
+QDataStream &operator<<(QDataStream &stream, const AdBlockRuleStore &store);
+QDataStream &operator>>(QDataStream &stream, AdBlockRuleStore &store);
+
+#endif // ADBLOCKRULESTORE_H
+
@@ -31,20 +31,43 @@
 #include "browserapplication.h"
 #include "networkaccessmanager.h"
 
+#include <qabstractnetworkcache.h>
 #include <qcryptographichash.h>
+#include <qdatastream.h>
 #include <qdebug.h>
 #include <qfile.h>
+#include <qfileinfo.h>
 #include <qnetworkreply.h>
+#include <qtconcurrentrun.h>
 #include <qtextstream.h>
 
+#include <stdio.h>
+
 // #define ADBLOCKSUBSCRIPTION_DEBUG
 
+/*
+    The precompiled rules are stored next to the subscription text as
+    magic, version, the size, modification time and SHA-1 of the text they
+    were parsed from, followed by the rule store.  Bump the version whenever
+    the stream format of AdBlockRuleStore changes.
+ */
+static const quint32 ADBLOCK_CACHE_MAGIC = 0x41424243; // "ABBC"
+static const quint32 ADBLOCK_CACHE_VERSION = 2;
+
 AdBlockSubscription::AdBlockSubscription(const QUrl &url, QObject *parent)
     : QObject(parent)
     , m_url(url.toEncoded())
     , m_enabled(false)
     , m_downloading(0)
+    , m_downloadFile(0)
+    , m_blockedRequests(0)
+    , m_bytesSaved(0)
+    , m_parsing(false)
+    , m_parseWatcher(new QFutureWatcher<QExplicitlySharedDataPointer<AdBlockRuleStore> >(this))
+    , m_rules(new AdBlockRuleStore)
 {
+    qRegisterMetaType<AdBlockRuleChange>("AdBlockRuleChange");
+    connect(m_parseWatcher, SIGNAL(finished()), this, SLOT(rulesParsed()));
     parseUrl(url);
 }
 
@@ -64,6 +87,8 @@ void AdBlockSubscription::parseUrl(const QUrl &url)
     QByteArray lastUpdateByteArray = url.encodedQueryItemValue("lastUpdate");
     QString lastUpdateString = QUrl::fromPercentEncoding(lastUpdateByteArray);
     m_lastUpdate = QDateTime::fromString(lastUpdateString, Qt::ISODate);
+    m_etag = QUrl::fromPercentEncoding(url.encodedQueryItemValue("etag")).toLatin1();
+    m_lastModified = QUrl::fromPercentEncoding(url.encodedQueryItemValue("lastModified")).toLatin1();
     loadRules();
 }
 
@@ -82,6 +107,10 @@ QUrl AdBlockSubscription::url() const
         queryItems.append(Query(QLatin1String("enabled"), QLatin1String("false")));
     if (m_lastUpdate.isValid())
         queryItems.append(Query(QLatin1String("lastUpdate"), m_lastUpdate.toString(Qt::ISODate)));
+    if (!m_etag.isEmpty())
+        queryItems.append(Query(QLatin1String("etag"), QLatin1String(m_etag)));
+    if (!m_lastModified.isEmpty())
+        queryItems.append(Query(QLatin1String("lastModified"), QLatin1String(m_lastModified)));
     url.setQueryItems(queryItems);
     return url;
 }
@@ -96,7 +125,6 @@ void AdBlockSubscription::setEnabled(bool enabled)
     if (m_enabled == enabled)
         return;
     m_enabled = enabled;
-    populateCache();
     emit changed();
 }
 
@@ -124,6 +152,8 @@ void AdBlockSubscription::setLocation(const QUrl &url)
         return;
     m_location = url.toEncoded();
     m_lastUpdate = QDateTime();
+    m_etag.clear();
+    m_lastModified.clear();
     emit changed();
 }
 
@@ -145,32 +175,66 @@ QString AdBlockSubscription::rulesFileName() const
     return fileName;
 }
 
+/*
+    Local files are only read, we do not write next to them.
+ */
+QString AdBlockSubscription::cacheFileName() const
+{
+    if (location().scheme() == QLatin1String("file")
+        || m_location.isEmpty())
+        return QString();
+    return rulesFileName() + QLatin1String(".cache");
+}
+
+/*
+    Runs on a worker thread for downloaded subscriptions, it must not
+    touch the subscription.
+ */
+static QExplicitlySharedDataPointer<AdBlockRuleStore> parseRules(const QByteArray &data)
+{
+    QExplicitlySharedDataPointer<AdBlockRuleStore> rules(new AdBlockRuleStore);
+    rules->reserve(data.count('\n'));
+    QTextStream textStream(data);
+    textStream.readLine(1024); // header
+    while (!textStream.atEnd()) {
+        QString line = textStream.readLine();
+        rules->append(line);
+    }
+    return rules;
+}
+
 void AdBlockSubscription::loadRules()
 {
     QString fileName = rulesFileName();
 #if defined(ADBLOCKSUBSCRIPTION_DEBUG)
     qDebug() << "AdBlockSubscription::" << __FUNCTION__ << fileName;
 #endif
+    // Whatever is still being parsed is older than what is loaded now
+    m_parsing = false;
     QFile file(fileName);
     if (file.exists()) {
-        if (!file.open(QFile::ReadOnly)) {
+        if (loadCache(fileName)) {
+            emit rulesChanged(AdBlockRuleChange());
+        } else if (!file.open(QFile::ReadOnly)) {
             qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Unable to open adblock file for reading" << fileName;
         } else {
-            QTextStream textStream(&file);
+            QByteArray data = file.readAll();
+            file.close();
+            QTextStream textStream(&data, QIODevice::ReadOnly);
             QString header = textStream.readLine(1024);
             if (!header.startsWith(QLatin1String("[Adblock"))) {
                 qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "adblock file does not start with [Adblock" << fileName << "Header:" << header;
-                file.close();
                 file.remove();
+                removeCache();
                 m_lastUpdate = QDateTime();
+            } else if (location().scheme() == QLatin1String("file")) {
+                m_rules = parseRules(data);
+                emit rulesChanged(AdBlockRuleChange());
             } else {
-                m_rules.clear();
-                while (!textStream.atEnd()) {
-                    QString line = textStream.readLine();
-                    m_rules.append(AdBlockRule(line));
-                }
-                populateCache();
-                emit rulesChanged();
+                // Large lists take long enough to parse to stall the ui
+                m_parsing = true;
+                m_parsingSha1 = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+                m_parseWatcher->setFuture(QtConcurrent::run(parseRules, data));
             }
         }
     }
@@ -181,6 +245,143 @@ void AdBlockSubscription::loadRules()
     }
 }
 
+/*
+    Load the rules from the precompiled cache if it was written for the
+    current subscription text.  The size and modification time are checked
+    first, only if those differ is the text hashed to see if it really
+    changed.
+ */
+bool AdBlockSubscription::loadCache(const QString &fileName)
+{
+    QString cacheName = cacheFileName();
+    if (cacheName.isEmpty())
+        return false;
+
+    QFile cacheFile(cacheName);
+    if (!cacheFile.exists() || !cacheFile.open(QFile::ReadOnly))
+        return false;
+
+    qint64 size = cacheFile.size();
+    uchar *memory = cacheFile.map(0, size);
+    QByteArray cacheData;
+    if (memory)
+        cacheData = QByteArray::fromRawData(reinterpret_cast<const char*>(memory), size);
+    else
+        cacheData = cacheFile.readAll();
+
+    QDataStream stream(cacheData);
+    stream.setVersion(QDataStream::Qt_4_5);
+
+    quint32 magic;
+    quint32 version;
+    qint64 textSize;
+    QDateTime textModified;
+    QByteArray textSha1;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok
+        || magic != ADBLOCK_CACHE_MAGIC
+        || version != ADBLOCK_CACHE_VERSION) {
+#if defined(ADBLOCKSUBSCRIPTION_DEBUG)
+        qDebug() << "AdBlockSubscription::" << __FUNCTION__ << "cache version mismatch" << cacheName;
+#endif
+        return false;
+    }
+    stream >> textSize >> textModified >> textSha1;
+
+    QFileInfo info(fileName);
+    bool unchanged = (info.size() == textSize && info.lastModified() == textModified);
+    if (!unchanged) {
+        QFile file(fileName);
+        if (!file.open(QFile::ReadOnly))
+            return false;
+        unchanged = (QCryptographicHash::hash(file.readAll(), QCryptographicHash::Sha1) == textSha1);
+    }
+    if (!unchanged) {
+#if defined(ADBLOCKSUBSCRIPTION_DEBUG)
+        qDebug() << "AdBlockSubscription::" << __FUNCTION__ << "cache is out of date" << cacheName;
+#endif
+        return false;
+    }
+
+    QExplicitlySharedDataPointer<AdBlockRuleStore> rules(new AdBlockRuleStore);
+    stream >> *rules;
+    if (stream.status() != QDataStream::Ok) {
+        qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "corrupt adblock cache" << cacheName;
+        return false;
+    }
+
+    m_rules = rules;
+    // Only the modification time was different, refresh it for the next start
+    if (info.size() != textSize || info.lastModified() != textModified)
+        saveCache(fileName, textSha1);
+#if defined(ADBLOCKSUBSCRIPTION_DEBUG)
+    qDebug() << "AdBlockSubscription::" << __FUNCTION__ << "loaded" << m_rules->count() << "rules from" << cacheName;
+#endif
+    return true;
+}
+
+void AdBlockSubscription::saveCache(const QString &fileName, const QByteArray &sha1)
+{
+    QString cacheName = cacheFileName();
+    if (cacheName.isEmpty())
+        return;
+
+    QFile cacheFile(cacheName);
+    if (!cacheFile.open(QFile::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Unable to open adblock cache for writing:" << cacheName;
+        return;
+    }
+
+    QFileInfo info(fileName);
+    QDataStream stream(&cacheFile);
+    stream.setVersion(QDataStream::Qt_4_5);
+    stream << ADBLOCK_CACHE_MAGIC << ADBLOCK_CACHE_VERSION;
+    stream << info.size() << info.lastModified() << sha1;
+    stream << *m_rules;
+
+    if (stream.status() != QDataStream::Ok) {
+        qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Unable to write adblock cache:" << cacheName;
+        cacheFile.remove();
+    }
+}
+
+void AdBlockSubscription::rulesParsed()
+{
+    if (!m_parsing)
+        return;
+    m_parsing = false;
+    m_rules = m_parseWatcher->result();
+#if defined(ADBLOCKSUBSCRIPTION_DEBUG)
+    qDebug() << "AdBlockSubscription::" << __FUNCTION__ << m_rules->count();
+#endif
+    saveCache(rulesFileName(), m_parsingSha1);
+    emit rulesChanged(AdBlockRuleChange());
+}
+
+bool AdBlockSubscription::isLoading() const
+{
+    return m_parsing;
+}
+
+/*
+    Finish parsing the rules on this thread if it is still going on in the
+    background, used before the rules are changed or written out.
+ */
+void AdBlockSubscription::waitForRules()
+{
+    if (!m_parsing)
+        return;
+    m_parseWatcher->waitForFinished();
+    rulesParsed();
+}
+
+void AdBlockSubscription::removeCache()
+{
+    QString cacheName = cacheFileName();
+    if (!cacheName.isEmpty())
+        QFile::remove(cacheName);
+}
+
 void AdBlockSubscription::updateNow()
 {
 #if defined(ADBLOCKSUBSCRIPTION_DEBUG)
@@ -210,12 +411,83 @@ void AdBlockSubscription::updateNow()
         return;
     }
 
-    QNetworkRequest request(location());
+    download(location());
+}
+
+/*
+    Ask for the list only if it changed since the copy we have, the new
+    list is written to a .part file as it arrives and only replaces the
+    old one once it is complete.
+ */
+void AdBlockSubscription::download(const QUrl &url)
+{
+    QNetworkRequest request(url);
+    if (QFile::exists(rulesFileName())) {
+        if (!m_etag.isEmpty())
+            request.setRawHeader("If-None-Match", m_etag);
+        if (!m_lastModified.isEmpty())
+            request.setRawHeader("If-Modified-Since", m_lastModified);
+    }
+    discardDownload();
     QNetworkReply *reply = BrowserApplication::networkAccessManager()->get(request);
     m_downloading = reply;
+    connect(reply, SIGNAL(readyRead()), this, SLOT(rulesDataAvailable()));
     connect(reply, SIGNAL(finished()), this, SLOT(rulesDownloaded()));
 }
 
+void AdBlockSubscription::writeDownload(QNetworkReply *reply)
+{
+    // Not modified and redirect responses have no list in them
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status >= 300 && status < 400) {
+        reply->readAll();
+        return;
+    }
+
+    if (!m_downloadFile) {
+        if (reply->bytesAvailable() == 0)
+            return;
+        m_downloadFile = new QFile(rulesFileName() + QLatin1String(".part"), this);
+        if (!m_downloadFile->open(QFile::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Unable to open adblock file for writing:" << m_downloadFile->fileName();
+            delete m_downloadFile;
+            m_downloadFile = 0;
+            reply->abort();
+            return;
+        }
+    }
+    m_downloadFile->write(reply->readAll());
+}
+
+void AdBlockSubscription::discardDownload()
+{
+    if (!m_downloadFile)
+        return;
+    m_downloadFile->remove();
+    delete m_downloadFile;
+    m_downloadFile = 0;
+}
+
+void AdBlockSubscription::rulesDataAvailable()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply || reply != m_downloading)
+        return;
+    writeDownload(reply);
+}
+
+// rename(2) replaces the old file in one step, elsewhere it is removed first
+static bool replaceFile(const QString &fileName, const QString &newFileName)
+{
+#if defined(Q_OS_UNIX)
+    return ::rename(QFile::encodeName(fileName).constData(),
+                    QFile::encodeName(newFileName).constData()) == 0;
+#else
+    QFile::remove(newFileName);
+    return QFile::rename(fileName, newFileName);
+#endif
+}
+
 void AdBlockSubscription::rulesDownloaded()
 {
 #if defined(ADBLOCKSUBSCRIPTION_DEBUG)
@@ -228,14 +500,24 @@ void AdBlockSubscription::rulesDownloaded()
 #endif
         return;
     }
+    if (reply != m_downloading) {
+        reply->deleteLater();
+        return;
+    }
 
-    QByteArray response = reply->readAll();
+    if (reply->error() == QNetworkReply::NoError)
+        writeDownload(reply);
     QUrl redirect = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    QByteArray etag = reply->rawHeader("ETag");
+    QByteArray lastModified = reply->rawHeader("Last-Modified");
     reply->close();
     reply->deleteLater();
+    m_downloading = 0;
 
     if (reply->error() != QNetworkReply::NoError) {
         qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "error" << reply->errorString();
+        discardDownload();
         return;
     }
 
@@ -243,39 +525,68 @@ void AdBlockSubscription::rulesDownloaded()
 #if defined(ADBLOCKSUBSCRIPTION_DEBUG)
         qDebug() << "AdBlockSubscription::" << __FUNCTION__ << "redirect to:" << redirect;
 #endif
-        QNetworkRequest request(redirect);
-        m_downloading = BrowserApplication::networkAccessManager()->get(request);
-        connect(m_downloading, SIGNAL(finished()), this, SLOT(rulesDownloaded()));
+        download(redirect);
         return;
     }
 
-    if (response.isEmpty()) {
+    // The rules are the same, only what is saved about them changes
+    if (status == 304) {
+#if defined(ADBLOCKSUBSCRIPTION_DEBUG)
+        qDebug() << "AdBlockSubscription::" << __FUNCTION__ << "not modified";
+#endif
+        discardDownload();
+        if (!etag.isEmpty())
+            m_etag = etag;
+        if (!lastModified.isEmpty())
+            m_lastModified = lastModified;
+        m_lastUpdate = QDateTime::currentDateTime();
+        emit metaDataChanged();
+        return;
+    }
+
+    if (!m_downloadFile || m_downloadFile->size() == 0) {
         qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "empty response";
+        discardDownload();
+        return;
+    }
+
+    // Keep the list we have if what came back is not a list
+    m_downloadFile->close();
+    QString partFileName = m_downloadFile->fileName();
+    if (!m_downloadFile->open(QFile::ReadOnly)
+        || !m_downloadFile->readLine(1024).startsWith("[Adblock")) {
+        qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "downloaded file does not start with [Adblock" << location();
+        discardDownload();
         return;
     }
+    m_downloadFile->close();
+    delete m_downloadFile;
+    m_downloadFile = 0;
 
     QString fileName = rulesFileName();
-    QFile file(fileName);
-    if (!file.open(QFile::ReadWrite)) {
-        qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Unable to open adblock file for writing:" << fileName;
+    if (!replaceFile(partFileName, fileName)) {
+        qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Unable to move adblock file into place:" << fileName;
+        QFile::remove(partFileName);
         return;
     }
-    file.write(response);
+    m_etag = etag;
+    m_lastModified = lastModified;
+    removeCache();
     m_lastUpdate = QDateTime::currentDateTime();
     loadRules();
     emit changed();
-    m_downloading = 0;
 }
 
 void AdBlockSubscription::saveRules()
 {
 #if defined(ADBLOCKSUBSCRIPTION_DEBUG)
-    qDebug() << "AdBlockSubscription::" << __FUNCTION__ << rulesFileName() << m_rules.count();
+    qDebug() << "AdBlockSubscription::" << __FUNCTION__ << rulesFileName() << m_rules->count();
 #endif
     QString fileName = rulesFileName();
     if (fileName.isEmpty())
         return;
 
+    waitForRules();
     QFile file(fileName);
     if (!file.open(QFile::ReadWrite | QIODevice::Truncate)) {
         qWarning() << "AdBlockSubscription::" << __FUNCTION__ << "Unable to open adblock file for writing:" << fileName;
@@ -284,92 +595,156 @@ void AdBlockSubscription::saveRules()
 
     QTextStream textStream(&file);
     textStream << "[Adblock Plus 0.7.1]" << endl;
-    foreach (const AdBlockRule &rule, m_rules)
-        textStream << rule.filter() << endl;
+    for (int i = 0; i < m_rules->count(); ++i)
+        textStream << m_rules->filter(m_rules->id(i)) << endl;
+    removeCache();
 }
 
-QList<const AdBlockRule*> AdBlockSubscription::pageRules() const
+QList<AdBlockRule> AdBlockSubscription::pageRules() const
 {
-    return m_pageRules;
+    QList<AdBlockRule> rules;
+    if (!isEnabled())
+        return rules;
+    for (int i = 0; i < m_rules->count(); ++i) {
+        int id = m_rules->id(i);
+        if (m_rules->isEnabled(id) && m_rules->isCSSRule(id))
+            rules.append(m_rules->rule(id));
+    }
+    return rules;
 }
 
-const AdBlockRule *AdBlockSubscription::allow(const QString &urlString) const
+/*
+    Every rule as its own handle, ruleCount() and rule() are cheaper for
+    going over the rules of a large subscription.
+ */
+QList<AdBlockRule> AdBlockSubscription::allRules() const
 {
-    foreach (const AdBlockRule *rule, m_networkExceptionRules) {
-        if (rule->networkMatch(urlString))
-            return rule;
-    }
-    return 0;
+    QList<AdBlockRule> rules;
+    for (int i = 0; i < m_rules->count(); ++i)
+        rules.append(m_rules->rule(m_rules->id(i)));
+    return rules;
 }
 
-const AdBlockRule *AdBlockSubscription::block(const QString &urlString) const
+/*
+    The store is shared with the caller, the subscription detaches from it
+    before its rules change.
+ */
+QExplicitlySharedDataPointer<AdBlockRuleStore> AdBlockSubscription::ruleStore() const
 {
-    foreach (const AdBlockRule *rule, m_networkBlockRules) {
-        if (rule->networkMatch(urlString))
-            return rule;
-    }
-    return 0;
+    return m_rules;
 }
 
-QList<AdBlockRule> AdBlockSubscription::allRules() const
+int AdBlockSubscription::ruleCount() const
 {
-    return m_rules;
+    return m_rules->count();
 }
 
+AdBlockRule AdBlockSubscription::rule(int offset) const
+{
+    if (offset < 0 || offset >= m_rules->count())
+        return AdBlockRule();
+    return m_rules->rule(m_rules->id(offset));
+}
+
+/*
+    Emitting which rule changed lets the manager update just that rule in
+    its engine.
+ */
 void AdBlockSubscription::addRule(const AdBlockRule &rule)
 {
 #if defined(ADBLOCKSUBSCRIPTION_DEBUG)
     qDebug() << "AdBlockSubscription::" << __FUNCTION__ << rule.filter();
 #endif
-    m_rules.append(rule);
-    populateCache();
-    emit rulesChanged();
+    waitForRules();
+    detachRules();
+    int id = m_rules->append(rule);
+    emit rulesChanged(AdBlockRuleChange(AdBlockRuleChange::Added, m_rules->count() - 1, id));
 }
 
 void AdBlockSubscription::removeRule(int offset)
 {
 #if defined(ADBLOCKSUBSCRIPTION_DEBUG)
-    qDebug() << "AdBlockSubscription::" << __FUNCTION__ << offset << m_rules.count();
+    qDebug() << "AdBlockSubscription::" << __FUNCTION__ << offset << m_rules->count();
 #endif
-    if (offset < 0 || offset >= m_rules.count())
+    waitForRules();
+    if (offset < 0 || offset >= m_rules->count())
         return;
-    m_rules.removeAt(offset);
-    populateCache();
-    emit rulesChanged();
+    detachRules();
+    int id = m_rules->id(offset);
+    m_rules->remove(offset);
+    emit rulesChanged(AdBlockRuleChange(AdBlockRuleChange::Removed, offset, id));
 }
 
 void AdBlockSubscription::replaceRule(const AdBlockRule &rule, int offset)
 {
-    if (offset < 0 || offset >= m_rules.count())
+    waitForRules();
+    if (offset < 0 || offset >= m_rules->count())
         return;
-    m_rules[offset] = rule;
-    populateCache();
-    emit rulesChanged();
+    detachRules();
+    int id = m_rules->id(offset);
+    m_rules->replace(offset, rule);
+    emit rulesChanged(AdBlockRuleChange(AdBlockRuleChange::Replaced, offset, id));
 }
 
-void AdBlockSubscription::populateCache()
+int AdBlockSubscription::blockedRequests() const
 {
-    m_networkExceptionRules.clear();
-    m_networkBlockRules.clear();
-    m_pageRules.clear();
-    if (!isEnabled())
-        return;
+    return m_blockedRequests;
+}
 
-    for (int i = 0; i < m_rules.count(); ++i) {
-        const AdBlockRule *rule = &m_rules.at(i);
-        if (!rule->isEnabled())
-            continue;
+/*
+    What a blocked request would have cost, as far as the disk cache knows
+    from an earlier visit.  0 when it was never loaded.
+ */
+static qint64 cachedSize(const QUrl &url)
+{
+    QAbstractNetworkCache *cache = BrowserApplication::networkAccessManager()->cache();
+    if (!cache)
+        return 0;
+    QNetworkCacheMetaData metaData = cache->metaData(url);
+    if (!metaData.isValid())
+        return 0;
+    foreach (const QNetworkCacheMetaData::RawHeader &header, metaData.rawHeaders()) {
+        if (qstricmp(header.first.constData(), "Content-Length") == 0)
+            return header.second.toLongLong();
+    }
+    return 0;
+}
 
-        if (rule->isCSSRule()) {
-            m_pageRules.append(rule);
-            continue;
-        }
+/*
+    The sizes the disk cache had for the blocked urls, requests that were
+    never loaded before are not counted.  The cache is only asked when the
+    figure is wanted so blocking a request does not touch the disk.
+ */
+qint64 AdBlockSubscription::bytesSaved() const
+{
+    QHash<QByteArray, int>::const_iterator it = m_unsizedBlocks.constBegin();
+    for (; it != m_unsizedBlocks.constEnd(); ++it)
+        m_bytesSaved += cachedSize(QUrl::fromEncoded(it.key())) * it.value();
+    m_unsizedBlocks.clear();
+    return m_bytesSaved;
+}
 
-        if (rule->isException()) {
-            m_networkExceptionRules.append(rule);
-        } else {
-            m_networkBlockRules.append(rule);
-        }
-    }
+void AdBlockSubscription::recordBlocked(const QByteArray &encodedUrl) const
+{
+    ++m_blockedRequests;
+    // Past this many different urls the rest are only counted as requests
+    if (m_unsizedBlocks.count() < 4096 || m_unsizedBlocks.contains(encodedUrl))
+        ++m_unsizedBlocks[encodedUrl];
+}
+
+void AdBlockSubscription::resetStatistics()
+{
+    m_blockedRequests = 0;
+    m_bytesSaved = 0;
+    m_unsizedBlocks.clear();
+    m_rules->resetStatistics();
 }
 
+/*
+    Engines and rule handles share the store, they keep the rules as they
+    were before the change.
+ */
+void AdBlockSubscription::detachRules()
+{
+    m_rules.detach();
+}
@@ -32,10 +32,41 @@
 #include <qobject.h>
 
 #include "adblockrule.h"
+#include "adblockrulestore.h"
 
+#include <qhash.h>
 #include <qlist.h>
 #include <qdatetime.h>
+#include <qfuturewatcher.h>
+#include <qmetatype.h>
 
+/*
+    What rulesChanged() changed.  Reset when all of the rules were loaded
+    again, otherwise the one rule at offset in the list and its id in the
+    subscription's rule store.  A removed rule is no longer in the store.
+ */
+class AdBlockRuleChange
+{
+
+public:
+    enum Type {
+        Reset,
+        Added,
+        Removed,
+        Replaced
+    };
+
+    AdBlockRuleChange(Type type = Reset, int offset = -1, int id = -1)
+        : type(type), offset(offset), id(id) {}
+
+    Type type;
+    int offset;
+    int id;
+};
+
+Q_DECLARE_METATYPE(AdBlockRuleChange)
+
+class QFile;
 class QNetworkReply;
 class QUrl;
 class AdBlockSubscription : public QObject
@@ -44,7 +75,8 @@ class AdBlockSubscription : public QObject
 
 signals:
     void changed();
-    void rulesChanged();
+    void metaDataChanged();
+    void rulesChanged(const AdBlockRuleChange &change);
 
 public:
     AdBlockSubscription(const QUrl &url, QObject *parent = 0);
@@ -62,25 +94,43 @@ public:
     void updateNow();
     QDateTime lastUpdate() const;
 
+    bool isLoading() const;
+    void waitForRules();
+
     void saveRules();
 
-    const AdBlockRule *allow(const QString &urlString) const;
-    const AdBlockRule *block(const QString &urlString) const;
-    QList<const AdBlockRule*> pageRules() const;
+    QList<AdBlockRule> pageRules() const;
 
     QList<AdBlockRule> allRules() const;
+    QExplicitlySharedDataPointer<AdBlockRuleStore> ruleStore() const;
+    int ruleCount() const;
+    AdBlockRule rule(int offset) const;
     void addRule(const AdBlockRule &rule);
     void removeRule(int offset);
     void replaceRule(const AdBlockRule &rule, int offset);
 
+    int blockedRequests() const;
+    qint64 bytesSaved() const;
+    void recordBlocked(const QByteArray &encodedUrl) const;
+    void resetStatistics();
+
 private slots:
+    void rulesDataAvailable();
     void rulesDownloaded();
+    void rulesParsed();
 
 private:
-    void populateCache();
+    void download(const QUrl &url);
+    void writeDownload(QNetworkReply *reply);
+    void discardDownload();
+    void detachRules();
     QString rulesFileName() const;
+    QString cacheFileName() const;
     void parseUrl(const QUrl &url);
     void loadRules();
+    bool loadCache(const QString &fileName);
+    void saveCache(const QString &fileName, const QByteArray &sha1);
+    void removeCache();
 
     QByteArray m_url;
 
@@ -88,14 +138,21 @@ private:
     QByteArray m_location;
     QDateTime m_lastUpdate;
     bool m_enabled;
+    // validators of the last download, sent back to only get a changed list
+    QByteArray m_etag;
+    QByteArray m_lastModified;
 
     QNetworkReply *m_downloading;
-    QList<AdBlockRule> m_rules;
-
-    // sorted list
-    QList<const AdBlockRule*> m_networkExceptionRules;
-    QList<const AdBlockRule*> m_networkBlockRules;
-    QList<const AdBlockRule*> m_pageRules;
+    QFile *m_downloadFile;
+
+    // only updated from the thread requests are made on
+    mutable int m_blockedRequests;
+    mutable qint64 m_bytesSaved;
+    mutable QHash<QByteArray, int> m_unsizedBlocks;
+    bool m_parsing;
+    QFutureWatcher<QExplicitlySharedDataPointer<AdBlockRuleStore> > *m_parseWatcher;
+    QByteArray m_parsingSha1;
+    QExplicitlySharedDataPointer<AdBlockRuleStore> m_rules;
 };
 
 #endif // ADBLOCKSUBSCRIPTION_H
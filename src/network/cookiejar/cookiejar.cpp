@@ -139,6 +139,7 @@ void CookieJar::clear()
 {
     if (!m_loaded)
         load();
+    loadAllStoredCookies();
     setAllCookies(QList<QNetworkCookie>());
     m_saveTimer->changeOccurred();
     emit cookiesChanged();
@@ -152,7 +153,17 @@ void CookieJar::load()
     qRegisterMetaTypeStreamOperators<QList<QNetworkCookie> >("QList<QNetworkCookie>");
     QSettings cookieSettings(BrowserApplication::dataFilePath(QLatin1String("cookies.ini")), QSettings::IniFormat);
     if (!m_isPrivate) {
-        setAllCookies(qvariant_cast<QList<QNetworkCookie> >(cookieSettings.value(QLatin1String("cookies"))));
+        m_store.setFileName(BrowserApplication::dataFilePath(QLatin1String("cookies.dat")));
+        if (m_store.exists()) {
+            // Only the index is read, the cookies follow as they are used
+            m_store.open();
+            setRecordChanges(true);
+        } else {
+            // Cookies used to be saved in cookies.ini, the first
+            // save writes them out to the store
+            setRecordChanges(true);
+            setAllCookies(qvariant_cast<QList<QNetworkCookie> >(cookieSettings.value(QLatin1String("cookies"))));
+        }
     }
     cookieSettings.beginGroup(QLatin1String("Exceptions"));
     m_exceptions_block = cookieSettings.value(QLatin1String("block")).toStringList();
@@ -161,6 +172,7 @@ void CookieJar::load()
     qSort(m_exceptions_block.begin(), m_exceptions_block.end());
     qSort(m_exceptions_allow.begin(), m_exceptions_allow.end());
     qSort(m_exceptions_allowForSession.begin(), m_exceptions_allowForSession.end());
+    compileRules();
 
     loadSettings();
 }
@@ -182,12 +194,16 @@ void CookieJar::loadSettings()
                     KeepUntilExpire :
                     static_cast<KeepPolicy>(keepPolicyEnum.keyToValue(value));
 
-    if (m_keepCookies == KeepUntilExit)
+    if (m_keepCookies == KeepUntilExit) {
+        loadAllStoredCookies();
         setAllCookies(QList<QNetworkCookie>());
+    }
 
     m_loaded = true;
     m_filterTrackingCookies = settings.value(QLatin1String("filterTrackingCookies"), m_filterTrackingCookies).toBool();
     m_sessionLength = settings.value(QLatin1String("sessionLength"), -1).toInt();
+    setMaximumCookies(settings.value(QLatin1String("maximumCookies"), 3000).toInt());
+    setMaximumCookiesPerDomain(settings.value(QLatin1String("maximumCookiesPerDomain"), 150).toInt());
     emit cookiesChanged();
 }
 
@@ -199,12 +215,17 @@ void CookieJar::save()
 
     QSettings cookieSettings(BrowserApplication::dataFilePath(QLatin1String("cookies.ini")), QSettings::IniFormat);
 
-    QList<QNetworkCookie> cookies = allCookies();
-    for (int i = cookies.count() - 1; i >= 0; --i) {
-        if (cookies.at(i).isSessionCookie())
-            cookies.removeAt(i);
+    // Only the changes since the last save are appended to the store
+    // unless a new snapshot of the whole jar is needed
+    bool reset;
+    QList<NetworkCookieChange> changes = takeChanges(&reset);
+    if (reset || m_store.needsCompaction() || !m_store.append(changes)) {
+        loadAllStoredCookies();
+        if (m_store.writeSnapshot(allCookies()))
+            cookieSettings.remove(QLatin1String("cookies"));
+        else
+            qWarning() << "CookieJar:" << "Unable to save cookies to" << m_store.fileName();
     }
-    cookieSettings.setValue(QLatin1String("cookies"), qVariantFromValue<QList<QNetworkCookie> >(cookies));
     cookieSettings.beginGroup(QLatin1String("Exceptions"));
     cookieSettings.setValue(QLatin1String("block"), m_exceptions_block);
     cookieSettings.setValue(QLatin1String("allow"), m_exceptions_allow);
@@ -225,19 +246,8 @@ void CookieJar::save()
 
 void CookieJar::purgeOldCookies()
 {
-    QList<QNetworkCookie> cookies = allCookies();
-    if (cookies.isEmpty())
-        return;
-    int oldCount = cookies.count();
-    QDateTime now = QDateTime::currentDateTime();
-    for (int i = cookies.count() - 1; i >= 0; --i) {
-        if (!cookies.at(i).isSessionCookie() && cookies.at(i).expirationDate() < now)
-            cookies.removeAt(i);
-    }
-    if (oldCount == cookies.count())
-        return;
-    setAllCookies(cookies);
-    emit cookiesChanged();
+    if (removeExpiredCookies())
+        emit cookiesChanged();
 }
 
 QList<QNetworkCookie> CookieJar::cookiesForUrl(const QUrl &url) const
@@ -245,19 +255,76 @@ QList<QNetworkCookie> CookieJar::cookiesForUrl(const QUrl &url) const
     CookieJar *that = const_cast<CookieJar*>(this);
     if (!m_loaded)
         that->load();
+    that->loadStoredCookies(url.host());
 
     return NetworkCookieJar::cookiesForUrl(url);
 }
 
+/*
+    Stored cookies are read one top level domain at a time, before the
+    first time a site under it gets or sets cookies.
+*/
+void CookieJar::loadStoredCookies(const QString &host)
+{
+    if (m_store.hasUnloadedCookies())
+        addCookies(m_store.load(CookieStore::topLevelDomain(host)));
+}
+
+void CookieJar::loadAllStoredCookies()
+{
+    if (m_store.hasUnloadedCookies())
+        addCookies(m_store.load());
+}
+
+/*
+    The exception rules are kept in a hash from the rule without its
+    leading dot to the lists it is on.  A rule matches a domain that is
+    equal to it or ends with a dot followed by the rule, so a domain only
+    needs one lookup for itself and one for each parent domain.
+*/
+static void addRules(QHash<QString, int> *compiled, const QStringList &rules, int flag)
+{
+    foreach (const QString &rule, rules) {
+        if (rule.startsWith(QLatin1Char('.')))
+            (*compiled)[rule.mid(1)] |= flag;
+        else
+            (*compiled)[rule] |= flag;
+    }
+}
+
+static int matchingRules(const QHash<QString, int> &compiled, const QString &domain)
+{
+    if (compiled.isEmpty())
+        return 0;
+    int flags = compiled.value(domain);
+    const QChar *data = domain.unicode();
+    int dot = domain.indexOf(QLatin1Char('.'));
+    while (dot != -1) {
+        flags |= compiled.value(QString::fromRawData(data + dot + 1, domain.length() - dot - 1));
+        dot = domain.indexOf(QLatin1Char('.'), dot + 1);
+    }
+    return flags;
+}
+
+void CookieJar::compileRules()
+{
+    m_rules.clear();
+    addRules(&m_rules, m_exceptions_block, 1 << Block);
+    addRules(&m_rules, m_exceptions_allow, 1 << Allow);
+    addRules(&m_rules, m_exceptions_allowForSession, 1 << AllowForSession);
+}
+
 bool CookieJar::setCookiesFromUrl(const QList<QNetworkCookie> &cookieList, const QUrl &url)
 {
     if (!m_loaded)
         load();
 
     QString host = url.host();
-    bool eBlock = isOnDomainList(m_exceptions_block, host);
-    bool eAllow = !eBlock && isOnDomainList(m_exceptions_allow, host);
-    bool eAllowSession = !eBlock && !eAllow && isOnDomainList(m_exceptions_allowForSession, host);
+    loadStoredCookies(host);
+    int rules = matchingRules(m_rules, host);
+    bool eBlock = rules & (1 << Block);
+    bool eAllow = !eBlock && (rules & (1 << Allow));
+    bool eAllowSession = !eBlock && !eAllow && (rules & (1 << AllowForSession));
 
     bool addedCookies = false;
     // pass exceptions
@@ -291,22 +358,8 @@ bool CookieJar::setCookiesFromUrl(const QList<QNetworkCookie> &cookieList, const
                 } else {
                     // finally force it in if wanted
                     if (m_acceptCookies == AcceptAlways) {
-                        QList<QNetworkCookie> cookies = allCookies();
-                        QList<QNetworkCookie>::Iterator it = cookies.begin(),
-                                   end = cookies.end();
-                        for (; it != end; ++it) {
-                            // does this cookie already exist?
-                            if (cookie.name() == it->name() &&
-                                cookie.domain() == it->domain() &&
-                                cookie.path() == it->path()) {
-                                // found a match
-                                cookies.erase(it);
-                                break;
-                            }
-                        }
-
-                        cookies += cookie;
-                        setAllCookies(cookies);
+                        loadStoredCookies(cookie.domain());
+                        insertCookie(cookie);
                         addedCookies = true;
                     }
     #if 0
@@ -334,6 +387,7 @@ QList<QNetworkCookie> CookieJar::cookies() const
     CookieJar *that = const_cast<CookieJar*>(this);
     if (!m_loaded)
         that->load();
+    that->loadAllStoredCookies();
 
     return allCookies();
 }
@@ -342,6 +396,7 @@ void CookieJar::setCookies(const QList<QNetworkCookie> &cookies)
 {
     if (!m_loaded)
         load();
+    loadAllStoredCookies();
     setAllCookies(cookies);
     m_saveTimer->changeOccurred();
     emit cookiesChanged();
@@ -349,29 +404,9 @@ void CookieJar::setCookies(const QList<QNetworkCookie> &cookies)
 
 bool CookieJar::isOnDomainList(const QStringList &rules, const QString &domain)
 {
-    // Either the rule matches the domain exactly
-    // or the domain ends with ".rule"
-    foreach (const QString &rule, rules) {
-        if (rule.startsWith(QLatin1String("."))) {
-            if (domain.endsWith(rule))
-                return true;
-
-            QStringRef withoutDot = rule.rightRef(rule.size() - 1);
-            if (domain == withoutDot)
-                return true;
-        } else {
-            QStringRef domainEnding = domain.rightRef(rule.size() + 1);
-            if (!domainEnding.isEmpty()
-                && domainEnding.at(0) == QLatin1Char('.')
-                && domain.endsWith(rule)) {
-                return true;
-            }
-
-            if (rule == domain)
-                return true;
-        }
-    }
-    return false;
+    QHash<QString, int> compiled;
+    addRules(&compiled, rules, 1);
+    return matchingRules(compiled, domain) != 0;
 }
 
 CookieJar::AcceptPolicy CookieJar::acceptPolicy() const
@@ -435,6 +470,7 @@ void CookieJar::setBlockedCookies(const QStringList &list)
         load();
     m_exceptions_block = list;
     qSort(m_exceptions_block.begin(), m_exceptions_block.end());
+    compileRules();
     applyRules();
     m_saveTimer->changeOccurred();
 }
@@ -445,6 +481,7 @@ void CookieJar::setAllowedCookies(const QStringList &list)
         load();
     m_exceptions_allow = list;
     qSort(m_exceptions_allow.begin(), m_exceptions_allow.end());
+    compileRules();
     applyRules();
     m_saveTimer->changeOccurred();
 }
@@ -455,20 +492,23 @@ void CookieJar::setAllowForSessionCookies(const QStringList &list)
         load();
     m_exceptions_allowForSession = list;
     qSort(m_exceptions_allowForSession.begin(), m_exceptions_allowForSession.end());
+    compileRules();
     applyRules();
     m_saveTimer->changeOccurred();
 }
 
 void CookieJar::applyRules()
 {
+    loadAllStoredCookies();
     QList<QNetworkCookie> cookies = allCookies();
     bool changed = false;
     for (int i = cookies.count() - 1; i >= 0; --i) {
         const QNetworkCookie &cookie = cookies.at(i);
-        if (isOnDomainList(m_exceptions_block, cookie.domain())) {
+        int rules = matchingRules(m_rules, cookie.domain());
+        if (rules & (1 << Block)) {
             cookies.removeAt(i);
             changed = true;
-        } else if (isOnDomainList(m_exceptions_allowForSession, cookie.domain())) {
+        } else if (rules & (1 << AllowForSession)) {
             const_cast<QNetworkCookie&>(cookie).setExpirationDate(QDateTime());
             changed = true;
         }
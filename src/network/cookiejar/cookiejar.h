@@ -63,8 +63,10 @@
 #ifndef COOKIEJAR_H
 #define COOKIEJAR_H
 
+#include "cookiestore.h"
 #include "networkcookiejar.h"
 
+#include <qhash.h>
 #include <qstringlist.h>
 
 class AutoSaver;
@@ -143,10 +145,14 @@ protected:
 
 private:
     void applyRules();
+    void compileRules();
     void purgeOldCookies();
     void load();
+    void loadStoredCookies(const QString &host);
+    void loadAllStoredCookies();
     bool m_loaded;
     AutoSaver *m_saveTimer;
+    CookieStore m_store;
     bool m_filterTrackingCookies;
 
     AcceptPolicy m_acceptCookies;
@@ -155,6 +161,7 @@ private:
     QStringList m_exceptions_block;
     QStringList m_exceptions_allow;
     QStringList m_exceptions_allowForSession;
+    QHash<QString, int> m_rules;
     bool m_isPrivate;
     int m_sessionLength;
 };
@@ -6,6 +6,7 @@ HEADERS += \
   cookieexceptionsdialog.h \
   cookieexceptionsmodel.h \
   cookiejar.h \
+  cookiestore.h \
   cookiemodel.h
 
 SOURCES += \
@@ -13,7 +14,8 @@ SOURCES += \
   cookieexceptionsmodel.cpp \
   cookiemodel.cpp \
   cookieexceptionsdialog.cpp \
-  cookiejar.cpp
+  cookiejar.cpp \
+  cookiestore.cpp
 
 FORMS += \
     cookies.ui \
@@ -0,0 +1,438 @@
+/*
+ * Copyright 2009 Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "cookiestore.h"
+
+#include <qbytearray.h>
+#include <qdatastream.h>
+#include <qfile.h>
+#include <qhash.h>
+#include <qmap.h>
+
+#include <qdebug.h>
+
+#if defined(Q_OS_UNIX)
+#include <stdio.h>
+#endif
+
+// #define COOKIESTORE_DEBUG
+
+static const quint32 CookieStoreMagic = 0x436b4a72;
+static const quint32 CookieStoreVersion = 2;
+
+enum CookieRecordFlag {
+    SecureFlag = 0x1,
+    HttpOnlyFlag = 0x2
+};
+
+/*
+    Every cookie is written as the same fixed sequence of fields so it can
+    be read back without going through the Set-Cookie header parser.
+*/
+static void writeCookie(QDataStream &stream, const QNetworkCookie &cookie)
+{
+    quint8 flags = 0;
+    if (cookie.isSecure())
+        flags |= SecureFlag;
+    if (cookie.isHttpOnly())
+        flags |= HttpOnlyFlag;
+    stream << cookie.name() << cookie.value()
+           << cookie.domain() << cookie.path()
+           << cookie.expirationDate().toUTC()
+           << flags;
+}
+
+static bool readCookie(QDataStream &stream, QNetworkCookie *cookie)
+{
+    QByteArray name;
+    QByteArray value;
+    QString domain;
+    QString path;
+    QDateTime expirationDate;
+    quint8 flags;
+    stream >> name >> value >> domain >> path >> expirationDate >> flags;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+    cookie->setName(name);
+    cookie->setValue(value);
+    cookie->setDomain(domain);
+    cookie->setPath(path);
+    cookie->setExpirationDate(expirationDate);
+    cookie->setSecure(flags & SecureFlag);
+    cookie->setHttpOnly(flags & HttpOnlyFlag);
+    return true;
+}
+
+static QByteArray cookieKey(const QNetworkCookie &cookie)
+{
+    return cookie.name() + '\0' + cookie.domain().toUtf8() + '\0' + cookie.path().toUtf8();
+}
+
+static bool replaceFile(const QString &fileName, const QString &newFileName)
+{
+#if defined(Q_OS_UNIX)
+    return ::rename(QFile::encodeName(fileName).constData(),
+                    QFile::encodeName(newFileName).constData()) == 0;
+#else
+    QFile::remove(newFileName);
+    return QFile::rename(fileName, newFileName);
+#endif
+}
+
+CookieStore::CookieStore(const QString &fileName)
+    : m_fileName(fileName)
+    , m_opened(false)
+    , m_generation(0)
+    , m_snapshotCount(0)
+    , m_journalCount(0)
+    , m_journalValid(false)
+{
+}
+
+QString CookieStore::fileName() const
+{
+    return m_fileName;
+}
+
+void CookieStore::setFileName(const QString &fileName)
+{
+    m_fileName = fileName;
+    m_groups.clear();
+    m_opened = false;
+    m_generation = 0;
+    m_snapshotCount = 0;
+    m_journalCount = 0;
+    m_journalValid = false;
+}
+
+QString CookieStore::journalFileName() const
+{
+    return m_fileName + QLatin1String(".journal");
+}
+
+bool CookieStore::exists() const
+{
+    return QFile::exists(m_fileName);
+}
+
+/*
+    Returns the last label of \a host, the key the snapshot groups
+    cookies by.
+*/
+QString CookieStore::topLevelDomain(const QString &host)
+{
+    int end = host.length();
+    while (end > 0 && host.at(end - 1) == QLatin1Char('.'))
+        --end;
+    if (end == 0)
+        return QString();
+    int start = host.lastIndexOf(QLatin1Char('.'), end - 1) + 1;
+    return host.mid(start, end - start).toLower();
+}
+
+/*
+    Reads the index of the snapshot and the journal, returns false if
+    there is no usable snapshot.
+*/
+bool CookieStore::open()
+{
+    m_groups.clear();
+    m_opened = true;
+    m_snapshotCount = 0;
+    m_journalCount = 0;
+    m_journalValid = false;
+
+    QFile file(m_fileName);
+    if (!file.open(QFile::ReadOnly))
+        return false;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_5);
+    quint32 magic;
+    quint32 version;
+    quint32 count;
+    stream >> magic >> version >> m_generation >> count;
+    if (magic != CookieStoreMagic || (version != 1 && version != CookieStoreVersion)) {
+        qWarning() << "CookieStore:" << "Unknown cookie file format" << m_fileName;
+        return false;
+    }
+
+    if (version == 1) {
+        // The first version was a flat list of cookies without an index
+        for (quint32 i = 0; i < count; ++i) {
+            QNetworkCookie cookie;
+            if (!readCookie(stream, &cookie)) {
+                qWarning() << "CookieStore:" << "Cookie file is truncated" << m_fileName;
+                break;
+            }
+            m_groups[topLevelDomain(cookie.domain())].cookies.append(cookie);
+            ++m_snapshotCount;
+        }
+    } else {
+        for (quint32 i = 0; i < count; ++i) {
+            QString domain;
+            quint32 offset;
+            Group group;
+            stream >> domain >> group.count >> offset;
+            if (stream.status() != QDataStream::Ok) {
+                qWarning() << "CookieStore:" << "Cookie file is truncated" << m_fileName;
+                m_groups.clear();
+                m_snapshotCount = 0;
+                return false;
+            }
+            group.offset = offset;
+            m_groups.insert(domain, group);
+            m_snapshotCount += group.count;
+        }
+
+        // Offsets are relative to the end of the index
+        qint64 start = file.pos();
+        QHash<QString, Group>::iterator it = m_groups.begin();
+        for (; it != m_groups.end(); ++it)
+            it.value().offset += start;
+    }
+
+    readJournal();
+#if defined(COOKIESTORE_DEBUG)
+    qDebug() << "CookieStore::" << __FUNCTION__ << m_groups.count() << m_snapshotCount << m_journalCount;
+#endif
+    return true;
+}
+
+/*
+    Sorts the journal records by the group they belong to, they are
+    replayed when the group is loaded.
+*/
+void CookieStore::readJournal()
+{
+    // A journal from another snapshot is left over from a failed save
+    QFile journal(journalFileName());
+    if (!journal.open(QFile::ReadOnly))
+        return;
+    QDataStream stream(&journal);
+    stream.setVersion(QDataStream::Qt_4_5);
+    quint32 magic;
+    quint32 version;
+    quint32 generation;
+    stream >> magic >> version >> generation;
+    if (stream.status() != QDataStream::Ok
+        || magic != CookieStoreMagic
+        || version < 1 || version > CookieStoreVersion
+        || generation != m_generation)
+        return;
+    m_journalValid = true;
+
+    qint64 end = journal.pos();
+    while (!stream.atEnd()) {
+        quint8 type;
+        QNetworkCookie cookie;
+        stream >> type;
+        // The last record is cut short when the browser did not exit cleanly,
+        // it is cut off so the next changes are not appended behind it
+        if (!readCookie(stream, &cookie)) {
+            journal.close();
+            if (!QFile::resize(journalFileName(), end))
+                m_journalValid = false;
+            return;
+        }
+        end = journal.pos();
+        ++m_journalCount;
+        m_groups[topLevelDomain(cookie.domain())].changes.append(
+            NetworkCookieChange(NetworkCookieChange::Type(type), cookie));
+    }
+}
+
+bool CookieStore::hasUnloadedCookies() const
+{
+    return !m_groups.isEmpty();
+}
+
+/*
+    Returns the stored cookies that were not loaded yet.
+*/
+QList<QNetworkCookie> CookieStore::load()
+{
+    if (!m_opened)
+        open();
+    QList<QNetworkCookie> cookies;
+    foreach (const QString &domain, m_groups.keys())
+        cookies += load(domain);
+    return cookies;
+}
+
+/*
+    Returns the stored cookies under \a topLevelDomain, or nothing if
+    they were already loaded.
+*/
+QList<QNetworkCookie> CookieStore::load(const QString &topLevelDomain)
+{
+    if (!m_opened)
+        open();
+    QHash<QString, Group>::iterator it = m_groups.find(topLevelDomain);
+    if (it == m_groups.end())
+        return QList<QNetworkCookie>();
+    Group group = it.value();
+    m_groups.erase(it);
+
+    QList<QNetworkCookie> cookies = group.cookies;
+    if (group.offset >= 0) {
+        QFile file(m_fileName);
+        if (!file.open(QFile::ReadOnly) || !file.seek(group.offset)) {
+            qWarning() << "CookieStore:" << "Unable to read cookies from" << m_fileName;
+        } else {
+            QDataStream stream(&file);
+            stream.setVersion(QDataStream::Qt_4_5);
+            for (quint32 i = 0; i < group.count; ++i) {
+                QNetworkCookie cookie;
+                if (!readCookie(stream, &cookie)) {
+                    qWarning() << "CookieStore:" << "Cookie file is truncated" << m_fileName;
+                    break;
+                }
+                cookies.append(cookie);
+            }
+        }
+    }
+#if defined(COOKIESTORE_DEBUG)
+    qDebug() << "CookieStore::" << __FUNCTION__ << topLevelDomain << cookies.count() << group.changes.count();
+#endif
+    if (group.changes.isEmpty())
+        return cookies;
+
+    QHash<QByteArray, QNetworkCookie> replayed;
+    foreach (const QNetworkCookie &cookie, cookies)
+        replayed.insert(cookieKey(cookie), cookie);
+    foreach (const NetworkCookieChange &change, group.changes) {
+        if (change.type == NetworkCookieChange::Inserted)
+            replayed.insert(cookieKey(change.cookie), change.cookie);
+        else
+            replayed.remove(cookieKey(change.cookie));
+    }
+    return replayed.values();
+}
+
+/*
+    Replaces the snapshot with \a cookies and starts a new journal.  Any
+    cookies that were not loaded yet are dropped, so \a cookies has to
+    include them.
+*/
+bool CookieStore::writeSnapshot(const QList<QNetworkCookie> &cookies)
+{
+#if defined(COOKIESTORE_DEBUG)
+    qDebug() << "CookieStore::" << __FUNCTION__ << cookies.count();
+#endif
+    m_journalValid = false;
+
+    QMap<QString, QList<QNetworkCookie> > groups;
+    quint32 count = 0;
+    foreach (const QNetworkCookie &cookie, cookies) {
+        if (cookie.isSessionCookie())
+            continue;
+        groups[topLevelDomain(cookie.domain())].append(cookie);
+        ++count;
+    }
+
+    // The size of every group has to be known to write the index
+    QList<QByteArray> data;
+    QMap<QString, QList<QNetworkCookie> >::const_iterator it = groups.constBegin();
+    for (; it != groups.constEnd(); ++it) {
+        QByteArray group;
+        QDataStream stream(&group, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_4_5);
+        foreach (const QNetworkCookie &cookie, it.value())
+            writeCookie(stream, cookie);
+        data.append(group);
+    }
+
+    QString partFileName = m_fileName + QLatin1String(".part");
+    QFile file(partFileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_5);
+    stream << CookieStoreMagic << CookieStoreVersion << (m_generation + 1) << quint32(groups.count());
+    quint32 offset = 0;
+    int i = 0;
+    for (it = groups.constBegin(); it != groups.constEnd(); ++it, ++i) {
+        stream << it.key() << quint32(it.value().count()) << offset;
+        offset += data.at(i).size();
+    }
+    foreach (const QByteArray &group, data)
+        stream.writeRawData(group.constData(), group.size());
+    file.close();
+    if (stream.status() != QDataStream::Ok || file.error() != QFile::NoError
+        || !replaceFile(partFileName, m_fileName)) {
+        QFile::remove(partFileName);
+        return false;
+    }
+
+    ++m_generation;
+    m_groups.clear();
+    m_opened = true;
+    m_snapshotCount = count;
+    m_journalCount = 0;
+    return startJournal();
+}
+
+bool CookieStore::startJournal()
+{
+    QFile journal(journalFileName());
+    if (!journal.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    QDataStream stream(&journal);
+    stream.setVersion(QDataStream::Qt_4_5);
+    stream << CookieStoreMagic << CookieStoreVersion << m_generation;
+    journal.close();
+    m_journalValid = (journal.error() == QFile::NoError);
+    return m_journalValid;
+}
+
+/*
+    Appends \a changes to the journal, returns false if that was not
+    possible and a new snapshot has to be written instead.
+*/
+bool CookieStore::append(const QList<NetworkCookieChange> &changes)
+{
+    if (!m_journalValid)
+        return false;
+    if (changes.isEmpty())
+        return true;
+
+    QFile journal(journalFileName());
+    if (!journal.open(QFile::WriteOnly | QFile::Append)) {
+        m_journalValid = false;
+        return false;
+    }
+    QDataStream stream(&journal);
+    stream.setVersion(QDataStream::Qt_4_5);
+    foreach (const NetworkCookieChange &change, changes) {
+        if (change.cookie.isSessionCookie())
+            continue;
+        stream << quint8(change.type);
+        writeCookie(stream, change.cookie);
+        ++m_journalCount;
+    }
+    journal.close();
+    m_journalValid = (stream.status() == QDataStream::Ok
+                      && journal.error() == QFile::NoError);
+    return m_journalValid;
+}
+
+bool CookieStore::needsCompaction() const
+{
+    return m_journalCount > qMax(256, m_snapshotCount);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2009 Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef COOKIESTORE_H
+#define COOKIESTORE_H
+
+#include "networkcookiejar.h"
+
+#include <qhash.h>
+#include <qstring.h>
+
+/*
+    Keeps cookies on disk as a binary snapshot plus a journal of the
+    cookies that were inserted or removed since the snapshot was taken.
+
+    Saving only appends the latest changes to the journal.  Once the
+    journal holds more records than the snapshot has cookies the two are
+    compacted into a new snapshot.  Session cookies are never stored.
+
+    The snapshot groups the cookies by top level domain behind an index
+    of where each group starts.  open() only reads the index and the
+    journal, the cookies of a group are read by load() when they are
+    first needed.
+*/
+class CookieStore
+{
+public:
+    CookieStore(const QString &fileName = QString());
+
+    QString fileName() const;
+    void setFileName(const QString &fileName);
+
+    bool exists() const;
+    bool open();
+    bool hasUnloadedCookies() const;
+    QList<QNetworkCookie> load();
+    QList<QNetworkCookie> load(const QString &topLevelDomain);
+    bool writeSnapshot(const QList<QNetworkCookie> &cookies);
+    bool append(const QList<NetworkCookieChange> &changes);
+    bool needsCompaction() const;
+
+    static QString topLevelDomain(const QString &host);
+
+private:
+    QString journalFileName() const;
+    void readJournal();
+    bool startJournal();
+
+    struct Group {
+        Group() : offset(-1), count(0) {}
+        qint64 offset;
+        quint32 count;
+        QList<QNetworkCookie> cookies;
+        QList<NetworkCookieChange> changes;
+    };
+
+    QString m_fileName;
+    QHash<QString, Group> m_groups;
+    bool m_opened;
+    quint32 m_generation;
+    int m_snapshotCount;
+    int m_journalCount;
+    bool m_journalValid;
+};
+
+#endif // COOKIESTORE_H
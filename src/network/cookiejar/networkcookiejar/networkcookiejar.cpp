@@ -36,7 +36,7 @@
 
 #include "networkcookiejar.h"
 #include "networkcookiejar_p.h"
-#include "twoleveldomains_p.h"
+#include "publicsuffix_p.h"
 
 //#define NETWORKCOOKIEJAR_DEBUG
 
@@ -49,6 +49,7 @@
 
 #include <qurl.h>
 #include <qdatetime.h>
+#include <qset.h>
 
 #if defined(NETWORKCOOKIEJAR_DEBUG)
 #include <qdebug.h>
@@ -86,34 +87,52 @@ QList<QNetworkCookie> NetworkCookieJar::cookiesForUrl(const QUrl &url) const
 #if defined(NETWORKCOOKIEJAR_DEBUG)
     qDebug() << "NetworkCookieJar::" << __FUNCTION__ << url;
 #endif
-    // Generate split host
     QString host = url.host();
     if (url.scheme().toLower() == QLatin1String("file"))
         host = QLatin1String("localhost");
-    QStringList urlHost = splitHost(host);
-
-    // Get all the cookies for url
-    QList<QNetworkCookie> cookies = d->tree.find(urlHost);
-    if (urlHost.count() > 2) {
-        int top = 2;
-        if (d->matchesBlacklist(urlHost.last()))
-            top = 3;
-
-        urlHost.removeFirst();
-        while (urlHost.count() >= top) {
-            cookies += d->tree.find(urlHost);
-            urlHost.removeFirst();
+    const QString urlPath = d->urlPath(url);
+    const bool isSecure = url.scheme().toLower() == QLatin1String("https");
+
+    // The same url is asked for many times while loading a page
+    QDateTime now = QDateTime::currentDateTime().toTimeSpec(Qt::UTC);
+    const uint currentTime = now.toTime_t();
+    QString cacheKey = host + QLatin1Char('\n') + urlPath;
+    if (isSecure)
+        cacheKey += QLatin1Char('\n');
+    if (CookieCacheEntry *entry = d->cache.object(cacheKey)) {
+        if (d->isCurrent(*entry, currentTime)) {
+            return entry->cookies;
         }
     }
+    CookieCacheEntry *entry = new CookieCacheEntry;
+    entry->expires = uint(-1);
+
+    // Get all the cookies for the host and its parent domains, the
+    // tree is walked down once and then back up through the parents
+    int labels = 0;
+    int node = d->tree.closestNode(host, &labels);
+    int depth = d->tree.depth(node);
+    int top = labels;
+    if (labels > 2 && depth > 0)
+        top = qMin(labels, d->publicSuffixLabels(host) + 1);
+
+    // The closest node is a dependency even if it is above the top,
+    // adding the missing part of the host would change it
+    entry->nodes.append(node);
+    entry->generations.append(d->tree.generation(node));
+    QList<QNetworkCookie> cookies;
+    for (; depth >= top; --depth) {
+        cookies += d->tree.values(node);
+        if (node != entry->nodes.first()) {
+            entry->nodes.append(node);
+            entry->generations.append(d->tree.generation(node));
+        }
+        node = d->tree.parent(node);
+    }
 
-    // Prevent doing anything expensive in the common case where
-    // there are no cookies to check
-    if (cookies.isEmpty())
-        return cookies;
-
-    QDateTime now = QDateTime::currentDateTime().toTimeSpec(Qt::UTC);
-    const QString urlPath = d->urlPath(url);
-    const bool isSecure = url.scheme().toLower() == QLatin1String("https");
+    // Expired cookies are left in the tree until the next batch removal,
+    // only check the dates when the earliest one has already passed
+    const bool checkExpiration = !d->expiry.isEmpty() && d->expiry.next() < currentTime;
     QList<QNetworkCookie>::iterator i = cookies.begin();
     for (; i != cookies.end();) {
         if (!d->matchingPath(*i, urlPath)) {
@@ -131,10 +150,7 @@ QList<QNetworkCookie> NetworkCookieJar::cookiesForUrl(const QUrl &url) const
 #endif
             continue;
         }
-        if (!i->isSessionCookie() && now > i->expirationDate()) {
-            // remove now (expensive short term) because there will
-            // probably be many more cookiesForUrl calls for this host
-            d->tree.remove(splitHost(i->domain()), *i);
+        if (checkExpiration && !i->isSessionCookie() && now > i->expirationDate()) {
 #if defined(NETWORKCOOKIEJAR_DEBUG)
             qDebug() << __FUNCTION__ << "Ignoring cookie, expiration issue"
                      << *i << now;
@@ -142,18 +158,34 @@ QList<QNetworkCookie> NetworkCookieJar::cookiesForUrl(const QUrl &url) const
             i = cookies.erase(i);
             continue;
         }
+        if (!i->isSessionCookie())
+            entry->expires = qMin(entry->expires, CookieExpiryHeap::expirationTime(*i));
         ++i;
     }
 
     // shorter paths should go first
-    qSort(cookies.begin(), cookies.end(), shorterPaths);
+    if (cookies.count() > 1)
+        qSort(cookies.begin(), cookies.end(), shorterPaths);
 #if defined(NETWORKCOOKIEJAR_DEBUG)
     qDebug() << "NetworkCookieJar::" << __FUNCTION__ << "returning" << cookies.count();
     qDebug() << cookies;
 #endif
+    entry->cookies = cookies;
+    d->cache.insert(cacheKey, entry);
     return cookies;
 }
 
+bool NetworkCookieJarPrivate::isCurrent(const CookieCacheEntry &entry, uint now) const
+{
+    if (entry.expires <= now)
+        return false;
+    for (int i = 0; i < entry.nodes.count(); ++i) {
+        if (tree.generation(entry.nodes.at(i)) != entry.generations.at(i))
+            return false;
+    }
+    return true;
+}
+
 static const qint32 NetworkCookieJarMagic = 0xae;
 
 QByteArray NetworkCookieJar::saveState () const
@@ -182,24 +214,83 @@ bool NetworkCookieJar::restoreState(const QByteArray &state)
     if (marker != NetworkCookieJarMagic || v != version)
         return false;
     stream >> d->tree;
+    d->cache.clear();
+    d->reset();
+    d->staleExpiries = 0;
+    d->expiry.rebuild(d->tree);
     return true;
 }
 
 /*!
     Remove any session cookies or cookies that have expired.
   */
-void NetworkCookieJar::endSession()
+/*
+    Session cookies are not in the expiry heap, ending a session has to
+    go through all the cookies.
+*/
+class SessionCookies
 {
-    const QList<QNetworkCookie> cookies = d->tree.all();
-    QDateTime now = QDateTime::currentDateTime().toTimeSpec(Qt::UTC);
-    QList<QNetworkCookie>::const_iterator i = cookies.constBegin();
-    for (; i != cookies.constEnd();) {
-        if (i->isSessionCookie()
-            || (!i->isSessionCookie() && now > i->expirationDate())) {
-                d->tree.remove(splitHost(i->domain()), *i);
-        }
-        ++i;
+public:
+    SessionCookies(NetworkCookieJarPrivate *d) : d(d) {}
+
+    bool operator()(const QNetworkCookie &cookie)
+    {
+        if (!cookie.isSessionCookie())
+            return false;
+        d->removed(cookie);
+        return true;
     }
+
+private:
+    NetworkCookieJarPrivate *d;
+};
+
+void NetworkCookieJar::endSession()
+{
+    d->expire(QDateTime::currentDateTime().toTime_t());
+
+    SessionCookies sessionCookies(d);
+    d->tree.removeIf(sessionCookies);
+}
+
+/*!
+    Remove the cookies that have expired, returns true if any were removed.
+
+    Lookups do not remove expired cookies, this should be called from time
+    to time so they do not pile up.
+  */
+bool NetworkCookieJar::removeExpiredCookies()
+{
+    return d->expire(QDateTime::currentDateTime().toTime_t()) > 0;
+}
+
+/*!
+    Limits the number of cookies in the jar to \a maximum, -1 means there
+    is no limit.  When a new cookie goes over the limit the cookies that
+    would expire first are removed.
+  */
+void NetworkCookieJar::setMaximumCookies(int maximum)
+{
+    d->maximumCookies = maximum;
+}
+
+/*!
+    Limits the number of cookies each registrable domain, like
+    example.com or example.co.uk, together with its subdomains can have
+    to \a maximum, -1 means there is no limit.
+  */
+void NetworkCookieJar::setMaximumCookiesPerDomain(int maximum)
+{
+    d->maximumCookiesPerDomain = maximum;
+}
+
+/*!
+    Inserts \a cookie without any of the checks done in setCookiesFromUrl(),
+    replacing the cookie with the same name, domain and path.
+  */
+void NetworkCookieJar::insertCookie(const QNetworkCookie &cookie)
+{
+    d->insert(cookie);
 }
 
 static const int maxCookiePathLength = 1024;
@@ -211,6 +302,7 @@ bool NetworkCookieJar::setCookiesFromUrl(const QList<QNetworkCookie> &cookieList
     qDebug() << cookieList;
 #endif
     QDateTime now = QDateTime::currentDateTime().toTimeSpec(Qt::UTC);
+    d->expire(now.toTime_t());
     bool changed = false;
     QString fullUrlPath = url.path();
     QString defaultPath = fullUrlPath.mid(0, fullUrlPath.lastIndexOf(QLatin1Char('/')) + 1);
@@ -254,26 +346,14 @@ bool NetworkCookieJar::setCookiesFromUrl(const QList<QNetworkCookie> &cookieList
         }
 
         // replace/remove existing cookies
-        QString domain = cookie.domain();
-        Q_ASSERT(!domain.isEmpty());
-        QStringList urlHost = splitHost(domain);
-
-        QList<QNetworkCookie> cookies = d->tree.find(urlHost);
-        QList<QNetworkCookie>::const_iterator it = cookies.constBegin();
-        for (; it != cookies.constEnd(); ++it) {
-            if (cookie.name() == it->name() &&
-                cookie.domain() == it->domain() &&
-                cookie.path() == it->path()) {
-                d->tree.remove(urlHost, *it);
-                break;
-            }
-        }
-
-        if (alreadyDead)
+        Q_ASSERT(!cookie.domain().isEmpty());
+        if (alreadyDead) {
+            d->take(cookie);
             continue;
+        }
 
         changed = true;
-        d->tree.insert(urlHost, cookie);
+        d->insert(cookie);
     }
 
     return changed;
@@ -287,16 +367,336 @@ QList<QNetworkCookie> NetworkCookieJar::allCookies() const
     return d->tree.all();
 }
 
-void NetworkCookieJar::setAllCookies(const QList<QNetworkCookie> &cookieList)
+/*!
+    Adds \a cookieList to the jar without recording them as changes, for
+    cookies that are read back from storage after the jar was set up.
+    Cookies over the limits are removed once all of them are added.
+  */
+void NetworkCookieJar::addCookies(const QList<QNetworkCookie> &cookieList)
 {
 #if defined(NETWORKCOOKIEJAR_DEBUG)
     qDebug() << "NetworkCookieJar::" << __FUNCTION__ << cookieList.count();
 #endif
-    d->tree.clear();
     foreach (const QNetworkCookie &cookie, cookieList) {
-        QString domain = cookie.domain();
-        d->tree.insert(splitHost(domain), cookie);
+        if (d->tree.insert(cookie.domain(), cookie))
+            ++d->staleExpiries;
+        if (!cookie.isSessionCookie())
+            d->expiry.insert(cookie);
+    }
+    d->enforceLimits(cookieList);
+}
+
+void NetworkCookieJar::setAllCookies(const QList<QNetworkCookie> &cookieList)
+{
+#if defined(NETWORKCOOKIEJAR_DEBUG)
+    qDebug() << "NetworkCookieJar::" << __FUNCTION__ << cookieList.count();
+#endif
+    d->setAll(cookieList);
+}
+
+/*!
+    When \a record is true every cookie that is inserted or removed from
+    now on is remembered until takeChanges() is called.
+  */
+void NetworkCookieJar::setRecordChanges(bool record)
+{
+    d->recordChanges = record;
+    d->changesReset = false;
+    d->changes.clear();
+}
+
+/*!
+    Returns the changes recorded since the last call.  \a reset is set to
+    true when the whole jar was replaced in the meantime, or too much
+    changed to be worth listing, and the changes are then empty.
+
+    Cookies that expire are not part of the changes.
+  */
+QList<NetworkCookieChange> NetworkCookieJar::takeChanges(bool *reset)
+{
+    QList<NetworkCookieChange> changes = d->changes;
+    if (reset)
+        *reset = d->changesReset;
+    d->changes.clear();
+    d->changesReset = false;
+    return changes;
+}
+
+void NetworkCookieJarPrivate::record(NetworkCookieChange::Type type, const QNetworkCookie &cookie)
+{
+    if (!recordChanges || changesReset)
+        return;
+    if (changes.count() >= 4096) {
+        reset();
+        return;
+    }
+    changes.append(NetworkCookieChange(type, cookie));
+}
+
+void NetworkCookieJarPrivate::reset()
+{
+    if (!recordChanges)
+        return;
+    changes.clear();
+    changesReset = true;
+}
+
+void NetworkCookieJarPrivate::insert(const QNetworkCookie &cookie)
+{
+    QNetworkCookie replaced;
+    bool replacing = tree.insert(cookie.domain(), cookie, &replaced);
+    if (replacing)
+        removed(replaced);
+    record(NetworkCookieChange::Inserted, cookie);
+    if (!cookie.isSessionCookie())
+        expiry.insert(cookie);
+    if (!replacing)
+        enforceLimits(cookie);
+}
+
+/*
+    Returns the node of the registrable domain that \a node is part of,
+    the domain just below the public suffix.
+*/
+int NetworkCookieJarPrivate::registrableDomain(int node) const
+{
+    return tree.ancestor(node, publicSuffixLabels(node) + 1);
+}
+
+void NetworkCookieJarPrivate::enforceLimits(const QNetworkCookie &inserted)
+{
+    if (maximumCookiesPerDomain > 0) {
+        int domain = registrableDomain(tree.node(inserted.domain()));
+        int count = tree.count(domain);
+        if (count > maximumCookiesPerDomain)
+            evict(domain, count - maximumCookiesPerDomain, inserted);
     }
+
+    // Make some room so this does not have to run for every new cookie
+    if (maximumCookies > 0 && tree.count() > maximumCookies)
+        evict(0, tree.count() - maximumCookies + maximumCookies / 20, inserted);
+}
+
+/*
+    Checks the limits of the domains of \a added after they were put in
+    the tree at once.
+*/
+void NetworkCookieJarPrivate::enforceLimits(const QList<QNetworkCookie> &added)
+{
+    if (maximumCookiesPerDomain > 0) {
+        QSet<int> domains;
+        foreach (const QNetworkCookie &cookie, added) {
+            int node = tree.node(cookie.domain());
+            if (node != -1)
+                domains.insert(registrableDomain(node));
+        }
+        foreach (int domain, domains) {
+            int count = tree.count(domain);
+            if (count > maximumCookiesPerDomain)
+                evict(domain, count - maximumCookiesPerDomain, QNetworkCookie());
+        }
+    }
+
+    if (maximumCookies > 0 && tree.count() > maximumCookies)
+        evict(0, tree.count() - maximumCookies, QNetworkCookie());
+}
+
+/*
+    Removes \a count cookies from \a root and the nodes below it, starting
+    with the cookies that expire first.  Session cookies go before all the
+    others as they would not outlive the session anyway.  The \a keep
+    cookie is never removed.
+
+    When a cookie was last used is not kept across restarts, its expiry is.
+*/
+void NetworkCookieJarPrivate::evict(int root, int count, const QNetworkCookie &keep)
+{
+    QList<QNetworkCookie> cookies;
+    QList<QPair<uint, int> > order;
+    foreach (int node, tree.subtree(root)) {
+        foreach (const QNetworkCookie &cookie, tree.values(node)) {
+            if (cookie == keep)
+                continue;
+            uint expires = cookie.isSessionCookie() ? 0 : CookieExpiryHeap::expirationTime(cookie);
+            order.append(qMakePair(expires, cookies.count()));
+            cookies.append(cookie);
+        }
+    }
+    qSort(order);
+
+    QList<QNetworkCookie> evicted;
+    for (int i = 0; i < order.count() && evicted.count() < count; ++i)
+        evicted.append(cookies.at(order.at(i).second));
+#if defined(NETWORKCOOKIEJAR_DEBUG)
+    qDebug() << "NetworkCookieJarPrivate::" << __FUNCTION__ << evicted.count() << "of" << tree.count(root);
+#endif
+    foreach (const QNetworkCookie &cookie, evicted)
+        remove(cookie);
+}
+
+/*
+    Removes \a cookie if it is in the tree unchanged.
+*/
+bool NetworkCookieJarPrivate::remove(const QNetworkCookie &cookie)
+{
+    if (!tree.remove(cookie.domain(), cookie))
+        return false;
+    removed(cookie);
+    return true;
+}
+
+/*
+    Removes the cookie with the same name, domain and path as \a cookie.
+*/
+bool NetworkCookieJarPrivate::take(const QNetworkCookie &cookie)
+{
+    QNetworkCookie existing;
+    if (!tree.take(cookie.domain(), TrieValueKey<QNetworkCookie>::key(cookie), &existing))
+        return false;
+    removed(existing);
+    return true;
+}
+
+void NetworkCookieJarPrivate::removed(const QNetworkCookie &cookie)
+{
+    record(NetworkCookieChange::Removed, cookie);
+    if (cookie.isSessionCookie())
+        return;
+
+    // Rebuild the heap once it is mostly entries of removed cookies
+    ++staleExpiries;
+    if (staleExpiries > 32 && staleExpiries > expiry.count() / 2) {
+        staleExpiries = 0;
+        expiry.rebuild(tree);
+    }
+}
+
+void NetworkCookieJarPrivate::setAll(const QList<QNetworkCookie> &cookies)
+{
+    tree.clear();
+    cache.clear();
+    foreach (const QNetworkCookie &cookie, cookies)
+        tree.insert(cookie.domain(), cookie);
+    reset();
+    staleExpiries = 0;
+    expiry.rebuild(cookies);
+    enforceLimits(cookies);
+}
+
+/*
+    Removes every cookie that expired before \a now, returns the number
+    of cookies removed.
+*/
+int NetworkCookieJarPrivate::expire(uint now)
+{
+    int removed = 0;
+    while (!expiry.isEmpty() && expiry.next() < now) {
+        QNetworkCookie cookie = expiry.take();
+        if (tree.remove(cookie.domain(), cookie)) {
+#if defined(NETWORKCOOKIEJAR_DEBUG)
+            qDebug() << "NetworkCookieJarPrivate::" << __FUNCTION__ << cookie;
+#endif
+            ++removed;
+        } else if (staleExpiries > 0) {
+            --staleExpiries;
+        }
+    }
+    return removed;
+}
+
+void CookieExpiryHeap::clear()
+{
+    m_entries.clear();
+}
+
+uint CookieExpiryHeap::expirationTime(const QNetworkCookie &cookie)
+{
+    QDateTime date = cookie.expirationDate().toUTC();
+    uint time = date.toTime_t();
+    // toTime_t() can not go before the epoch
+    if (time == uint(-1) && date.date().year() < 1970)
+        return 0;
+    return time;
+}
+
+void CookieExpiryHeap::insert(const QNetworkCookie &cookie)
+{
+    Entry entry;
+    entry.expires = expirationTime(cookie);
+    entry.cookie = cookie;
+
+    int index = m_entries.count();
+    m_entries.append(entry);
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (m_entries.at(parent).expires <= entry.expires)
+            break;
+        m_entries[index] = m_entries.at(parent);
+        index = parent;
+    }
+    m_entries[index] = entry;
+}
+
+void CookieExpiryHeap::rebuild(const QList<QNetworkCookie> &cookies)
+{
+    m_entries.clear();
+    foreach (const QNetworkCookie &cookie, cookies)
+        append(cookie);
+    heapify();
+}
+
+void CookieExpiryHeap::rebuild(const Trie<QNetworkCookie> &tree)
+{
+    m_entries.clear();
+    Trie<QNetworkCookie>::const_iterator i = tree.constBegin();
+    for (; i != tree.constEnd(); ++i)
+        append(*i);
+    heapify();
+}
+
+void CookieExpiryHeap::append(const QNetworkCookie &cookie)
+{
+    if (cookie.isSessionCookie())
+        return;
+    Entry entry;
+    entry.expires = expirationTime(cookie);
+    entry.cookie = cookie;
+    m_entries.append(entry);
+}
+
+void CookieExpiryHeap::heapify()
+{
+    for (int i = m_entries.count() / 2 - 1; i >= 0; --i)
+        siftDown(i, m_entries.at(i));
+}
+
+QNetworkCookie CookieExpiryHeap::take()
+{
+    QNetworkCookie cookie = m_entries.first().cookie;
+    Entry last = m_entries.last();
+    m_entries.remove(m_entries.count() - 1);
+    if (!m_entries.isEmpty())
+        siftDown(0, last);
+    return cookie;
+}
+
+void CookieExpiryHeap::siftDown(int index, const Entry &entry)
+{
+    const Entry moving = entry;
+    const int count = m_entries.count();
+    for (;;) {
+        int child = 2 * index + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count
+            && m_entries.at(child + 1).expires < m_entries.at(child).expires)
+            ++child;
+        if (moving.expires <= m_entries.at(child).expires)
+            break;
+        m_entries[index] = m_entries.at(child);
+        index = child;
+    }
+    m_entries[index] = moving;
 }
 
 QString NetworkCookieJarPrivate::urlPath(const QUrl &url) const
@@ -318,16 +718,50 @@ bool NetworkCookieJarPrivate::matchingPath(const QNetworkCookie &cookie, const Q
 
 bool NetworkCookieJarPrivate::matchesBlacklist(const QString &string) const
 {
-    if (!setSecondLevelDomain) {
-        // Alternatively to save a little bit of ram we could just
-        // use bsearch on twoLevelDomains in place
-        for (int j = 0; twoLevelDomains[j]; ++j)
-            secondLevelDomains += QLatin1String(twoLevelDomains[j]);
-        setSecondLevelDomain = true;
-    }
     QStringList::const_iterator i =
          qBinaryFind(secondLevelDomains.constBegin(), secondLevelDomains.constEnd(), string);
-        return (i != secondLevelDomains.constEnd());
+    return (i != secondLevelDomains.constEnd());
+}
+
+/*
+    Returns the number of labels at the end of \a host that are a public
+    suffix, like "com" or "co.uk", which cookies can not be set for.
+*/
+int NetworkCookieJarPrivate::publicSuffixLabels(const QString &host) const
+{
+    TrieKey walker(host);
+    if (setSecondLevelDomain) {
+        if (!walker.next())
+            return 0;
+        QString topLevelDomain(walker.label(), walker.length());
+        return (walker.next() && matchesBlacklist(topLevelDomain)) ? 2 : 1;
+    }
+
+    PublicSuffixMatcher matcher;
+    while (!matcher.isDone() && walker.next())
+        matcher.addLabel(walker.label(), walker.length());
+    return matcher.suffixLabels();
+}
+
+/*
+    Returns the number of labels of the domain of \a node that are a
+    public suffix.
+*/
+int NetworkCookieJarPrivate::publicSuffixLabels(int node) const
+{
+    int depth = tree.depth(node);
+    if (setSecondLevelDomain) {
+        if (depth < 2)
+            return depth;
+        return matchesBlacklist(tree.label(tree.ancestor(node, 1))) ? 2 : 1;
+    }
+
+    PublicSuffixMatcher matcher;
+    for (int i = 1; i <= depth && !matcher.isDone(); ++i) {
+        QString label = tree.label(tree.ancestor(node, i));
+        matcher.addLabel(label.constData(), label.length());
+    }
+    return matcher.suffixLabels();
 }
 
 bool NetworkCookieJarPrivate::matchingDomain(const QNetworkCookie &cookie, const QUrl &url) const
@@ -347,8 +781,8 @@ bool NetworkCookieJarPrivate::matchingDomain(const QNetworkCookie &cookie, const
             return true;
     }
 
-    // Check for blacklist
-    if (parts.count() == 2 && matchesBlacklist(parts.last()))
+    // Cookies can not be set for a public suffix
+    if (parts.count() > 1 && publicSuffixLabels(domain) >= parts.count())
         return false;
 
     QStringList urlParts = url.host().toLower().split(QLatin1Char('.'), QString::SkipEmptyParts);
@@ -370,6 +804,7 @@ void NetworkCookieJar::setSecondLevelDomains(const QStringList &secondLevelDomai
 {
     d->setSecondLevelDomain = true;
     d->secondLevelDomains = secondLevelDomains;
+    d->cache.clear();
     qSort(d->secondLevelDomains);
 }
 
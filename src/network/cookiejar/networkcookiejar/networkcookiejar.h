@@ -39,6 +39,23 @@
 
 #include <qnetworkcookie.h>
 
+class NetworkCookieChange
+{
+public:
+    enum Type {
+        Inserted,
+        Removed
+    };
+
+    NetworkCookieChange(Type type = Inserted, const QNetworkCookie &cookie = QNetworkCookie())
+        : type(type)
+        , cookie(cookie)
+    {}
+
+    Type type;
+    QNetworkCookie cookie;
+};
+
 class NetworkCookieJarPrivate;
 class NetworkCookieJar : public QNetworkCookieJar {
     Q_OBJECT
@@ -53,10 +70,18 @@ protected:
     QByteArray saveState() const;
     bool restoreState(const QByteArray &state);
     void endSession();
+    bool removeExpiredCookies();
+    void insertCookie(const QNetworkCookie &cookie);
 
     QList<QNetworkCookie> allCookies() const;
     void setAllCookies(const QList<QNetworkCookie> &cookieList);
+    void addCookies(const QList<QNetworkCookie> &cookieList);
     void setSecondLevelDomains(const QStringList &secondLevelDomains);
+    void setMaximumCookies(int maximum);
+    void setMaximumCookiesPerDomain(int maximum);
+
+    void setRecordChanges(bool record);
+    QList<NetworkCookieChange> takeChanges(bool *reset);
 
 private:
     NetworkCookieJarPrivate *d;
@@ -39,6 +39,8 @@
 
 #include "trie_p.h"
 
+#include <qcache.h>
+
 QT_BEGIN_NAMESPACE
 QDataStream &operator<<(QDataStream &stream, const QNetworkCookie &cookie)
 {
@@ -57,17 +59,102 @@ QDataStream &operator>>(QDataStream &stream, QNetworkCookie &cookie)
 }
 QT_END_NAMESPACE
 
+/*
+    Cookies replace each other when name, domain and path are the same.
+*/
+template<>
+struct TrieValueKey<QNetworkCookie> {
+    static QString key(const QNetworkCookie &cookie)
+    {
+        return QString::fromLatin1(cookie.name()) + QLatin1Char('\n')
+               + cookie.domain() + QLatin1Char('\n') + cookie.path();
+    }
+};
+
+/*
+    Min-heap of the cookies that have an expiration date, ordered by the
+    time they expire.  Entries are not taken out when a cookie is replaced
+    or removed from the tree, they are skipped when they come up instead.
+*/
+class CookieExpiryHeap {
+public:
+    inline bool isEmpty() const { return m_entries.isEmpty(); }
+    inline int count() const { return m_entries.count(); }
+    inline uint next() const { return m_entries.first().expires; }
+
+    void clear();
+    void insert(const QNetworkCookie &cookie);
+    void rebuild(const QList<QNetworkCookie> &cookies);
+    void rebuild(const Trie<QNetworkCookie> &tree);
+    QNetworkCookie take();
+
+    static uint expirationTime(const QNetworkCookie &cookie);
+
+private:
+    struct Entry {
+        uint expires;
+        QNetworkCookie cookie;
+    };
+    void append(const QNetworkCookie &cookie);
+    void heapify();
+    void siftDown(int index, const Entry &entry);
+
+    QVector<Entry> m_entries;
+};
+
+/*
+    The cookies returned for a host, path and secure flag together with
+    the trie nodes they were collected from.  The entry is out of date as
+    soon as one of those nodes changed or one of the cookies expired.
+*/
+struct CookieCacheEntry {
+    QList<QNetworkCookie> cookies;
+    QVector<int> nodes;
+    QVector<uint> generations;
+    uint expires;
+};
+
 class NetworkCookieJarPrivate {
 public:
     NetworkCookieJarPrivate()
-        : setSecondLevelDomain(false)
+        : cache(128)
+        , staleExpiries(0)
+        , maximumCookies(-1)
+        , maximumCookiesPerDomain(-1)
+        , recordChanges(false)
+        , changesReset(false)
+        , setSecondLevelDomain(false)
     {}
 
     Trie<QNetworkCookie> tree;
-    mutable bool setSecondLevelDomain;
-    mutable QStringList secondLevelDomains;
+    mutable QCache<QString, CookieCacheEntry> cache;
+    CookieExpiryHeap expiry;
+    int staleExpiries;
+    int maximumCookies;
+    int maximumCookiesPerDomain;
+    bool recordChanges;
+    bool changesReset;
+    QList<NetworkCookieChange> changes;
+    bool setSecondLevelDomain;
+    QStringList secondLevelDomains;
+
+    void insert(const QNetworkCookie &cookie);
+    bool remove(const QNetworkCookie &cookie);
+    bool take(const QNetworkCookie &cookie);
+    void removed(const QNetworkCookie &cookie);
+    void setAll(const QList<QNetworkCookie> &cookies);
+    int expire(uint now);
+    void record(NetworkCookieChange::Type type, const QNetworkCookie &cookie);
+    bool isCurrent(const CookieCacheEntry &entry, uint now) const;
+    int registrableDomain(int node) const;
+    void enforceLimits(const QNetworkCookie &inserted);
+    void enforceLimits(const QList<QNetworkCookie> &added);
+    void evict(int root, int count, const QNetworkCookie &keep);
+    void reset();
 
     bool matchesBlacklist(const QString &string) const;
+    int publicSuffixLabels(const QString &host) const;
+    int publicSuffixLabels(int node) const;
     bool matchingDomain(const QNetworkCookie &cookie, const QUrl &url) const;
     QString urlPath(const QUrl &url) const;
     bool matchingPath(const QNetworkCookie &cookie, const QString &urlPath) const;
@@ -0,0 +1,166 @@
+/*
+   Copyright (C) 2009, Torch Mobile Inc. and Linden Research, Inc. All rights reserved.
+*/
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is Torch Mobile Inc. (http://www.torchmobile.com/) code
+ *
+ * The Initial Developer of the Original Code is:
+ *   Benjamin Meyer (benjamin.meyer@torchmobile.com)
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+
+#ifndef PUBLICSUFFIX_H
+#define PUBLICSUFFIX_H
+
+#include <qstring.h>
+#include <qurl.h>
+
+enum PublicSuffixFlag {
+    PublicSuffixRule = 0x1,
+    PublicSuffixWildcard = 0x2,
+    PublicSuffixException = 0x4
+};
+
+/*
+    A node of the public suffix label tree, the children of a node are
+    stored next to each other sorted by label.
+*/
+struct PublicSuffixNode {
+    quint32 label;
+    quint8 length;
+    quint8 flags;
+    quint16 childCount;
+    quint32 firstChild;
+};
+
+// To update the table see public_suffix_list.dat
+#include "publicsuffixdata_p.h"
+
+/*
+    Finds the number of labels of a host that are a public suffix.  The
+    labels are added starting at the top level domain until isDone().
+
+    A host that no rule matches has its top level domain as the suffix.
+*/
+class PublicSuffixMatcher
+{
+public:
+    PublicSuffixMatcher() : m_node(0), m_labels(0), m_suffix(0), m_done(false) {}
+
+    inline bool isDone() const { return m_done; }
+    inline int suffixLabels() const { return m_suffix; }
+    inline void addLabel(const QChar *label, int length);
+
+private:
+    static inline int compare(const QChar *label, int length, const PublicSuffixNode &node);
+    static inline int child(int node, const QChar *label, int length);
+
+    int m_node;
+    int m_labels;
+    int m_suffix;
+    bool m_done;
+};
+
+void PublicSuffixMatcher::addLabel(const QChar *label, int length)
+{
+    if (m_done)
+        return;
+    ++m_labels;
+
+    // The table holds the ascii form of the labels
+    QString ace;
+    for (int i = 0; i < length; ++i) {
+        if (label[i].unicode() > 0x7f) {
+            ace = QString::fromLatin1(QUrl::toAce(QString(label, length)));
+            label = ace.constData();
+            length = ace.length();
+            break;
+        }
+    }
+
+    // The root matches everything, the implicit "*" rule
+    const PublicSuffixNode &parent = publicSuffixNodes[m_node];
+    bool wildcard = (m_node == 0 || (parent.flags & PublicSuffixWildcard));
+    int next = child(m_node, label, length);
+    if (next == -1) {
+        if (wildcard)
+            m_suffix = m_labels;
+        m_done = true;
+        return;
+    }
+
+    const PublicSuffixNode &node = publicSuffixNodes[next];
+    if (node.flags & PublicSuffixException) {
+        m_suffix = m_labels - 1;
+        m_done = true;
+        return;
+    }
+    if (wildcard || (node.flags & PublicSuffixRule))
+        m_suffix = m_labels;
+    m_node = next;
+    if (node.childCount == 0 && !(node.flags & PublicSuffixWildcard))
+        m_done = true;
+}
+
+int PublicSuffixMatcher::compare(const QChar *label, int length, const PublicSuffixNode &node)
+{
+    const char *nodeLabel = publicSuffixLabels + node.label;
+    int common = qMin(length, int(node.length));
+    for (int i = 0; i < common; ++i) {
+        ushort c = label[i].unicode();
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        ushort n = uchar(nodeLabel[i]);
+        if (c != n)
+            return c < n ? -1 : 1;
+    }
+    return length - int(node.length);
+}
+
+/*
+    Binary searches the children of \a node for \a label.
+*/
+int PublicSuffixMatcher::child(int node, const QChar *label, int length)
+{
+    int low = publicSuffixNodes[node].firstChild;
+    int high = low + publicSuffixNodes[node].childCount;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        int result = compare(label, length, publicSuffixNodes[middle]);
+        if (result == 0)
+            return middle;
+        if (result < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return -1;
+}
+
+#endif
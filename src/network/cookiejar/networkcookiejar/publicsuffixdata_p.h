@@ -0,0 +1,135 @@
+// Generated by tools/publicsuffix from public_suffix_list.dat, do not edit
+
+static const char publicSuffixLabels[] =
+    "ao"
+    "ar"
+    "arpa"
+    "bd"
+    "bn"
+    "br"
+    "ck"
+    "co"
+    "cr"
+    "cy"
+    "do"
+    "eg"
+    "et"
+    "fj"
+    "fk"
+    "gh"
+    "gn"
+    "gu"
+    "id"
+    "il"
+    "jm"
+    "ke"
+    "kh"
+    "ki"
+    "kw"
+    "kz"
+    "lb"
+    "lc"
+    "lr"
+    "ls"
+    "ml"
+    "mm"
+    "mv"
+    "mw"
+    "mx"
+    "my"
+    "ng"
+    "ni"
+    "np"
+    "nz"
+    "om"
+    "pa"
+    "pe"
+    "pg"
+    "pw"
+    "py"
+    "qa"
+    "sa"
+    "sb"
+    "sv"
+    "sy"
+    "th"
+    "tn"
+    "tz"
+    "uk"
+    "uy"
+    "va"
+    "ve"
+    "ye"
+    "yu"
+    "za"
+    "zm"
+    "zw"
+    "www";
+
+static const PublicSuffixNode publicSuffixNodes[] = {
+    { 0, 0, 0, 63, 1 }, // root
+    { 0, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // ao
+    { 2, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // ar
+    { 4, 4, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // arpa
+    { 8, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // bd
+    { 10, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // bn
+    { 12, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // br
+    { 14, 2, PublicSuffixRule | PublicSuffixWildcard, 1, 64 }, // ck
+    { 16, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // co
+    { 18, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // cr
+    { 20, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // cy
+    { 22, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // do
+    { 24, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // eg
+    { 26, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // et
+    { 28, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // fj
+    { 30, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // fk
+    { 32, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // gh
+    { 34, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // gn
+    { 36, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // gu
+    { 38, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // id
+    { 40, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // il
+    { 42, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // jm
+    { 44, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // ke
+    { 46, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // kh
+    { 48, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // ki
+    { 50, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // kw
+    { 52, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // kz
+    { 54, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // lb
+    { 56, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // lc
+    { 58, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // lr
+    { 60, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // ls
+    { 62, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // ml
+    { 64, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // mm
+    { 66, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // mv
+    { 68, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // mw
+    { 70, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // mx
+    { 72, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // my
+    { 74, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // ng
+    { 76, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // ni
+    { 78, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // np
+    { 80, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // nz
+    { 82, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // om
+    { 84, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // pa
+    { 86, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // pe
+    { 88, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // pg
+    { 90, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // pw
+    { 92, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // py
+    { 94, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // qa
+    { 96, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // sa
+    { 98, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // sb
+    { 100, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // sv
+    { 102, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // sy
+    { 104, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // th
+    { 106, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // tn
+    { 108, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // tz
+    { 110, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // uk
+    { 112, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // uy
+    { 114, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // va
+    { 116, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // ve
+    { 118, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // ye
+    { 120, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // yu
+    { 122, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // za
+    { 124, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // zm
+    { 126, 2, PublicSuffixRule | PublicSuffixWildcard, 0, 0 }, // zw
+    { 128, 3, PublicSuffixException, 0, 0 }, // www
+};
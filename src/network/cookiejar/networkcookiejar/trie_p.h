@@ -39,55 +39,315 @@
 
 //#define TRIE_DEBUG
 
+#include <qdatastream.h>
+#include <qhash.h>
+#include <qmap.h>
 #include <qstringlist.h>
+#include <qvector.h>
 
 #if defined(TRIE_DEBUG)
 #include <qdebug.h>
 #endif
 
+/*
+    Walks the labels of a host name from the last one to the first
+    without copying them, "www.example.com" gives "com", "example"
+    and then "www".  Leading and trailing dots are ignored.
+*/
+class TrieKey
+{
+public:
+    inline TrieKey(const QString &key);
+
+    inline bool next();
+    inline const QChar *label() const { return m_label; }
+    inline int length() const { return m_length; }
+
+private:
+    const QChar *m_begin;
+    const QChar *m_end;
+    const QChar *m_label;
+    int m_length;
+    bool m_atEnd;
+};
+
+TrieKey::TrieKey(const QString &key)
+    : m_begin(key.unicode())
+    , m_end(key.unicode() + key.length())
+    , m_label(0)
+    , m_length(0)
+{
+    while (m_end != m_begin && *(m_end - 1) == QLatin1Char('.'))
+        --m_end;
+    while (m_begin != m_end && *m_begin == QLatin1Char('.'))
+        ++m_begin;
+    m_atEnd = (m_begin == m_end);
+}
+
+bool TrieKey::next()
+{
+    if (m_atEnd)
+        return false;
+    const QChar *begin = m_end;
+    while (begin != m_begin && *(begin - 1) != QLatin1Char('.'))
+        --begin;
+    m_label = begin;
+    m_length = m_end - begin;
+    if (begin == m_begin)
+        m_atEnd = true;
+    else
+        m_end = begin - 1;
+    return true;
+}
+
+/*
+    Interns the labels used as keys in the Trie so that each level
+    only has to compare integers.  Looking up a label that is already
+    known does not allocate.
+*/
+class TrieLabels
+{
+public:
+    inline void clear();
+    inline int count() const { return m_labels.count(); }
+    inline const QString &at(int id) const { return m_labels.at(id); }
+
+    inline int find(const QChar *label, int length) const;
+    inline int intern(const QChar *label, int length);
+    inline int intern(const QString &label) { return intern(label.unicode(), label.length()); }
+
+private:
+    static inline uint hash(const QChar *label, int length);
+    inline void link(int id);
+
+    QVector<QString> m_labels;
+    QVector<uint> m_hashes;
+    QVector<int> m_next;
+    QVector<int> m_buckets;
+};
+
+void TrieLabels::clear()
+{
+    m_labels.clear();
+    m_hashes.clear();
+    m_next.clear();
+    m_buckets.clear();
+}
+
+uint TrieLabels::hash(const QChar *label, int length)
+{
+    uint h = 0;
+    while (length--) {
+        h = (h << 4) + (label++)->unicode();
+        h ^= (h & 0xf0000000) >> 23;
+        h &= 0x0fffffff;
+    }
+    return h;
+}
+
+int TrieLabels::find(const QChar *label, int length) const
+{
+    if (m_buckets.isEmpty())
+        return -1;
+    uint h = hash(label, length);
+    int id = m_buckets.at(h & (m_buckets.count() - 1));
+    while (id != -1) {
+        const QString &candidate = m_labels.at(id);
+        if (m_hashes.at(id) == h && candidate.length() == length) {
+            const QChar *c = candidate.unicode();
+            int i = 0;
+            while (i < length && c[i] == label[i])
+                ++i;
+            if (i == length)
+                return id;
+        }
+        id = m_next.at(id);
+    }
+    return -1;
+}
+
+int TrieLabels::intern(const QChar *label, int length)
+{
+    int id = find(label, length);
+    if (id != -1)
+        return id;
+
+    id = m_labels.count();
+    m_labels.append(QString(label, length));
+    m_hashes.append(hash(label, length));
+    m_next.append(-1);
+    if (m_labels.count() <= m_buckets.count()) {
+        link(id);
+        return id;
+    }
+
+    m_buckets.fill(-1, qMax(16, m_buckets.count() * 2));
+    for (int i = 0; i < m_labels.count(); ++i)
+        link(i);
+    return id;
+}
+
+void TrieLabels::link(int id)
+{
+    int bucket = m_hashes.at(id) & (m_buckets.count() - 1);
+    m_next[id] = m_buckets.at(bucket);
+    m_buckets[bucket] = id;
+}
+
+/*
+    The values of a node are indexed by the key returned from
+    TrieValueKey<T>::key(), a node holds at most one value for each key.
+    It has to be specialized for the type stored in the Trie.
+*/
+template<class T>
+struct TrieValueKey;
+
+struct TrieChild
+{
+    int label;
+    int node;
+};
+Q_DECLARE_TYPEINFO(TrieChild, Q_PRIMITIVE_TYPE);
+
 /*
     A Trie tree (prefix tree) where the lookup takes m in the worst case.
 
-    The key is stored in _reverse_ order
+    The key is a host name and is walked in _reverse_ order, one label
+    at a time.
 
     Example:
-    Keys: x,a y,a
+    Keys: x.a y.a
 
     Trie:
     a
     | \
     x  y
-*/
 
+    The nodes live in a single pool and are referred to by index, the
+    root is always node 0.  Every node knows its parent so a lookup can
+    go to the deepest node of a host and then walk up through the parent
+    domains.  Children are kept sorted by interned label id.
+
+    Inserting a value replaces the value with the same TrieValueKey in
+    that node.
+
+    Every node has a generation that changes whenever its values or its
+    children change, so results built from a set of nodes can be checked
+    for being out of date.  Generations are never reused, not even after
+    clear().
+
+    Nodes also count the values below them.
+
+    The const_iterator goes over all the values node by node in the
+    order of the pool, not in key order.  It is invalidated by any
+    change to the Trie, use removeIf() to remove values while going
+    over them.
+*/
 template<class T>
 class Trie {
+    struct Node;
+
 public:
+    class const_iterator
+    {
+    public:
+        inline const_iterator() : m_nodes(0), m_node(0), m_value(0) {}
+        inline const T &operator*() const { return m_nodes->at(m_node).values.at(m_value); }
+        inline const T *operator->() const { return &operator*(); }
+        inline int node() const { return m_node; }
+        inline bool operator==(const const_iterator &other) const
+            { return m_node == other.m_node && m_value == other.m_value; }
+        inline bool operator!=(const const_iterator &other) const
+            { return !(*this == other); }
+        inline const_iterator &operator++() { ++m_value; skip(); return *this; }
+
+    private:
+        friend class Trie<T>;
+        inline const_iterator(const QVector<Node> *nodes, int node)
+            : m_nodes(nodes), m_node(node), m_value(0) { skip(); }
+        inline void skip() {
+            while (m_node < m_nodes->count() && m_value >= m_nodes->at(m_node).values.count()) {
+                ++m_node;
+                m_value = 0;
+            }
+        }
+
+        const QVector<Node> *m_nodes;
+        int m_node;
+        int m_value;
+    };
+    friend class const_iterator;
+
     Trie();
     ~Trie();
 
     void clear();
-    void insert(const QStringList &key, const T &value);
-    bool remove(const QStringList &key, const T &value);
-    QList<T> find(const QStringList &key) const;
+    bool insert(const QString &key, const T &value, T *replaced = 0);
+    bool remove(const QString &key, const T &value);
+    bool take(const QString &key, const QString &valueKey, T *value = 0);
+    QList<T> find(const QString &key) const;
     QList<T> all() const;
-
-    inline bool contains(const QStringList &key) const;
-    inline bool isEmpty() const { return children.isEmpty() && values.isEmpty(); }
+    template<class Predicate> int removeIf(Predicate &predicate);
+
+    inline const_iterator begin() const { return const_iterator(&m_nodes, 0); }
+    inline const_iterator end() const { return const_iterator(&m_nodes, m_nodes.count()); }
+    inline const_iterator constBegin() const { return begin(); }
+    inline const_iterator constEnd() const { return end(); }
+
+    inline bool contains(const QString &key) const { return node(key) != -1; }
+    inline bool isEmpty() const
+        { return m_nodes.at(0).children.isEmpty() && m_nodes.at(0).values.isEmpty(); }
+
+    int node(const QString &key) const;
+    int closestNode(const QString &key, int *labels = 0) const;
+    inline int parent(int node) const { return m_nodes.at(node).parent; }
+    inline int depth(int node) const { return m_nodes.at(node).depth; }
+    inline uint generation(int node) const { return m_nodes.at(node).generation; }
+    inline int count(int node = 0) const { return m_nodes.at(node).count; }
+    int ancestor(int node, int depth) const;
+    QVector<int> subtree(int node) const;
+    inline QString label(int node) const;
+    inline const QList<T> &values(int node) const { return m_nodes.at(node).values; }
 
 private:
-    const Trie<T>* walkTo(const QStringList &key) const;
-    Trie<T>* walkTo(const QStringList &key, bool create = false);
+    struct Node {
+        Node() : label(-1), parent(-1), depth(0), generation(0), count(0) {}
+        int label;
+        int parent;
+        int depth;
+        uint generation;
+        int count;
+        QVector<TrieChild> children;
+        QList<T> values;
+        QHash<QString, int> index;
+    };
+
+    static int lowerBound(const QVector<TrieChild> &children, int label);
+    int child(int node, int label) const;
+    int addChild(int node, int label);
+    bool addValue(int node, const T &value, T *replaced);
+    void removeValue(int node, int index, const QString &valueKey);
+    void prune(int node);
+    void addCount(int node, int count);
+    inline void touch(int node) { m_nodes[node].generation = ++m_generation; }
+
+    void write(QDataStream &out, int node) const;
+    void read(QDataStream &in, int node);
 
     template<class T1> friend QDataStream &operator<<(QDataStream &, const Trie<T1>&);
     template<class T1> friend QDataStream &operator>>(QDataStream &, Trie<T1>&);
 
-    QList<T> values;
-    QStringList childrenKeys;
-    QList<Trie<T> > children;
+    QVector<Node> m_nodes;
+    QVector<int> m_freeNodes;
+    TrieLabels m_labels;
+    uint m_generation;
 };
 
 template<class T>
-Trie<T>::Trie() {
+Trie<T>::Trie()
+    : m_generation(0) {
+    m_nodes.append(Node());
+    touch(0);
 }
 
 template<class T>
@@ -99,72 +359,86 @@ void Trie<T>::clear() {
 #if defined(TRIE_DEBUG)
     qDebug() << "Trie::" << __FUNCTION__;
 #endif
-    values.clear();
-    childrenKeys.clear();
-    children.clear();
+    m_nodes.clear();
+    m_nodes.append(Node());
+    touch(0);
+    m_freeNodes.clear();
+    m_labels.clear();
 }
 
 template<class T>
-bool Trie<T>::contains(const QStringList &key) const {
-    return walkTo(key);
+QString Trie<T>::label(int node) const {
+    int label = m_nodes.at(node).label;
+    if (label == -1)
+        return QString();
+    return m_labels.at(label);
 }
 
+/*
+    Inserts \a value under \a key, returns true if it replaced a value
+    with the same value key, which is then stored in \a replaced.
+*/
 template<class T>
-void Trie<T>::insert(const QStringList &key, const T &value) {
+bool Trie<T>::insert(const QString &key, const T &value, T *replaced) {
 #if defined(TRIE_DEBUG)
     qDebug() << "Trie::" << __FUNCTION__ << key << value;
 #endif
-    Trie<T> *node = walkTo(key, true);
-    if (node)
-        node->values.append(value);
+    int node = 0;
+    TrieKey walker(key);
+    while (walker.next())
+        node = addChild(node, m_labels.intern(walker.label(), walker.length()));
+    return addValue(node, value, replaced);
 }
 
+/*
+    Removes \a value from \a key if it is stored there unchanged.
+*/
 template<class T>
-bool Trie<T>::remove(const QStringList &key, const T &value) {
+bool Trie<T>::remove(const QString &key, const T &value) {
 #if defined(TRIE_DEBUG)
     qDebug() << "Trie::" << __FUNCTION__ << key << value;
 #endif
-    Trie<T> *node = walkTo(key, true);
-    if (node) {
-        bool removed = node->values.removeOne(value);
-        if (!removed)
-            return false;
-
-        // A faster implementation of removing nodes up the tree
-        // can be created if profile shows this to be slow
-        QStringList subKey = key;
-        while (node->values.isEmpty()
-               && node->children.isEmpty()
-               && !subKey.isEmpty()) {
-            QString currentLevelKey = subKey.first();
-            QStringList parentKey = subKey.mid(1);
-            Trie<T> *parent = walkTo(parentKey, false);
-            Q_ASSERT(parent);
-            QStringList::iterator iterator;
-            iterator = qBinaryFind(parent->childrenKeys.begin(),
-                                   parent->childrenKeys.end(),
-                                   currentLevelKey);
-            Q_ASSERT(iterator != parent->childrenKeys.end());
-            int index = iterator - parent->childrenKeys.begin();
-            parent->children.removeAt(index);
-            parent->childrenKeys.removeAt(index);
-
-            node = parent;
-            subKey = parentKey;
-        }
-        return removed;
-    }
-    return false;
+    int node = this->node(key);
+    if (node == -1)
+        return false;
+    const QString valueKey = TrieValueKey<T>::key(value);
+    int index = m_nodes.at(node).index.value(valueKey, -1);
+    if (index == -1 || !(m_nodes.at(node).values.at(index) == value))
+        return false;
+    removeValue(node, index, valueKey);
+    prune(node);
+    return true;
 }
 
+/*
+    Removes the value with \a valueKey from \a key whatever it is.
+*/
 template<class T>
-QList<T> Trie<T>::find(const QStringList &key) const {
+bool Trie<T>::take(const QString &key, const QString &valueKey, T *value) {
+#if defined(TRIE_DEBUG)
+    qDebug() << "Trie::" << __FUNCTION__ << key << valueKey;
+#endif
+    int node = this->node(key);
+    if (node == -1)
+        return false;
+    int index = m_nodes.at(node).index.value(valueKey, -1);
+    if (index == -1)
+        return false;
+    if (value)
+        *value = m_nodes.at(node).values.at(index);
+    removeValue(node, index, valueKey);
+    prune(node);
+    return true;
+}
+
+template<class T>
+QList<T> Trie<T>::find(const QString &key) const {
 #if defined(TRIE_DEBUG)
     qDebug() << "Trie::" << __FUNCTION__ << key;
 #endif
-    const Trie<T> *node = walkTo(key);
-    if (node)
-        return node->values;
+    int node = this->node(key);
+    if (node != -1)
+        return m_nodes.at(node).values;
     return QList<T>();
 }
 
@@ -173,83 +447,275 @@ QList<T> Trie<T>::all() const {
 #if defined(TRIE_DEBUG)
     qDebug() << "Trie::" << __FUNCTION__;
 #endif
-    QList<T> all = values;
-    for (int i = 0; i < children.count(); ++i)
-        all += children[i].all();
+    QList<T> all;
+    for (int i = 0; i < m_nodes.count(); ++i)
+        all += m_nodes.at(i).values;
     return all;
 }
 
+/*
+    Removes every value that \a predicate returns true for, returns the
+    number of values removed.
+*/
 template<class T>
-QDataStream &operator<<(QDataStream &out, const Trie<T>&trie) {
-    out << trie.values;
-    out << trie.childrenKeys;
-    out << trie.children;
-    Q_ASSERT(trie.childrenKeys.count() == trie.children.count());
-    return out;
+template<class Predicate>
+int Trie<T>::removeIf(Predicate &predicate) {
+    int removed = 0;
+    for (int node = 0; node < m_nodes.count(); ++node) {
+        int count = m_nodes.at(node).values.count();
+        // Going backwards the value that is moved into a hole was seen already
+        for (int i = count - 1; i >= 0; --i) {
+            const T &value = m_nodes.at(node).values.at(i);
+            if (predicate(value)) {
+                removeValue(node, i, TrieValueKey<T>::key(value));
+                ++removed;
+            }
+        }
+        if (m_nodes.at(node).values.count() != count)
+            prune(node);
+    }
+#if defined(TRIE_DEBUG)
+    qDebug() << "Trie::" << __FUNCTION__ << removed;
+#endif
+    return removed;
 }
 
+/*
+    Returns the node for \a key or -1 if there is none.
+*/
 template<class T>
-QDataStream &operator>>(QDataStream &in, Trie<T> &trie) {
-    trie.clear();
-    in >> trie.values;
-    in >> trie.childrenKeys;
-    in >> trie.children;
-    Q_ASSERT(trie.childrenKeys.count() == trie.children.count());
-    return in;
+int Trie<T>::node(const QString &key) const {
+    int node = 0;
+    TrieKey walker(key);
+    while (walker.next()) {
+        int label = m_labels.find(walker.label(), walker.length());
+        if (label == -1)
+            return -1;
+        node = child(node, label);
+        if (node == -1)
+            return -1;
+    }
+    return node;
 }
 
-// Very fast const walk
+/*
+    Returns the deepest node on the way to \a key, that is the node
+    itself or the closest parent domain that has a node.  If \a labels
+    is set it is given the number of labels in \a key.
+*/
 template<class T>
-const Trie<T>* Trie<T>::walkTo(const QStringList &key) const {
-    const Trie<T> *node = this;
-    QStringList::const_iterator childIterator;
-    QStringList::const_iterator begin, end;
-
-    int depth = key.count() - 1;
-    while (depth >= 0) {
-        const QString currentLevelKey = key.at(depth--);
-        begin = node->childrenKeys.constBegin();
-        end = node->childrenKeys.constEnd();
-        childIterator = qBinaryFind(begin, end, currentLevelKey);
-        if (childIterator == end)
-            return 0;
-        node = &node->children.at(childIterator - begin);
+int Trie<T>::closestNode(const QString &key, int *labels) const {
+    int node = 0;
+    int count = 0;
+    bool found = true;
+    TrieKey walker(key);
+    while (walker.next()) {
+        ++count;
+        if (!found)
+            continue;
+        int label = m_labels.find(walker.label(), walker.length());
+        int next = (label == -1) ? -1 : child(node, label);
+        if (next == -1) {
+            found = false;
+            if (!labels)
+                break;
+        } else {
+            node = next;
+        }
     }
+    if (labels)
+        *labels = count;
     return node;
 }
 
 template<class T>
-Trie<T>* Trie<T>::walkTo(const QStringList &key, bool create) {
-    QStringList::iterator iterator;
-    Trie<T> *node = this;
-    QStringList::iterator begin, end;
-    int depth = key.count() - 1;
-    while (depth >= 0) {
-        const QString currentLevelKey = key.at(depth--);
-        begin = node->childrenKeys.begin();
-        end = node->childrenKeys.end();
-        iterator = qBinaryFind(begin, end, currentLevelKey);
-#if defined(TRIE_DEBUG)
-        qDebug() << "\t" << node << key << currentLevelKey << node->childrenKeys;
-#endif
-        int index = -1;
-        if (iterator == end) {
-            if (!create)
-                return 0;
-            iterator = qLowerBound(begin,
-                                   end,
-                                   currentLevelKey);
-            index = iterator - begin;
-            node->childrenKeys.insert(iterator, currentLevelKey);
-            node->children.insert(index, Trie<T>());
-        } else {
-            index = iterator - begin;
-        }
-        Q_ASSERT(index >= 0 && index < node->children.count());
-        node = &node->children[index];
+int Trie<T>::lowerBound(const QVector<TrieChild> &children, int label) {
+    int low = 0;
+    int high = children.count();
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (children.at(middle).label < label)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+template<class T>
+int Trie<T>::child(int node, int label) const {
+    const QVector<TrieChild> &children = m_nodes.at(node).children;
+    int index = lowerBound(children, label);
+    if (index == children.count() || children.at(index).label != label)
+        return -1;
+    return children.at(index).node;
+}
+
+template<class T>
+int Trie<T>::addChild(int node, int label) {
+    int index = lowerBound(m_nodes.at(node).children, label);
+    if (index < m_nodes.at(node).children.count()
+        && m_nodes.at(node).children.at(index).label == label)
+        return m_nodes.at(node).children.at(index).node;
+
+    int child;
+    if (!m_freeNodes.isEmpty()) {
+        child = m_freeNodes.last();
+        m_freeNodes.remove(m_freeNodes.count() - 1);
+    } else {
+        child = m_nodes.count();
+        m_nodes.append(Node());
+    }
+    Node &created = m_nodes[child];
+    created.label = label;
+    created.parent = node;
+    created.depth = m_nodes.at(node).depth + 1;
+
+    TrieChild entry;
+    entry.label = label;
+    entry.node = child;
+    m_nodes[node].children.insert(index, entry);
+    touch(child);
+    touch(node);
+    return child;
+}
+
+template<class T>
+bool Trie<T>::addValue(int node, const T &value, T *replaced) {
+    touch(node);
+    Node &current = m_nodes[node];
+    const QString valueKey = TrieValueKey<T>::key(value);
+    QHash<QString, int>::iterator it = current.index.find(valueKey);
+    if (it != current.index.end()) {
+        if (replaced)
+            *replaced = current.values.at(it.value());
+        current.values[it.value()] = value;
+        return true;
+    }
+    current.index.insert(valueKey, current.values.count());
+    current.values.append(value);
+    addCount(node, 1);
+    return false;
+}
+
+/*
+    The order of the values in a node does not matter, the last value
+    is moved into the hole so nothing else has to be renumbered.
+*/
+template<class T>
+void Trie<T>::removeValue(int node, int index, const QString &valueKey) {
+    touch(node);
+    Node &current = m_nodes[node];
+    int last = current.values.count() - 1;
+    if (index != last) {
+        current.values[index] = current.values.at(last);
+        current.index[TrieValueKey<T>::key(current.values.at(index))] = index;
+    }
+    current.values.removeLast();
+    current.index.remove(valueKey);
+    addCount(node, -1);
+}
+
+template<class T>
+void Trie<T>::addCount(int node, int count) {
+    while (node != -1) {
+        m_nodes[node].count += count;
+        node = m_nodes.at(node).parent;
     }
+}
+
+/*
+    Returns the parent of \a node, or \a node itself, that is at \a depth.
+*/
+template<class T>
+int Trie<T>::ancestor(int node, int depth) const {
+    while (m_nodes.at(node).depth > depth)
+        node = m_nodes.at(node).parent;
     return node;
 }
 
-#endif
+/*
+    Returns \a node and every node below it.
+*/
+template<class T>
+QVector<int> Trie<T>::subtree(int node) const {
+    QVector<int> nodes;
+    nodes.append(node);
+    for (int i = 0; i < nodes.count(); ++i) {
+        const QVector<TrieChild> &children = m_nodes.at(nodes.at(i)).children;
+        for (int j = 0; j < children.count(); ++j)
+            nodes.append(children.at(j).node);
+    }
+    return nodes;
+}
+
+/*
+    Removes \a node and any parents that are left without values or
+    children.
+*/
+template<class T>
+void Trie<T>::prune(int node) {
+    while (node != 0
+           && m_nodes.at(node).values.isEmpty()
+           && m_nodes.at(node).children.isEmpty()) {
+        int parent = m_nodes.at(node).parent;
+        QVector<TrieChild> &children = m_nodes[parent].children;
+        int index = lowerBound(children, m_nodes.at(node).label);
+        Q_ASSERT(index < children.count() && children.at(index).node == node);
+        children.remove(index);
+        m_nodes[node] = Node();
+        touch(node);
+        touch(parent);
+        m_freeNodes.append(node);
+        node = parent;
+    }
+}
+
+/*
+    The stream layout is the one of the original recursive Trie, the
+    values of a node, the sorted keys of its children and then each child.
+*/
+template<class T>
+void Trie<T>::write(QDataStream &out, int node) const {
+    const Node &current = m_nodes.at(node);
+    QMap<QString, int> children;
+    for (int i = 0; i < current.children.count(); ++i)
+        children.insert(m_labels.at(current.children.at(i).label), current.children.at(i).node);
+    out << current.values;
+    out << children.keys();
+    out << quint32(children.count());
+    QMap<QString, int>::const_iterator i = children.constBegin();
+    for (; i != children.constEnd(); ++i)
+        write(out, i.value());
+}
+
+template<class T>
+void Trie<T>::read(QDataStream &in, int node) {
+    QStringList keys;
+    QList<T> values;
+    quint32 count;
+    in >> values;
+    for (int i = 0; i < values.count(); ++i)
+        addValue(node, values.at(i), 0);
+    in >> keys;
+    in >> count;
+    if (count != quint32(keys.count()))
+        return;
+    for (int i = 0; i < keys.count() && in.status() == QDataStream::Ok; ++i)
+        read(in, addChild(node, m_labels.intern(keys.at(i))));
+}
 
+template<class T>
+QDataStream &operator<<(QDataStream &out, const Trie<T>&trie) {
+    trie.write(out, 0);
+    return out;
+}
+
+template<class T>
+QDataStream &operator>>(QDataStream &in, Trie<T> &trie) {
+    trie.clear();
+    trie.read(in, 0);
+    return in;
+}
+
+#endif
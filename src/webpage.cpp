@@ -100,6 +100,7 @@ WebPage::WebPage(QObject *parent)
     , m_openTargetBlankLinksIn(TabWidget::NewWindow)
     , m_javaScriptExternalObject(0)
     , m_javaScriptAroraObject(0)
+    , lastRequestFrame(0)
 {
     setPluginFactory(webPluginFactory());
     NetworkAccessManagerProxy *networkManagerProxy = new NetworkAccessManagerProxy(this);
@@ -193,6 +194,8 @@ void WebPage::populateNetworkRequest(QNetworkRequest &request)
 {
     if (request == lastRequest) {
         request.setAttribute((QNetworkRequest::Attribute)(pageAttributeId() + 1), lastRequestType);
+        request.setAttribute((QNetworkRequest::Attribute)(pageAttributeId() + 2),
+                             qVariantFromValue((void *) lastRequestFrame));
     }
     WebPageProxy::populateNetworkRequest(request);
 }
@@ -257,6 +260,7 @@ bool WebPage::acceptNavigationRequest(QWebFrame *frame, const QNetworkRequest &r
 {
     lastRequest = request;
     lastRequestType = type;
+    lastRequestFrame = frame;
 
     QString scheme = request.url().scheme();
     if (scheme == QLatin1String("mailto")
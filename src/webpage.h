@@ -107,6 +107,7 @@ protected:
 private:
     QNetworkRequest lastRequest;
     QWebPage::NavigationType lastRequestType;
+    QWebFrame *lastRequestFrame;
 
 };
 
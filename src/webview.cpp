@@ -126,6 +126,8 @@ WebView::WebView(QWidget *parent)
             this, SLOT(setProgress(int)));
     connect(this, SIGNAL(loadFinished(bool)),
             this, SLOT(loadFinished()));
+    connect(page()->mainFrame(), SIGNAL(urlChanged(const QUrl &)),
+            this, SLOT(applyAdBlockRules()));
     connect(page(), SIGNAL(aboutToLoadUrl(const QUrl &)),
             this, SIGNAL(urlChanged(const QUrl &)));
     connect(page(), SIGNAL(downloadRequested(const QNetworkRequest &)),
@@ -573,10 +575,15 @@ void WebView::loadFinished()
                    << "Url:" << url();
     }
     m_progress = 0;
-    AdBlockManager::instance()->page()->applyRulesToPage(page());
     BrowserApplication::instance()->autoFillManager()->fill(page());
 }
 
+// Element hiding is a user stylesheet, set it before the new page is laid out
+void WebView::applyAdBlockRules()
+{
+    AdBlockManager::instance()->page()->applyRulesToPage(page());
+}
+
 void WebView::loadUrl(const QUrl &url, const QString &title)
 {
     if (url.scheme() == QLatin1String("javascript")) {
@@ -127,6 +127,7 @@ private:
 private slots:
     void setProgress(int progress);
     void loadFinished();
+    void applyAdBlockRules();
     void setStatusBarText(const QString &string);
     void downloadRequested(const QNetworkRequest &request);
     void openActionUrlInNewTab();
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2008 Benjamin C. Meyer <ben@meyerhome.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include <QtCore/QtCore>
+
+struct Node {
+    QString label;
+    QStringList flags;
+    // label -> node, kept sorted the way the cookie jar searches them
+    QMap<QString, int> children;
+};
+
+static int child(QList<Node> *nodes, int parent, const QString &label)
+{
+    int index = (*nodes)[parent].children.value(label, -1);
+    if (index != -1)
+        return index;
+    Node node;
+    node.label = label;
+    nodes->append(node);
+    index = nodes->count() - 1;
+    (*nodes)[parent].children.insert(label, index);
+    return index;
+}
+
+static void addFlag(Node *node, const char *flag)
+{
+    if (!node->flags.contains(QLatin1String(flag)))
+        node->flags.append(QLatin1String(flag));
+}
+
+/*
+    Adds a rule of the list, "example.com", "*.example.com" or
+    "!www.example.com", to the tree of labels below the root.
+ */
+static bool addRule(QList<Node> *nodes, const QString &line)
+{
+    QString rule = line;
+    bool exception = rule.startsWith(QLatin1Char('!'));
+    if (exception)
+        rule = rule.mid(1);
+    QStringList labels = rule.split(QLatin1Char('.'));
+    bool wildcard = labels.first() == QLatin1String("*");
+    if (wildcard)
+        labels.removeFirst();
+    if (labels.isEmpty() || (wildcard && exception))
+        return false;
+
+    int node = 0;
+    while (!labels.isEmpty()) {
+        QString label = labels.takeLast();
+        // Hosts are looked up in their ascii form
+        QString ace = QString::fromLatin1(QUrl::toAce(label));
+        if (ace.isEmpty() || ace.length() > 255 || ace.contains(QLatin1Char('*')))
+            return false;
+        node = child(nodes, node, ace.toLower());
+    }
+    if (exception)
+        addFlag(&(*nodes)[node], "PublicSuffixException");
+    else if (wildcard)
+        addFlag(&(*nodes)[node], "PublicSuffixWildcard");
+    else
+        addFlag(&(*nodes)[node], "PublicSuffixRule");
+    return true;
+}
+
+/*!
+    A tool to compile the public suffix list, https://publicsuffix.org/list/,
+    into the table the cookie jar looks up the public suffix of a host in.
+
+    The nodes of the label tree are written breadth first so the children
+    of a node follow each other, sorted by label.
+
+    Example: ./publicsuffix public_suffix_list.dat -o publicsuffixdata_p.h
+*/
+int main(int argc, char **argv)
+{
+    QCoreApplication application(argc, argv);
+
+    QFile inFile;
+    QFile outFile;
+
+    // Either read in from stdin and output to stdout
+    // or read in from a file and output to a file
+    bool setInput = false;
+    bool setOutput = false;
+    QStringList args = application.arguments();
+    args.pop_front();
+    foreach (const QString &arg, args) {
+        if (arg == QLatin1String("-o")) {
+            setOutput = true;
+        } else if (setOutput) {
+            outFile.setFileName(arg);
+            outFile.open(QIODevice::WriteOnly);
+        } else if (QFile::exists(arg)) {
+            setInput = true;
+            inFile.setFileName(arg);
+            inFile.open(QIODevice::ReadOnly);
+        } else {
+            qWarning() << "Usage: publicsuffix"
+                       << "[stdin|listfile]" << "[stdout|-o outFile]";
+            return 1;
+        }
+    }
+    if (!setInput)
+        inFile.open(stdin, QIODevice::ReadOnly);
+    if (!setOutput)
+        outFile.open(stdout, QIODevice::WriteOnly);
+
+    QList<Node> nodes;
+    nodes.append(Node());
+    QTextStream in(&inFile);
+    in.setCodec("UTF-8");
+    int lineNumber = 0;
+    while (!in.atEnd()) {
+        QString line = in.readLine();
+        ++lineNumber;
+        // Only the text up to the first whitespace is part of the rule
+        line = line.section(QRegExp(QLatin1String("\\s")), 0, 0);
+        if (line.isEmpty() || line.startsWith(QLatin1String("//")))
+            continue;
+        if (!addRule(&nodes, line))
+            qWarning() << "publicsuffix: skipping unsupported rule at line" << lineNumber << line;
+    }
+
+    QList<int> order;
+    order.append(0);
+    for (int i = 0; i < order.count(); ++i)
+        order += nodes.at(order.at(i)).children.values();
+    QHash<int, int> positions;
+    for (int i = 0; i < order.count(); ++i)
+        positions[order.at(i)] = i;
+    if (order.count() > 0xffff) {
+        qWarning() << "publicsuffix: too many nodes" << order.count();
+        return 1;
+    }
+
+    QTextStream out(&outFile);
+    out << "// Generated by tools/publicsuffix from public_suffix_list.dat, do not edit\n";
+    out << "\n";
+    out << "static const char publicSuffixLabels[] =\n";
+    for (int i = 1; i < order.count(); ++i) {
+        out << "    \"" << nodes.at(order.at(i)).label << "\"";
+        out << (i == order.count() - 1 ? ";\n" : "\n");
+    }
+    if (order.count() == 1)
+        out << "    \"\";\n";
+    out << "\n";
+    out << "static const PublicSuffixNode publicSuffixNodes[] = {\n";
+    int offset = 0;
+    for (int i = 0; i < order.count(); ++i) {
+        const Node &node = nodes.at(order.at(i));
+        int firstChild = node.children.isEmpty() ? 0 : positions.value(node.children.constBegin().value());
+        QString flags = node.flags.isEmpty() ? QLatin1String("0") : node.flags.join(QLatin1String(" | "));
+        out << "    { " << offset << ", " << node.label.length() << ", " << flags
+            << ", " << node.children.count() << ", " << firstChild << " },";
+        out << (i == 0 ? QString(QLatin1String(" // root")) : QLatin1String(" // ") + node.label) << "\n";
+        offset += node.label.length();
+    }
+    out << "};\n";
+    return 0;
+}